@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""Compare two runs of the bench tool (src/bench) saved with --json.
+
+    bench --json > base.json
+    ... change something, rebuild ...
+    bench --json > new.json
+    scripts/bench_compare.py base.json new.json --threshold 5
+
+Prints the change in ns/op of every benchmark found in both runs and exits with status 1 when
+any of them got slower by more than the threshold, in percent.
+"""
+import argparse
+import json
+import sys
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith("{"):
+                result = json.loads(line)
+                results[result["name"]] = result
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare two bench --json runs.")
+    parser.add_argument("base")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="slowdown in percent counted as a regression (default: 5)")
+    parser.add_argument("--min", action="store_true",
+                        help="compare the fastest run of each benchmark instead of the median")
+    args = parser.parse_args()
+
+    base, new = load(args.base), load(args.new)
+    key = "ns_per_op_min" if args.min else "ns_per_op"
+    width = max((len(name) for name in base), default=0)
+
+    regressions = 0
+    for name, result in base.items():
+        if name not in new:
+            continue
+        before, after = result[key], new[name][key]
+        change = (after - before) / before * 100 if before else 0.0
+        mark = ""
+        if change > args.threshold:
+            mark = "  REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            mark = "  faster"
+        print(f"{name:<{width}} {before:12.3f} {after:12.3f} ns/op {change:+8.1f}%{mark}")
+
+    for name in sorted(set(base) ^ set(new)):
+        print(f"{name:<{width}} only in {'base' if name in base else 'new'}")
+
+    if regressions:
+        print(f"{regressions} regression(s) over {args.threshold}%")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""Generate src/romdb.inc from the CHIP-8 community database's programs.json."""
+import json
+import sys
+
+HEADER = """/*
+    Known ROM images, one ROM(sha1, title, platform, cycles_per_frame, keymap) entry per line.
+
+    sha1             - SHA-1 of the ROM image as 40 hex digits
+    platform         - modern, cosmac_vip, schip or xochip
+    cycles_per_frame - instructions executed per 60 Hz frame
+    keymap           - CHIP-8 key for up, down, left, right, A, B, X, Y, L, R, select and start,
+                       one hex digit each, '-' for unmapped
+
+    Entries can be in any order, the table is sorted at compile time. Regenerate from the
+    CHIP-8 community database (https://github.com/chip-8/chip-8-database) with:
+
+        scripts/gen_romdb.py path/to/chip-8-database/database/programs.json > src/romdb.inc
+*/"""
+
+# Community database platform ids, in order of preference, mapped to our quirk profiles
+PLATFORMS = [
+    ("modernChip8", "modern"),
+    ("originalChip8", "cosmac_vip"),
+    ("hybridVIP", "cosmac_vip"),
+    ("superchip1", "schip"),
+    ("superchip", "schip"),
+    ("xochip", "xochip"),
+]
+
+BUTTONS = ["up", "down", "left", "right", "a", "b", "x", "y", "l", "r", "select", "start"]
+DEFAULT_KEYMAP = "2846501379EF"
+DEFAULT_CYCLES_PER_FRAME = 11
+
+
+def keymap(keys):
+    if not keys:
+        return DEFAULT_KEYMAP
+    return "".join("%X" % keys[button] if button in keys else "-" for button in BUTTONS)
+
+
+def platform(platforms):
+    for theirs, ours in PLATFORMS:
+        if theirs in platforms:
+            return ours
+    return None
+
+
+def main():
+    with open(sys.argv[1], encoding="utf-8") as f:
+        programs = json.load(f)
+
+    print(HEADER)
+    seen = set()
+    for program in programs:
+        for sha1, rom in sorted(program.get("roms", {}).items()):
+            sha1 = sha1.lower()
+            target = platform(rom.get("platforms", []))
+            if target is None or sha1 in seen:
+                continue
+            seen.add(sha1)
+            title = program.get("title", "").replace("\\", "\\\\").replace('"', '\\"')
+            cycles = rom.get("tickrate", DEFAULT_CYCLES_PER_FRAME)
+            print('ROM("%s", "%s", %s, %d, "%s")' % (sha1, title, target, cycles, keymap(rom.get("keys"))))
+
+
+if __name__ == "__main__":
+    main()
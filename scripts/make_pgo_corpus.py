@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+"""Write the PGO training corpus: small programs that behave like typical CHIP-8 games.
+
+There is no ROM set we can ship, so these stand in for one. Each program is a game loop in the
+style of a common genre, so the profile sees the same instruction mix real games have: sprite
+drawing with collision checks, keypad polling, timer waits, BCD score display, register spills
+and random numbers. The XO-CHIP program adds bitplanes, long I loads, range loads and audio.
+
+    scripts/make_pgo_corpus.py corpus/
+
+writes one subdirectory per platform, which scripts/pgo_train.py runs with that platform.
+"""
+import os
+import sys
+
+SCRATCH = 0x300     # BCD digits and spilled registers
+
+
+class Program:
+    """A two-pass assembler: words are emitted with symbolic addresses, resolved by assemble()."""
+
+    def __init__(self):
+        self.words = []     # Numbers, or (opcode, label) pairs
+        self.labels = {}
+
+    def label(self, name):
+        self.labels[name] = 0x200 + 2 * len(self.words)
+
+    def __call__(self, *words):
+        self.words.extend(words)
+
+    def data(self, name, data):
+        if len(data) % 2:
+            data += b"\0"
+        self.label(name)
+        self.words.extend((data[i] << 8) | data[i + 1] for i in range(0, len(data), 2))
+
+    def assemble(self):
+        out = bytearray()
+        for word in self.words:
+            if isinstance(word, tuple):
+                opcode, name = word
+                word = opcode | self.labels[name] if opcode != 0x10000 else self.labels[name]
+            out += bytes([(word >> 8) & 0xFF, word & 0xFF])
+        return bytes(out)
+
+
+def addr(opcode, name):
+    return (opcode, name)
+
+
+def long_addr(name):
+    return (0x10000, name)
+
+
+def show_score(p, register):
+    """Draw the decimal digits of register at the top left, spilling V0-V4 around it."""
+    p(0xA000 | SCRATCH + 8, 0xF455)                     # Save V0-V4
+    p(0xA000 | SCRATCH, 0xF033 | register << 8, 0xF265)
+    p(0x6300, 0x6401)                                   # V3 = x, V4 = y
+    for digit in range(3):
+        p(0xF029 | digit << 8, 0xD345, 0x7305)
+    p(0xA000 | SCRATCH + 8, 0xF465)
+
+
+def paddle():
+    """Pong-like: a keypad-driven paddle, a bouncing ball with collision, score and a frame timer."""
+    p = Program()
+    p(0x00E0, 0x6002, 0x610C, 0x6220, 0x6310, 0x6401, 0x6501, 0x6E00)
+    p(addr(0xA000, "paddle"), 0xD016, addr(0xA000, "ball"), 0xD231)
+    p.label("loop")
+    p(addr(0xA000, "paddle"), 0xD016)                   # Erase the paddle
+    p(0x6601, 0xE6A1, 0x71FF, 0x6604, 0xE6A1, 0x7101)   # Keys 1 and 4 move it
+    p(0x671F, 0x8172, 0xD016)
+    p(addr(0xA000, "ball"), 0xD231, 0x8244, 0x8354)     # Move the ball
+    p(0x323E, addr(0x1000, "right_ok"), 0x64FF)
+    p.label("right_ok")
+    p(0x3200, addr(0x1000, "left_ok"), 0x6401, 0x7E01)
+    p.label("left_ok")
+    p(0x331F, addr(0x1000, "bottom_ok"), 0x65FF)
+    p.label("bottom_ok")
+    p(0x3300, addr(0x1000, "top_ok"), 0x6501)
+    p.label("top_ok")
+    p(0xD231, 0x3F00, addr(0x2000, "hit"))
+    p(0x6802, 0xF815)
+    p.label("wait")
+    p(0xF807, 0x3800, addr(0x1000, "wait"))
+    p(addr(0x1000, "loop"))
+    p.label("hit")
+    p(0x6401, 0x7E01, 0xF818)
+    show_score(p, 0xE)
+    p(0x00EE)
+    p.data("paddle", bytes([0x80] * 6))
+    p.data("ball", bytes([0x80]))
+    return p.assemble()
+
+
+def invaders():
+    """Space Invaders-like: a grid of sprites redrawn and shifted every frame, plus a player shot."""
+    p = Program()
+    p(0x00E0, 0x6A00, 0x6B00, 0x6C01, 0x6D1C, 0x6E00)
+    p.label("frame")
+    p(addr(0xA000, "alien"))
+    p(0x6100)                                           # Row loop, V1 = y
+    p.label("row")
+    p(0x6000)
+    p.label("column")
+    p(0x8200, 0x82A4, 0xD214, 0x700A, 0x3032, addr(0x1000, "column"))
+    p(0x7105, 0x3114, addr(0x1000, "row"))
+    p(0xC703, 0x3700, addr(0x1000, "no_shot"))          # Fire now and then
+    p(addr(0xA000, "shot"), 0xD6D3, 0x3F00, 0x7E01, 0xD6D3)
+    p.label("no_shot")
+    p(0x6605, 0xE69E, 0x8AC4, 0x6607, 0xE69E, 0x8AC5)   # Keys 5 and 7 nudge the grid
+    p(0x8CC6, 0x4C00, 0x6C01)                           # Shift the step
+    p(0xA000 | SCRATCH, 0xFE33, 0xF265, 0xF029, 0x633A, 0x6400, 0xD345)
+    p(0x00E0, 0x7A01, 0x6F3F, 0x8AF2, addr(0x1000, "frame"))
+    p.data("alien", bytes([0x3C, 0x7E, 0xDB, 0x66]))
+    p.data("shot", bytes([0x80, 0x80, 0x80]))
+    return p.assemble()
+
+
+def maze():
+    """The classic random maze: diagonal strokes picked by RND until the screen is full, then again."""
+    p = Program()
+    p.label("start")
+    p(0x00E0, 0x6000, 0x6100)
+    p.label("next")
+    p(addr(0xA000, "left"), 0xC201, 0x3201, addr(0xA000, "right"))
+    p(0xD014, 0x7004, 0x3040, addr(0x1000, "next"))
+    p(0x6000, 0x7104, 0x3120, addr(0x1000, "next"))
+    p(0x6E1E, 0xFE15)
+    p.label("hold")
+    p(0xFE07, 0x3E00, addr(0x1000, "hold"))
+    p(addr(0x1000, "start"))
+    p.data("left", bytes([0x80, 0x40, 0x20, 0x10]))
+    p.data("right", bytes([0x10, 0x20, 0x40, 0x80]))
+    return p.assemble()
+
+
+def planes():
+    """An XO-CHIP demo: 16x16 sprites on two planes, long I loads, range loads and stores, audio."""
+    p = Program()
+    p(0x00E0, 0x6000, 0x6100, 0x6201, 0x6301)
+    p(0xF000, long_addr("pattern"), 0xF002, 0x6A40, 0xFA3A)
+    p.label("loop")
+    p(0xF301, 0x00E0)                                   # Both planes
+    p(0xF000, long_addr("sprite"), 0xD010)
+    p(0xF101, 0x8400, 0x8514, 0xD450)                   # Plane 1 only
+    p(0x8024, 0x8134, 0x6F38, 0x8012, 0x6F18, 0x8112)
+    p(0xA000 | SCRATCH, 0x5032, 0x5453, 0x7A01, 0xFA3A, 0x6A04, 0xFA18)
+    p(0x6609, 0xE69E, 0x62FF, 0x660C, 0xE69E, 0x6201)
+    p(addr(0x1000, "loop"))
+    p.data("sprite", bytes([0xFF, 0xFF] + [0xC0, 0x03] * 14 + [0xFF, 0xFF]) * 2)
+    p.data("pattern", bytes(range(0, 256, 16)))
+    return p.assemble()
+
+
+CORPUS = {
+    "modern": {"paddle.ch8": paddle, "maze.ch8": maze},
+    "cosmac_vip": {"invaders.ch8": invaders, "maze.ch8": maze},
+    "schip": {"paddle.ch8": paddle, "invaders.ch8": invaders},
+    "xochip": {"planes.xo8": planes, "paddle.ch8": paddle},
+}
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: make_pgo_corpus.py CORPUS_DIR")
+    corpus_dir = sys.argv[1]
+
+    written = 0
+    for platform, programs in CORPUS.items():
+        os.makedirs(os.path.join(corpus_dir, platform), exist_ok=True)
+        for name, build in programs.items():
+            with open(os.path.join(corpus_dir, platform, name), "wb") as f:
+                f.write(build())
+            written += 1
+
+    print(f"wrote {written} training ROMs to {corpus_dir}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Pack a ROM set into one file that the runner and disassembler map instead of reading ROM by ROM.
+
+    scripts/pack_roms.py roms.c8pack path/to/roms [more dirs or files...]
+    runner --pack roms.c8pack --frames 600
+    disassembler --pack roms.c8pack
+
+Directories are searched recursively; each ROM is named by its path relative to the directory it
+was found in. The layout is described in src/rompack.h.
+"""
+import os
+import struct
+import sys
+
+MAGIC = b"CH8PACK\0"
+VERSION = 1
+HEADER = struct.Struct("<8sII")
+ENTRY = struct.Struct("<QQII")
+ROM_EXTENSIONS = (".ch8", ".c8", ".sc8", ".xo8")
+
+
+def find_roms(inputs):
+    for path in inputs:
+        if os.path.isfile(path):
+            yield os.path.basename(path), path
+            continue
+        for root, dirs, files in os.walk(path):
+            dirs.sort()
+            for name in sorted(files):
+                if name.lower().endswith(ROM_EXTENSIONS):
+                    full = os.path.join(root, name)
+                    yield os.path.relpath(full, path).replace(os.sep, "/"), full
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit("usage: pack_roms.py PACK ROM_DIR_OR_FILE...")
+    pack_path, inputs = sys.argv[1], sys.argv[2:]
+
+    roms = []
+    for name, path in find_roms(inputs):
+        with open(path, "rb") as f:
+            roms.append((name.encode("utf-8"), f.read()))
+
+    # Header, index, every name, then every ROM
+    offset = HEADER.size + ENTRY.size * len(roms)
+    name_offsets = []
+    for name, _ in roms:
+        name_offsets.append(offset)
+        offset += len(name)
+    data_offsets = []
+    for _, data in roms:
+        data_offsets.append(offset)
+        offset += len(data)
+
+    with open(pack_path, "wb") as f:
+        f.write(HEADER.pack(MAGIC, VERSION, len(roms)))
+        for (name, data), name_offset, data_offset in zip(roms, name_offsets, data_offsets):
+            f.write(ENTRY.pack(data_offset, name_offset, len(data), len(name)))
+        for name, _ in roms:
+            f.write(name)
+        for _, data in roms:
+            f.write(data)
+
+    print(f"packed {len(roms)} ROMs into {pack_path} ({offset} bytes)")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Training run for a CHIP8_PGO=GENERATE build: exercise the headless paths so the profile matches real use.
+
+    scripts/make_pgo_corpus.py build/pgo-corpus
+    scripts/pgo_train.py --build build --profile-dir build/pgo build/pgo-corpus [more ROM dirs...]
+
+ROMs in a subdirectory named after a platform (modern, cosmac_vip, schip, xochip) run on that
+platform, others on the one the ROM database gives. Every ROM runs through the runner's batch mode
+with pseudo-random keypad input, so games get past their title screens, then bench runs once over
+every instruction handler and whole libretro frames. Old profiles are deleted first, so the
+result only reflects this run. Clang profiles are merged into PROFILE_DIR/default.profdata.
+"""
+import argparse
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+PLATFORMS = ["modern", "cosmac_vip", "schip", "xochip"]
+ROM_EXTENSIONS = (".ch8", ".c8", ".sc8", ".xo8")
+
+
+def find_roms(rom_dirs):
+    """Map platform (None for the ROM database's choice) to ROM paths."""
+    roms = {}
+    for rom_dir in rom_dirs:
+        for root, _, files in os.walk(rom_dir):
+            platform = os.path.basename(root)
+            if platform not in PLATFORMS:
+                platform = None
+            for name in sorted(files):
+                if name.lower().endswith(ROM_EXTENSIONS):
+                    roms.setdefault(platform, []).append(os.path.join(root, name))
+    return roms
+
+
+def write_input_script(path, rom_path, frames):
+    """Keys held for a few frames at a time, the same for every run of the same ROM."""
+    rng = random.Random(os.path.basename(rom_path))
+    frame = 0
+    with open(path, "w") as f:
+        while frame < frames:
+            keys = rng.sample("0123456789abcdef", rng.randint(0, 2))
+            f.write(f"{frame} {''.join(keys) or '-'}\n")
+            frame += rng.randint(4, 40)
+
+
+def run(command):
+    print("+", " ".join(command), flush=True)
+    subprocess.run(command, check=True, stdout=subprocess.DEVNULL)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Write the profiles of a CHIP8_PGO=GENERATE build.")
+    parser.add_argument("--build", required=True, help="the GENERATE build directory")
+    parser.add_argument("--profile-dir", required=True, help="CHIP8_PGO_DIR of the build")
+    parser.add_argument("--frames", type=int, default=3600, help="frames to run each ROM (default: 3600)")
+    parser.add_argument("--llvm-profdata", help="merge Clang raw profiles with this llvm-profdata")
+    parser.add_argument("rom_dirs", nargs="+")
+    args = parser.parse_args()
+
+    roms = find_roms(args.rom_dirs)
+    if not roms:
+        sys.exit("no ROMs found")
+
+    shutil.rmtree(args.profile_dir, ignore_errors=True)
+    os.makedirs(args.profile_dir)
+
+    runner = os.path.join(args.build, "runner")
+    bench = os.path.join(args.build, "bench")
+    with tempfile.TemporaryDirectory() as scratch:
+        for platform, paths in sorted(roms.items(), key=lambda item: item[0] or ""):
+            manifest = os.path.join(scratch, f"{platform or 'romdb'}.txt")
+            with open(manifest, "w") as f:
+                for i, path in enumerate(paths):
+                    # Manifest fields are split on spaces, so ROMs are linked under plain names
+                    name = os.path.join(scratch, f"{platform or 'romdb'}-{i}")
+                    os.symlink(os.path.abspath(path), name + ".rom")
+                    write_input_script(name + ".keys", path, args.frames)
+                    f.write(f"{name}.rom {name}.keys\n")
+
+            command = [runner, "--batch", manifest, "--frames", str(args.frames)]
+            if platform:
+                command += ["--platform", platform]
+            run(command)
+
+        # The libretro core picks platforms from the ROM database, so only those ROMs go through it
+        run([bench, "--min-time", "0.02", "--repeats", "1"] + roms.get(None, []))
+
+    if args.llvm_profdata:
+        raw = [os.path.join(args.profile_dir, name) for name in os.listdir(args.profile_dir) if name.endswith(".profraw")]
+        run([args.llvm_profdata, "merge", "-o", os.path.join(args.profile_dir, "default.profdata")] + raw)
+
+    print(f"profiles written to {args.profile_dir}, reconfigure with -DCHIP8_PGO=USE and rebuild")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+"""Turn a directory of ROMs into seed inputs for the fuzz targets in src/fuzz.
+
+Each ROM is written once per platform, with the header described in src/fuzz/fuzz_input.h:
+
+    scripts/seed_fuzz_corpus.py path/to/roms corpus/
+    fuzz_execute corpus/
+"""
+import hashlib
+import os
+import sys
+
+PLATFORMS = ["modern", "cosmac_vip", "schip", "xochip"]
+CYCLES_PER_FRAME = 11  # Stored as cycles - 1, see fuzz::parse_input
+KEY_SEED = 1
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: seed_fuzz_corpus.py ROM_DIR CORPUS_DIR")
+    rom_dir, corpus_dir = sys.argv[1:]
+    os.makedirs(corpus_dir, exist_ok=True)
+
+    written = 0
+    for root, _, files in os.walk(rom_dir):
+        for name in sorted(files):
+            with open(os.path.join(root, name), "rb") as f:
+                rom = f.read()
+            for platform in range(len(PLATFORMS)):
+                data = bytes([platform, CYCLES_PER_FRAME - 1, KEY_SEED]) + rom
+                # Named by content like libFuzzer does, so seeding twice adds nothing
+                path = os.path.join(corpus_dir, hashlib.sha1(data).hexdigest())
+                with open(path, "wb") as f:
+                    f.write(data)
+                written += 1
+
+    print(f"wrote {written} seed inputs to {corpus_dir}")
+
+
+if __name__ == "__main__":
+    main()
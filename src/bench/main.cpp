@@ -0,0 +1,480 @@
+/*
+    Microbenchmarks for the core's hot paths: every instruction handler of the interpreter, DRW at
+    several sprite heights and positions, CLS, display conversion, save states, frames run with
+    profiling, tracing and on the lane engine, and whole libretro frames. Each benchmark is calibrated to run for a minimum time, then timed several times over;
+    the median is reported. --json writes one JSON object per benchmark, which
+    scripts/bench_compare.py compares between two builds.
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include "../chip8.h"
+#include "../lanes.h"
+#include "../libretro/libretro.h"
+#include "../ops.h"
+#include "../profile.h"
+#include "../trace.h"
+
+namespace {
+    struct Options {
+        double min_seconds = 0.1;       // Per timed run
+        unsigned int repeats = 5;
+        const char *filter = nullptr;
+        bool json = false;
+        bool list = false;
+    };
+
+    Options options;
+
+    bool selected(const std::string &name)
+    {
+        return !options.filter || name.find(options.filter) != std::string::npos;
+    }
+
+    // Names come from ROM file names too, so quote them properly
+    std::string json_string(const std::string &text)
+    {
+        std::string quoted = "\"";
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                quoted += '\\';
+                quoted += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                quoted += escape;
+            } else {
+                quoted += c;
+            }
+        }
+        return quoted + '"';
+    }
+
+    double elapsed_since(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /*
+        Time f, which does some work and returns how many operations it did. The call count is doubled
+        until one run takes min_seconds, then that many calls are timed repeats times.
+    */
+    void run_benchmark(const std::string &name, const std::function<std::uint64_t()> &f)
+    {
+        if (!selected(name)) {
+            return;
+        }
+        if (options.list) {
+            std::printf("%s\n", name.c_str());
+            return;
+        }
+
+        std::uint64_t calls = 1;
+        for (;;) {
+            auto start = std::chrono::steady_clock::now();
+            for (std::uint64_t i = 0; i < calls; i++) f();
+            if (elapsed_since(start) >= options.min_seconds || calls >= (std::uint64_t { 1 } << 40)) break;
+            calls *= 2;
+        }
+
+        std::vector<double> ns_per_op;
+        std::uint64_t ops = 0;
+        for (unsigned int repeat = 0; repeat < options.repeats; repeat++) {
+            std::uint64_t run_ops = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (std::uint64_t i = 0; i < calls; i++) run_ops += f();
+            double seconds = elapsed_since(start);
+            ns_per_op.push_back(run_ops ? seconds * 1e9 / static_cast<double>(run_ops) : 0);
+            ops += run_ops;
+        }
+        std::sort(ns_per_op.begin(), ns_per_op.end());
+        double median = ns_per_op[ns_per_op.size() / 2];
+
+        if (options.json) {
+            std::printf("{\"name\": %s, \"ns_per_op\": %.4f, \"ns_per_op_min\": %.4f, \"ops\": %llu, \"repeats\": %u}\n",
+                        json_string(name).c_str(), median, ns_per_op.front(), static_cast<unsigned long long>(ops), options.repeats);
+        } else {
+            std::printf("%-40s %10.3f ns/op %10.2f Mops/s\n", name.c_str(), median, median > 0 ? 1e3 / median : 0.0);
+        }
+        std::fflush(stdout);
+    }
+
+    // Fixed places for what the benchmark programs point at
+    constexpr std::uint16_t SUBROUTINE = 0xE00;     // A single RET
+    constexpr std::uint16_t SPRITE = 0xE10;         // 64 bytes of sprite data
+    constexpr std::uint16_t SCRATCH = 0x300;        // Target of memory writes
+
+    // Placeholders in a loop body, replaced by a jump to the instruction after them
+    constexpr std::uint16_t JP_NEXT = 0x1FFF;
+    constexpr std::uint16_t JP_OFFSET_NEXT = 0xBFFF;
+
+    /*
+        A program that runs setup once, then loops over body repeated to fill about 256 instructions,
+        so the closing jump costs next to nothing. Every instruction in body is what gets measured.
+    */
+    struct Workload {
+        std::string name;
+        chip8::Platform platform = chip8::Platform::modern;
+        std::vector<std::uint16_t> setup;
+        std::vector<std::uint16_t> body;
+        std::uint16_t keys = 0;
+    };
+
+    std::vector<std::uint8_t> build_program(const Workload &workload)
+    {
+        std::vector<std::uint8_t> rom(SPRITE + 64 - chip8::PROGRAM_START_ADDRESS);
+        std::size_t offset = 0;
+        auto emit = [&](std::uint16_t word) {
+            std::uint16_t address = static_cast<std::uint16_t>(chip8::PROGRAM_START_ADDRESS + offset);
+            if (word == JP_NEXT || word == JP_OFFSET_NEXT) {
+                word = static_cast<std::uint16_t>((word & 0xF000) | (address + 2));
+            }
+            rom[offset++] = static_cast<std::uint8_t>(word >> 8);
+            rom[offset++] = static_cast<std::uint8_t>(word);
+        };
+
+        for (std::uint16_t word : workload.setup) emit(word);
+        std::uint16_t loop = static_cast<std::uint16_t>(chip8::PROGRAM_START_ADDRESS + offset);
+        for (std::size_t count = 0; count < 256; count += workload.body.size()) {
+            for (std::uint16_t word : workload.body) emit(word);
+        }
+        emit(static_cast<std::uint16_t>(0x1000 | loop));
+
+        rom[SUBROUTINE - chip8::PROGRAM_START_ADDRESS] = 0x00;
+        rom[SUBROUTINE - chip8::PROGRAM_START_ADDRESS + 1] = 0xEE;
+        for (std::size_t i = 0; i < 64; i++) {
+            rom[SPRITE - chip8::PROGRAM_START_ADDRESS + i] = static_cast<std::uint8_t>(i % 3 == 0 ? 0xFF : 0xA5 ^ i);
+        }
+        return rom;
+    }
+
+    void run_workload(const Workload &workload)
+    {
+        std::vector<std::uint8_t> rom = build_program(workload);
+        chip8::Machine machine;
+        chip8::reset(machine, workload.platform);
+        chip8::load_rom(machine, rom.data(), rom.size());
+        machine.keys = workload.keys;
+
+        run_benchmark(workload.name, [&] {
+            std::uint64_t executed = chip8::fetch_decode_execute(machine, 1 << 14);
+            if (chip8::get_fault(machine) != chip8::Fault::none) {
+                std::fprintf(stderr, "%s: %s at 0x%04x\n", workload.name.c_str(), chip8::describe_fault(chip8::get_fault(machine)),
+                             machine.program_counter);
+                std::exit(1);
+            }
+            return executed;
+        });
+    }
+
+    void bench_opcodes()
+    {
+        using chip8::Platform;
+        const std::uint16_t ld_i_scratch = 0xA000 | SCRATCH;
+        const std::uint16_t ld_i_sprite = 0xA000 | SPRITE;
+
+        const std::vector<Workload> workloads = {
+            { "opcode/cls", Platform::modern, {}, { 0x00E0 } },
+            { "opcode/sys", Platform::modern, {}, { 0x0123 } },
+            { "opcode/jp", Platform::modern, {}, { JP_NEXT } },
+            { "opcode/call+ret", Platform::modern, {}, { 0x2000 | SUBROUTINE } },
+            { "opcode/se_byte/taken", Platform::modern, {}, { 0x3000 } },
+            { "opcode/se_byte/not_taken", Platform::modern, {}, { 0x3001 } },
+            { "opcode/sne_byte/taken", Platform::modern, {}, { 0x4001 } },
+            { "opcode/sne_byte/not_taken", Platform::modern, {}, { 0x4000 } },
+            { "opcode/se_reg/taken", Platform::modern, {}, { 0x5010 } },
+            { "opcode/se_reg/not_taken", Platform::modern, { 0x6101 }, { 0x5010 } },
+            { "opcode/sne_reg/taken", Platform::modern, { 0x6101 }, { 0x9010 } },
+            { "opcode/sne_reg/not_taken", Platform::modern, {}, { 0x9010 } },
+            { "opcode/ld_byte", Platform::modern, {}, { 0x6012 } },
+            { "opcode/add_byte", Platform::modern, {}, { 0x7003 } },
+            { "opcode/ld_reg", Platform::modern, {}, { 0x8010 } },
+            { "opcode/or_reg", Platform::modern, {}, { 0x8011 } },
+            { "opcode/and_reg", Platform::modern, {}, { 0x8012 } },
+            { "opcode/xor_reg", Platform::modern, {}, { 0x8013 } },
+            { "opcode/add_reg", Platform::modern, { 0x6105 }, { 0x8014 } },
+            { "opcode/sub_reg", Platform::modern, { 0x6105 }, { 0x8015 } },
+            { "opcode/shr", Platform::modern, { 0x60F1 }, { 0x8016 } },
+            { "opcode/subn", Platform::modern, { 0x6105 }, { 0x8017 } },
+            { "opcode/shl", Platform::modern, { 0x60F1 }, { 0x801E } },
+            { "opcode/ld_i", Platform::modern, {}, { 0xA123 } },
+            { "opcode/jp_offset", Platform::modern, {}, { JP_OFFSET_NEXT } },
+            { "opcode/rnd", Platform::modern, {}, { 0xC0FF } },
+            { "opcode/skp/taken", Platform::modern, {}, { 0xE09E }, 0x0001 },
+            { "opcode/skp/not_taken", Platform::modern, {}, { 0xE09E } },
+            { "opcode/sknp/taken", Platform::modern, {}, { 0xE0A1 } },
+            { "opcode/sknp/not_taken", Platform::modern, {}, { 0xE0A1 }, 0x0001 },
+            { "opcode/ld_vx_dt", Platform::modern, {}, { 0xF007 } },
+            { "opcode/ld_key/waiting", Platform::modern, {}, { 0xF00A } },
+            { "opcode/ld_dt", Platform::modern, {}, { 0xF015 } },
+            { "opcode/ld_st", Platform::modern, {}, { 0xF018 } },
+            { "opcode/add_i", Platform::modern, { 0x6001 }, { 0xF01E } },
+            { "opcode/ld_font", Platform::modern, {}, { 0xF029 } },
+            { "opcode/bcd", Platform::modern, { ld_i_scratch, 0x60FE }, { 0xF033 } },
+            { "opcode/store/8 registers", Platform::modern, { ld_i_scratch }, { 0xF755 } },
+            { "opcode/load/8 registers", Platform::modern, { ld_i_scratch }, { 0xF765 } },
+            { "opcode/ld_i_long", Platform::xochip, {}, { 0xF000, SCRATCH } },
+            { "opcode/plane", Platform::xochip, {}, { 0xF301 } },
+            { "opcode/audio", Platform::xochip, {}, { 0xF002 } },
+            { "opcode/pitch", Platform::xochip, {}, { 0xF03A } },
+            { "opcode/store_range/8 registers", Platform::xochip, { ld_i_scratch }, { 0x5072 } },
+            { "opcode/load_range/8 registers", Platform::xochip, { ld_i_scratch }, { 0x5073 } },
+            { "opcode/cls/xochip 4 planes", Platform::xochip, { 0xFF01 }, { 0x00E0 } },
+            { "opcode/drw/xochip 16x16 2 planes", Platform::xochip, { 0xF301, ld_i_sprite }, { 0xD010 } },
+        };
+        for (const Workload &workload : workloads) {
+            run_workload(workload);
+        }
+
+        // DRW at each height, byte aligned, unaligned and wrapping around (modern) or clipped (SCHIP) at the right edge
+        for (unsigned int height : { 1u, 5u, 8u, 15u }) {
+            for (unsigned int x : { 0u, 3u, 60u }) {
+                for (Platform platform : { Platform::modern, Platform::schip }) {
+                    if (platform == Platform::schip && x != 60) continue;
+                    Workload workload;
+                    workload.name = "drw/h" + std::to_string(height) + "/x" + std::to_string(x)
+                                  + (platform == Platform::schip ? "/clipped" : "");
+                    workload.platform = platform;
+                    workload.setup = { ld_i_sprite, static_cast<std::uint16_t>(0x6000 | x), 0x6108 };
+                    workload.body = { static_cast<std::uint16_t>(0xD010 | height) };
+                    run_workload(workload);
+                }
+            }
+        }
+    }
+
+    // A machine whose display has something on every plane
+    chip8::Machine make_drawn_machine(chip8::Platform platform)
+    {
+        chip8::Machine machine;
+        chip8::reset(machine, platform);
+        std::uint64_t pattern = 0x9E3779B97F4A7C15;
+        for (std::size_t plane = 0; plane < chip8::MAX_PLANES; plane++) {
+            for (auto &row : machine.planes.edit(plane)) {
+                pattern = pattern * 6364136223846793005 + 1442695040888963407;
+                row = pattern;
+            }
+        }
+        return machine;
+    }
+
+    void bench_video_and_state()
+    {
+        chip8::Machine machine = make_drawn_machine(chip8::Platform::xochip);
+        chip8::Framebuffer framebuffer;
+        run_benchmark("video/get_video_buffer", [&] {
+            chip8::get_video_buffer(machine, framebuffer);
+            return std::uint64_t { 1 };
+        });
+
+        for (chip8::Platform platform : { chip8::Platform::modern, chip8::Platform::xochip }) {
+            chip8::Machine saved = make_drawn_machine(platform);
+            std::vector<std::uint8_t> state(chip8::get_state_size(saved));
+            std::string suffix = std::string("/") + chip8::get_platform_name(platform);
+
+            run_benchmark("state/save" + suffix, [&] {
+                chip8::save_state(saved, state.data(), state.size());
+                return std::uint64_t { 1 };
+            });
+
+            chip8::Machine loaded;
+            run_benchmark("state/load" + suffix, [&] {
+                chip8::load_state(loaded, state.data(), state.size());
+                return std::uint64_t { 1 };
+            });
+        }
+    }
+
+    // libretro frontend stand-ins: no options, no logging, no input, and frames go nowhere
+    bool environment([[maybe_unused]] unsigned int command, [[maybe_unused]] void *data) { return false; }
+    void video_refresh([[maybe_unused]] const void *data, [[maybe_unused]] unsigned int width,
+                       [[maybe_unused]] unsigned int height, [[maybe_unused]] std::size_t pitch) {}
+    void input_poll() {}
+    std::int16_t input_state([[maybe_unused]] unsigned int port, [[maybe_unused]] unsigned int device,
+                             [[maybe_unused]] unsigned int index, [[maybe_unused]] unsigned int id) { return 0; }
+
+    /*
+        A small game loop: draw a moving sprite, test a key, use the timers and random numbers, then
+        draw a score digit through BCD and the font and call a subroutine, 16 instructions in all.
+    */
+    std::vector<std::uint8_t> make_game_rom()
+    {
+        const std::uint16_t program[] = {
+            0x00E0, 0x6A00, 0x6B00,                     // CLS, VA = VB = 0
+            0xA000 | SPRITE, 0xDAB8, 0x7A03, 0x7B01,    // loop: draw at (VA, VB) and move
+            0xC01F, 0xE09E, 0x7C01,                     // score a point unless a random key is held
+            0xF015, 0xF107,                             // DT = V0, V1 = DT
+            0xA000 | SCRATCH, 0xFC33, 0xF265, 0xF029,   // score digits, font address of the first
+            0xD125, 0x2000 | SUBROUTINE, 0x1206,        // draw it, call, loop
+        };
+        std::vector<std::uint8_t> rom(SUBROUTINE + 2 - chip8::PROGRAM_START_ADDRESS + 64);
+        for (std::size_t i = 0; i < std::size(program); i++) {
+            rom[2 * i] = static_cast<std::uint8_t>(program[i] >> 8);
+            rom[2 * i + 1] = static_cast<std::uint8_t>(program[i]);
+        }
+        rom[SUBROUTINE - chip8::PROGRAM_START_ADDRESS + 1] = 0xEE;
+        std::fill(rom.begin() + (SPRITE - chip8::PROGRAM_START_ADDRESS), rom.begin() + (SPRITE - chip8::PROGRAM_START_ADDRESS + 8), 0xC3);
+        return rom;
+    }
+
+    /*
+        The game loop a frame at a time: plainly, profiled, traced into a recorder with no file
+        open (so only the recording is timed, not the writes), and on N lanes at once. All of them
+        count instructions, so ns/op compares directly.
+    */
+    void bench_frames()
+    {
+        constexpr unsigned int CYCLES = 1000;
+        const std::vector<std::uint8_t> rom = make_game_rom();
+
+        chip8::Machine machine;
+        auto start = [&] {
+            chip8::reset(machine, chip8::Platform::modern);
+            chip8::load_rom(machine, rom.data(), rom.size());
+        };
+
+        start();
+        run_benchmark("run_frame/game", [&] { return std::uint64_t { chip8::run_frame(machine, CYCLES) }; });
+
+        start();
+        chip8::Profile profile;
+        run_benchmark("profile/game", [&] { return std::uint64_t { chip8::run_frame(machine, CYCLES, profile) }; });
+
+        start();
+        chip8::TraceRecorder trace;
+        run_benchmark("trace/game", [&] { return std::uint64_t { chip8::run_frame(machine, CYCLES, trace) }; });
+
+        for (std::size_t lane_count : { 1u, 8u, 64u, 256u }) {
+            std::string name = "lanes/" + std::to_string(lane_count);
+            if (!selected(name)) {
+                continue;
+            }
+            chip8::Lanes lanes;
+            if (!chip8::reset_lanes(lanes, chip8::Platform::modern, lane_count, rom.data(), rom.size())) {
+                std::fprintf(stderr, "%s: cannot start the game\n", name.c_str());
+                std::exit(1);
+            }
+            // Different keys per lane, so lanes take different branches
+            for (std::size_t lane = 0; lane < lane_count; lane++) {
+                chip8::set_lane_keys(lanes, lane, static_cast<std::uint16_t>(lane * 0x9E37));
+            }
+            run_benchmark(name, [&] { return chip8::run_lanes_frame(lanes, CYCLES); });
+        }
+    }
+
+    bool read_file(const char *path, std::vector<std::uint8_t> &data)
+    {
+        std::FILE *input = std::fopen(path, "rb");
+        if (!input) {
+            return false;
+        }
+
+        data.clear();
+        std::uint8_t chunk[4096];
+        while (std::size_t count = std::fread(chunk, 1, sizeof(chunk), input)) {
+            data.insert(data.end(), chunk, chunk + count);
+        }
+
+        bool ok = !std::ferror(input);
+        std::fclose(input);
+        return ok;
+    }
+
+    // Whole frames as a frontend runs them: input, the frame itself and the display conversion
+    bool bench_retro_run(const std::vector<const char *> &rom_paths)
+    {
+        retro_set_environment(environment);
+        retro_set_video_refresh(video_refresh);
+        retro_set_input_poll(input_poll);
+        retro_set_input_state(input_state);
+        retro_init();
+
+        std::vector<std::pair<std::string, std::vector<std::uint8_t>>> roms { { "game", make_game_rom() } };
+        for (const char *path : rom_paths) {
+            std::vector<std::uint8_t> data;
+            if (!read_file(path, data)) {
+                std::fprintf(stderr, "cannot read %s\n", path);
+                return false;
+            }
+            const char *name = std::strrchr(path, '/');
+            roms.emplace_back(name ? name + 1 : path, std::move(data));
+        }
+
+        for (const auto &[name, data] : roms) {
+            if (!selected("retro_run/" + name)) {
+                continue;
+            }
+            retro_game_info info {};
+            info.data = data.data();
+            info.size = data.size();
+            if (!retro_load_game(&info)) {
+                std::fprintf(stderr, "cannot load %s\n", name.c_str());
+                return false;
+            }
+            run_benchmark("retro_run/" + name, [] {
+                retro_run();
+                return std::uint64_t { 1 };
+            });
+            retro_unload_game();
+        }
+
+        retro_deinit();
+        return true;
+    }
+
+    void usage(const char *program)
+    {
+        std::fprintf(stderr,
+            "usage: %s [options] [rom...]\n"
+            "  --filter TEXT        only run benchmarks whose name contains TEXT\n"
+            "  --min-time SECONDS   minimum length of each timed run (default: 0.1)\n"
+            "  --repeats N          timed runs per benchmark, the median is reported (default: 5)\n"
+            "  --json               one JSON object per line, for scripts/bench_compare.py\n"
+            "  --list               list the benchmarks without running them\n"
+            "ROMs given are run frame by frame through the libretro core, next to a built-in game loop.\n",
+            program);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<const char *> rom_paths;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (std::strcmp(arg, "--json") == 0) {
+            options.json = true;
+        } else if (std::strcmp(arg, "--list") == 0) {
+            options.list = true;
+        } else if (arg[0] != '-' || arg[1] == '\0') {
+            rom_paths.push_back(arg);
+        } else if (!value) {
+            usage(argv[0]);
+            return 2;
+        } else if (std::strcmp(arg, "--filter") == 0) {
+            options.filter = value;
+            i++;
+        } else if (std::strcmp(arg, "--min-time") == 0) {
+            options.min_seconds = std::atof(value);
+            i++;
+        } else if (std::strcmp(arg, "--repeats") == 0) {
+            options.repeats = static_cast<unsigned int>(std::max(1, std::atoi(value)));
+            i++;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    bench_opcodes();
+    bench_video_and_state();
+    bench_frames();
+    return bench_retro_run(rom_paths) ? 0 : 1;
+}
@@ -0,0 +1,575 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include "cfg.h"
+#include "decode.h"
+#include "disassembler.h"
+#include "quirks.h"
+
+namespace chip8 {
+    namespace {
+        bool is_skip(Opcode opcode)
+        {
+            switch (opcode) {
+                case Opcode::se_byte:
+                case Opcode::sne_byte:
+                case Opcode::se_reg:
+                case Opcode::sne_reg:
+                case Opcode::skp:
+                case Opcode::sknp:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        template <bool Xochip>
+        class Analyzer {
+        public:
+            Analyzer(std::span<const std::uint8_t> code, std::uint16_t base, ControlFlowGraph &cfg)
+                // Addresses stop at 0xFFFF, which stays free for NO_ADDRESS
+                : code(code.first(std::min<std::size_t>(code.size(), 0xFFFF - base))), base(base), cfg(cfg),
+                  leaders(this->code.size())
+            {
+                cfg.bytes.assign(this->code.size(), ByteKind::data);
+            }
+
+            void run()
+            {
+                follow(base);
+                while (!pending.empty()) {
+                    std::uint32_t address = pending.back();
+                    pending.pop_back();
+                    trace(address);
+                }
+
+                build_blocks();
+                build_call_graph();
+            }
+
+        private:
+            std::span<const std::uint8_t> code;
+            std::uint16_t base;
+            ControlFlowGraph &cfg;
+            std::vector<bool> leaders;          // Per byte: a block starts here
+            std::vector<std::uint32_t> pending; // Leaders still to trace
+
+            bool contains(std::uint32_t address, std::uint32_t size) const
+            {
+                return address >= base && address - base + size <= code.size();
+            }
+
+            std::uint16_t word_at(std::uint32_t address) const
+            {
+                return static_cast<std::uint16_t>(code[address - base] << 8 | code[address - base + 1]);
+            }
+
+            // Anything cut off by the end of the ROM counts as invalid
+            Opcode decode_at(std::uint32_t address, std::uint32_t &size) const
+            {
+                size = 2;
+                if (!contains(address, 2)) {
+                    return Opcode::invalid;
+                }
+                Opcode opcode = decode<Xochip>(word_at(address));
+                if (!contains(address, instruction_size(opcode))) {
+                    return Opcode::invalid;
+                }
+                size = instruction_size(opcode);
+                return opcode;
+            }
+
+            // Where a skip at address lands when taken: past the next instruction, which on XO-CHIP may be F000 nnnn
+            std::uint32_t skip_target(std::uint32_t next) const
+            {
+                bool long_instruction = Xochip && contains(next, 2) && word_at(next) == 0xF000;
+                return next + (long_instruction ? 4 : 2);
+            }
+
+            std::uint16_t successor(std::uint32_t address) const
+            {
+                return contains(address, 2) ? static_cast<std::uint16_t>(address) : NO_ADDRESS;
+            }
+
+            void follow(std::uint32_t address)
+            {
+                if (contains(address, 2) && !leaders[address - base]) {
+                    leaders[address - base] = true;
+                    pending.push_back(address);
+                }
+            }
+
+            // Mark the instructions reachable by running on from address
+            void trace(std::uint32_t address)
+            {
+                while (contains(address, 2)) {
+                    if (cfg.bytes[address - base] == ByteKind::instruction) {
+                        // Joins code traced before, which therefore has two ways in
+                        leaders[address - base] = true;
+                        return;
+                    }
+
+                    std::uint32_t size = 0;
+                    Opcode opcode = decode_at(address, size);
+                    cfg.bytes[address - base] = ByteKind::instruction;
+                    for (std::uint32_t i = 1; i < size; i++) {
+                        if (cfg.bytes[address - base + i] == ByteKind::data) {
+                            cfg.bytes[address - base + i] = ByteKind::operand;
+                        }
+                    }
+
+                    std::uint32_t next = address + size;
+                    std::uint16_t instruction = word_at(address);
+                    switch (opcode) {
+                        case Opcode::jp:
+                            follow(instruction & 0x0FFF);
+                            return;
+                        case Opcode::call:
+                            follow(instruction & 0x0FFF);
+                            follow(next);
+                            return;
+                        case Opcode::ret:
+                        case Opcode::jp_offset:
+                        case Opcode::invalid:
+                            return;
+                        default:
+                            if (is_skip(opcode)) {
+                                follow(next);
+                                follow(skip_target(next));
+                                return;
+                            }
+                            address = next;
+                    }
+                }
+            }
+
+            void build_blocks()
+            {
+                for (std::uint32_t start = base; start < base + code.size(); start++) {
+                    if (leaders[start - base] && cfg.bytes[start - base] == ByteKind::instruction) {
+                        cfg.blocks.push_back(build_block(start));
+                    }
+                }
+            }
+
+            BasicBlock build_block(std::uint32_t start) const
+            {
+                BasicBlock block { static_cast<std::uint16_t>(start), 0, BlockEnd::end_of_code };
+
+                for (std::uint32_t address = start;;) {
+                    std::uint32_t size = 0;
+                    Opcode opcode = decode_at(address, size);
+                    std::uint32_t next = address + size;
+                    std::uint16_t instruction = word_at(address);
+                    block.end = static_cast<std::uint16_t>(next);
+
+                    switch (opcode) {
+                        case Opcode::jp:
+                            block.kind = BlockEnd::jump;
+                            block.successors[0] = successor(instruction & 0x0FFF);
+                            return block;
+                        case Opcode::call:
+                            block.kind = BlockEnd::call;
+                            block.successors = { successor(next), successor(instruction & 0x0FFF) };
+                            return block;
+                        case Opcode::ret:
+                            block.kind = BlockEnd::ret;
+                            return block;
+                        case Opcode::jp_offset:
+                            block.kind = BlockEnd::indirect;
+                            return block;
+                        case Opcode::invalid:
+                            block.kind = BlockEnd::invalid;
+                            return block;
+                        default:
+                            break;
+                    }
+
+                    if (is_skip(opcode)) {
+                        block.kind = BlockEnd::skip;
+                        block.successors = { successor(next), successor(skip_target(next)) };
+                        return block;
+                    }
+
+                    if (!contains(next, 2) || cfg.bytes[next - base] != ByteKind::instruction) {
+                        block.kind = BlockEnd::end_of_code;
+                        return block;
+                    }
+
+                    if (leaders[next - base]) {
+                        block.kind = BlockEnd::fallthrough;
+                        block.successors[0] = static_cast<std::uint16_t>(next);
+                        return block;
+                    }
+
+                    address = next;
+                }
+            }
+
+            // Functions are the entry point and every call target. A function owns the blocks it
+            // reaches without following calls, and calls whatever those blocks call.
+            void build_call_graph()
+            {
+                cfg.functions.push_back(base);
+                for (const BasicBlock &block : cfg.blocks) {
+                    if (block.kind == BlockEnd::call && block.successors[1] != NO_ADDRESS) {
+                        cfg.functions.push_back(block.successors[1]);
+                    }
+                }
+                std::sort(cfg.functions.begin(), cfg.functions.end());
+                cfg.functions.erase(std::unique(cfg.functions.begin(), cfg.functions.end()), cfg.functions.end());
+
+                std::vector<bool> visited(cfg.blocks.size());
+                std::vector<std::size_t> stack;
+                for (std::uint16_t function : cfg.functions) {
+                    std::fill(visited.begin(), visited.end(), false);
+                    push_block(function, visited, stack);
+
+                    while (!stack.empty()) {
+                        const BasicBlock &block = cfg.blocks[stack.back()];
+                        stack.pop_back();
+
+                        if (block.kind == BlockEnd::call) {
+                            if (block.successors[1] != NO_ADDRESS) {
+                                cfg.calls.push_back({ function, block.successors[1] });
+                            }
+                            push_block(block.successors[0], visited, stack);
+                        } else {
+                            push_block(block.successors[0], visited, stack);
+                            push_block(block.successors[1], visited, stack);
+                        }
+                    }
+                }
+
+                std::sort(cfg.calls.begin(), cfg.calls.end(), [](const CallEdge &a, const CallEdge &b) {
+                    return a.caller != b.caller ? a.caller < b.caller : a.callee < b.callee;
+                });
+                cfg.calls.erase(std::unique(cfg.calls.begin(), cfg.calls.end()), cfg.calls.end());
+            }
+
+            void push_block(std::uint16_t start, std::vector<bool> &visited, std::vector<std::size_t> &stack) const
+            {
+                if (start == NO_ADDRESS) {
+                    return;
+                }
+                auto it = std::lower_bound(cfg.blocks.begin(), cfg.blocks.end(), start,
+                                           [](const BasicBlock &block, std::uint16_t address) { return block.start < address; });
+                if (it != cfg.blocks.end() && it->start == start) {
+                    std::size_t index = static_cast<std::size_t>(it - cfg.blocks.begin());
+                    if (!visited[index]) {
+                        visited[index] = true;
+                        stack.push_back(index);
+                    }
+                }
+            }
+        };
+
+        /*
+            Binary layout, all values little endian:
+                "C8CF", version, platform, base, byte count (32 bits), block count (32 bits),
+                every block as start, end, kind and both successors,
+                function count (32 bits) and entry points, call count (32 bits) and caller/callee pairs,
+                then the byte kinds packed four to a byte, first byte in the low bits.
+            Bump CFG_VERSION whenever the layout changes.
+        */
+        constexpr std::array<std::uint8_t, 4> CFG_MAGIC { 'C', '8', 'C', 'F' };
+        constexpr std::uint8_t CFG_VERSION = 1;
+        constexpr std::size_t CFG_BLOCK_SIZE = 2 + 2 + 1 + 2 + 2;
+
+        struct CfgWriter {
+            std::vector<std::uint8_t> &data;
+
+            void put8(std::uint8_t value) { data.push_back(value); }
+            void put16(std::uint16_t value) { put8(static_cast<std::uint8_t>(value)); put8(static_cast<std::uint8_t>(value >> 8)); }
+            void put32(std::uint32_t value) { put16(static_cast<std::uint16_t>(value)); put16(static_cast<std::uint16_t>(value >> 16)); }
+        };
+
+        // Fails once a read would run past the end instead of reading beyond it
+        struct CfgReader {
+            const std::uint8_t *data;
+            std::size_t remaining;
+
+            bool has(std::size_t size) const { return size <= remaining; }
+            std::uint8_t get8() { remaining--; return *data++; }
+            std::uint16_t get16() { std::uint16_t low = get8(); return static_cast<std::uint16_t>(low | get8() << 8); }
+            std::uint32_t get32() { std::uint32_t low = get16(); return low | static_cast<std::uint32_t>(get16()) << 16; }
+        };
+
+        void append_hex(std::string &text, unsigned int value)
+        {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "%04x", value);
+            text += buffer;
+        }
+    }
+
+    ControlFlowGraph analyze_control_flow(std::span<const std::uint8_t> code, std::uint16_t base, Platform platform)
+    {
+        ControlFlowGraph cfg;
+        cfg.platform = platform;
+        cfg.base = base;
+        with_quirks(platform, [&](auto quirks) {
+            Analyzer<decltype(quirks)::xochip_opcodes>(code, base, cfg).run();
+        });
+        return cfg;
+    }
+
+    const BasicBlock *find_block(const ControlFlowGraph &cfg, std::uint16_t address)
+    {
+        auto it = std::upper_bound(cfg.blocks.begin(), cfg.blocks.end(), address,
+                                   [](std::uint16_t address, const BasicBlock &block) { return address < block.start; });
+        if (it == cfg.blocks.begin() || address >= std::prev(it)->end) {
+            return nullptr;
+        }
+        return &*std::prev(it);
+    }
+
+    std::vector<std::uint8_t> save_cfg(const ControlFlowGraph &cfg)
+    {
+        std::vector<std::uint8_t> data;
+        data.reserve(CFG_MAGIC.size() + 12 + cfg.blocks.size() * CFG_BLOCK_SIZE + cfg.bytes.size() / 4 + 16);
+        CfgWriter writer { data };
+
+        for (std::uint8_t c : CFG_MAGIC) {
+            writer.put8(c);
+        }
+        writer.put8(CFG_VERSION);
+        writer.put8(static_cast<std::uint8_t>(cfg.platform));
+        writer.put16(cfg.base);
+        writer.put32(static_cast<std::uint32_t>(cfg.bytes.size()));
+
+        writer.put32(static_cast<std::uint32_t>(cfg.blocks.size()));
+        for (const BasicBlock &block : cfg.blocks) {
+            writer.put16(block.start);
+            writer.put16(block.end);
+            writer.put8(static_cast<std::uint8_t>(block.kind));
+            writer.put16(block.successors[0]);
+            writer.put16(block.successors[1]);
+        }
+
+        writer.put32(static_cast<std::uint32_t>(cfg.functions.size()));
+        for (std::uint16_t function : cfg.functions) {
+            writer.put16(function);
+        }
+
+        writer.put32(static_cast<std::uint32_t>(cfg.calls.size()));
+        for (const CallEdge &call : cfg.calls) {
+            writer.put16(call.caller);
+            writer.put16(call.callee);
+        }
+
+        for (std::size_t i = 0; i < cfg.bytes.size(); i += 4) {
+            std::uint8_t packed = 0;
+            for (std::size_t j = 0; j < 4 && i + j < cfg.bytes.size(); j++) {
+                packed |= static_cast<std::uint8_t>(static_cast<unsigned int>(cfg.bytes[i + j]) << (2 * j));
+            }
+            writer.put8(packed);
+        }
+        return data;
+    }
+
+    bool load_cfg(ControlFlowGraph &cfg, const std::uint8_t *data, std::size_t size)
+    {
+        CfgReader reader { data, size };
+        if (!reader.has(CFG_MAGIC.size() + 12) || std::memcmp(data, CFG_MAGIC.data(), CFG_MAGIC.size()) != 0) {
+            return false;
+        }
+        reader.data += CFG_MAGIC.size();
+        reader.remaining -= CFG_MAGIC.size();
+
+        if (reader.get8() != CFG_VERSION) {
+            return false;
+        }
+
+        ControlFlowGraph loaded;
+        std::uint8_t platform = reader.get8();
+        if (platform > static_cast<std::uint8_t>(Platform::xochip)) {
+            return false;
+        }
+        loaded.platform = static_cast<Platform>(platform);
+        loaded.base = reader.get16();
+        std::uint32_t byte_count = reader.get32();
+
+        std::uint32_t block_count = reader.get32();
+        if (!reader.has(static_cast<std::size_t>(block_count) * CFG_BLOCK_SIZE + 4)) {
+            return false;
+        }
+        // Blocks must be non-empty, inside the ROM and sorted by start: find_block searches them and the
+        // listings slice the ROM by them. On XO-CHIP a block may start inside the 4-byte instruction
+        // ending the one before it, so blocks can overlap.
+        const std::uint32_t rom_end = static_cast<std::uint32_t>(loaded.base) + byte_count;
+        std::uint32_t first_start = loaded.base;
+        loaded.blocks.resize(block_count);
+        for (BasicBlock &block : loaded.blocks) {
+            block.start = reader.get16();
+            block.end = reader.get16();
+            if (block.start < first_start || block.end <= block.start || block.end > rom_end) {
+                return false;
+            }
+            first_start = block.start + 1u;
+            std::uint8_t kind = reader.get8();
+            if (kind > static_cast<std::uint8_t>(BlockEnd::end_of_code)) {
+                return false;
+            }
+            block.kind = static_cast<BlockEnd>(kind);
+            block.successors[0] = reader.get16();
+            block.successors[1] = reader.get16();
+        }
+
+        std::uint32_t function_count = reader.get32();
+        if (!reader.has(static_cast<std::size_t>(function_count) * 2 + 4)) {
+            return false;
+        }
+        loaded.functions.resize(function_count);
+        for (std::uint16_t &function : loaded.functions) {
+            function = reader.get16();
+        }
+
+        std::uint32_t call_count = reader.get32();
+        if (!reader.has(static_cast<std::size_t>(call_count) * 4 + (byte_count + 3) / 4)) {
+            return false;
+        }
+        loaded.calls.resize(call_count);
+        for (CallEdge &call : loaded.calls) {
+            call.caller = reader.get16();
+            call.callee = reader.get16();
+        }
+
+        loaded.bytes.resize(byte_count);
+        for (std::size_t i = 0; i < byte_count; i += 4) {
+            std::uint8_t packed = reader.get8();
+            for (std::size_t j = 0; j < 4 && i + j < byte_count; j++) {
+                std::uint8_t kind = (packed >> (2 * j)) & 0x3;
+                if (kind > static_cast<std::uint8_t>(ByteKind::operand)) {
+                    return false;
+                }
+                loaded.bytes[i + j] = static_cast<ByteKind>(kind);
+            }
+        }
+
+        cfg = std::move(loaded);
+        return true;
+    }
+
+    std::string cfg_to_dot(const ControlFlowGraph &cfg, std::span<const std::uint8_t> code)
+    {
+        std::string text = "digraph cfg {\n    node [shape=box, fontname=monospace];\n";
+
+        for (const BasicBlock &block : cfg.blocks) {
+            text += "    b";
+            append_hex(text, block.start);
+            text += " [label=\"";
+            // Disassembly lines are left aligned with \l
+            std::size_t offset = block.start - cfg.base;
+            if (offset + (block.end - block.start) <= code.size()) {
+                disassemble(code.subspan(offset, block.end - block.start), block.start, cfg.platform, [&](std::string_view lines) {
+                    for (char c : lines) {
+                        if (c == '\n') {
+                            text += "\\l";
+                        } else {
+                            text += c;
+                        }
+                    }
+                });
+            }
+            text += "\"];\n";
+
+            for (std::size_t i = 0; i < block.successors.size(); i++) {
+                if (block.successors[i] == NO_ADDRESS) {
+                    continue;
+                }
+                text += "    b";
+                append_hex(text, block.start);
+                text += " -> b";
+                append_hex(text, block.successors[i]);
+                if (block.kind == BlockEnd::call && i == 1) {
+                    text += " [style=dashed]";
+                } else if (block.kind == BlockEnd::skip && i == 1) {
+                    text += " [label=skip]";
+                }
+                text += ";\n";
+            }
+        }
+
+        text += "}\n";
+        return text;
+    }
+
+    std::string cfg_to_json(const ControlFlowGraph &cfg)
+    {
+        std::string text = "{\"platform\":\"";
+        text += get_platform_name(cfg.platform);
+        text += "\",\"base\":" + std::to_string(cfg.base);
+        text += ",\"size\":" + std::to_string(cfg.bytes.size());
+
+        text += ",\"blocks\":[";
+        for (std::size_t i = 0; i < cfg.blocks.size(); i++) {
+            const BasicBlock &block = cfg.blocks[i];
+            text += i == 0 ? "{" : ",{";
+            text += "\"start\":" + std::to_string(block.start);
+            text += ",\"end\":" + std::to_string(block.end);
+            text += ",\"kind\":\"";
+            text += get_block_end_name(block.kind);
+            text += "\",\"successors\":[";
+            bool first = true;
+            for (std::uint16_t successor : block.successors) {
+                if (successor != NO_ADDRESS) {
+                    text += first ? "" : ",";
+                    text += std::to_string(successor);
+                    first = false;
+                }
+            }
+            text += "]}";
+        }
+
+        text += "],\"functions\":[";
+        for (std::size_t i = 0; i < cfg.functions.size(); i++) {
+            text += i == 0 ? "" : ",";
+            text += std::to_string(cfg.functions[i]);
+        }
+
+        text += "],\"calls\":[";
+        for (std::size_t i = 0; i < cfg.calls.size(); i++) {
+            text += i == 0 ? "[" : ",[";
+            text += std::to_string(cfg.calls[i].caller) + "," + std::to_string(cfg.calls[i].callee) + "]";
+        }
+
+        // Code as [start, end) address ranges, everything else is data
+        text += "],\"code\":[";
+        bool first = true;
+        for (std::size_t i = 0; i < cfg.bytes.size();) {
+            if (cfg.bytes[i] == ByteKind::data) {
+                i++;
+                continue;
+            }
+            std::size_t end = i;
+            while (end < cfg.bytes.size() && cfg.bytes[end] != ByteKind::data) {
+                end++;
+            }
+            text += first ? "[" : ",[";
+            text += std::to_string(cfg.base + i) + "," + std::to_string(cfg.base + end) + "]";
+            first = false;
+            i = end;
+        }
+
+        text += "]}\n";
+        return text;
+    }
+
+    const char *get_block_end_name(BlockEnd kind)
+    {
+        switch (kind) {
+            case BlockEnd::fallthrough: return "fallthrough";
+            case BlockEnd::jump: return "jump";
+            case BlockEnd::call: return "call";
+            case BlockEnd::skip: return "skip";
+            case BlockEnd::ret: return "ret";
+            case BlockEnd::indirect: return "indirect";
+            case BlockEnd::invalid: return "invalid";
+            case BlockEnd::end_of_code: return "end_of_code";
+        }
+        return "unknown";
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+#include "chip8.h"
+
+namespace chip8 {
+    /*
+        Static control flow analysis of a ROM. Starting at the load address it follows jumps (1nnn),
+        calls (2nnn), both outcomes of every skip and the return site after each call, so only bytes
+        that can run as instructions are marked as code and sprite data in between is left alone.
+        Reachable code is split into basic blocks: straight runs of instructions entered only at the
+        top and left only at the bottom.
+
+        The analysis assumes code is not modified at run time, and cannot follow Bnnn (JP V0, nnn),
+        whose target depends on a register; such blocks end as indirect.
+    */
+    enum class BlockEnd : std::uint8_t {
+        fallthrough,    // Runs into the next block
+        jump,           // 1nnn
+        call,           // 2nnn, continues at the return site
+        skip,           // 3xkk, 4xkk, 5xy0, 9xy0, Ex9E or ExA1: the next instruction or the one after
+        ret,            // 00EE
+        indirect,       // Bnnn
+        invalid,        // An instruction the platform does not have
+        end_of_code,    // Runs past the end of the ROM
+    };
+
+    enum class ByteKind : std::uint8_t {
+        data,
+        instruction,    // The first byte of a reachable instruction
+        operand,        // Any further byte of one
+    };
+
+    inline constexpr std::uint16_t NO_ADDRESS = 0xFFFF;
+
+    struct BasicBlock {
+        std::uint16_t start;
+        std::uint16_t end;              // Just past the last instruction
+        BlockEnd kind;
+        // Blocks run next, NO_ADDRESS if unused or outside the ROM. A call lists the return site, then the callee.
+        std::array<std::uint16_t, 2> successors { NO_ADDRESS, NO_ADDRESS };
+    };
+
+    struct CallEdge {
+        std::uint16_t caller;           // Entry of the calling function
+        std::uint16_t callee;
+        bool operator==(const CallEdge &) const = default;
+    };
+
+    struct ControlFlowGraph {
+        Platform platform = Platform::modern;
+        std::uint16_t base = 0;                 // Address of the first byte of the ROM
+        std::vector<ByteKind> bytes;            // One per byte of the ROM
+        std::vector<BasicBlock> blocks;         // Sorted by start
+        std::vector<std::uint16_t> functions;   // Entry points, sorted: base and every call target
+        std::vector<CallEdge> calls;            // Sorted and without duplicates
+    };
+
+    ControlFlowGraph analyze_control_flow(std::span<const std::uint8_t> code, std::uint16_t base, Platform platform);
+
+    // The block holding an instruction address, or nullptr for data and addresses outside the ROM
+    const BasicBlock *find_block(const ControlFlowGraph &cfg, std::uint16_t address);
+
+    // Compact little endian binary form, see cfg.cpp for the layout
+    std::vector<std::uint8_t> save_cfg(const ControlFlowGraph &cfg);
+
+    bool load_cfg(ControlFlowGraph &cfg, const std::uint8_t *data, std::size_t size);
+
+    // Graphviz digraph of the blocks, each labelled with its disassembly from code
+    std::string cfg_to_dot(const ControlFlowGraph &cfg, std::span<const std::uint8_t> code);
+
+    std::string cfg_to_json(const ControlFlowGraph &cfg);
+
+    const char *get_block_end_name(BlockEnd kind);
+}
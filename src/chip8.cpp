@@ -1,171 +1,187 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
-#include <iostream>
 #include <fstream>
 #include <array>
 #include <string>
-#include <sstream>
-#include <sys/types.h>
-#include <vector>
 #include <cstring>
+#include <bit>
+#include <algorithm>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
 #include "chip8.h"
+#include "decode.h"
+#include "ops.h"
+#include "profile.h"
+#include "quirks.h"
+#include "trace.h"
 
 namespace chip8 {
     std::string LIB_NAME = "Emu-Chip8";
     std::string LIB_VERSION = "0.1.0";
 
-    constexpr int MEMORY_SIZE_BYTES = 4096;
-
-    /*
-        The first CHIP-8 interpreter (on the COSMAC VIP computer) was also located in RAM, from address 000 to 1FF. 
-        It would expect a CHIP-8 program to be loaded into memory after it, starting at address 0x200
-    */
-    constexpr uint16_t PROGRAM_START_ADDRESS = 0x200;
-
-    std::uint16_t program_counter = 0;
-    std::uint16_t i_register = 0;
-    std::uint8_t delay_timer = 0;
-    std::uint8_t sound_timer = 0;
-    std::uint32_t global_cycle_number = 0;
-
-    std::array<std::uint8_t, MEMORY_SIZE_BYTES> memory {};
-    std::array<std::array<std::uint8_t, SCREEN_WIDTH>, SCREEN_HEIGHT> display {}; // 64w X 32h Display
-
-    std::array<std::uint8_t, 16> registers{};
-    std::vector<int> stack(0); // TODO size?
-
-    //  For some reason, it’s become popular to put fonts at 050–09F. We will follow this "convention". TODO
+    // Loaded at FONT_START_ADDRESS
+    constexpr std::array<std::uint8_t, 0x50> FONTS {
+        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+        0x20, 0x60, 0x20, 0x20, 0x70, // 1
+        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+        0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+    };
+
+    // RGB565 colour for each combination of the four plane bits. 0 and 1 keep the classic black and white.
+    constexpr std::array<std::uint16_t, 16> PALETTE {
+        0x0000, 0xFFFF, 0xFE60, 0x6B4D, 0xF800, 0x07E0, 0x001F, 0xFFE0,
+        0x07FF, 0xF81F, 0x8410, 0xC618, 0x8000, 0x0400, 0x0010, 0xFD20,
+    };
+
+    // Byte j of PIXEL_SPREAD[b] is 1 when pixel j (bit 7-j) of the plane byte b is lit
+    constexpr std::array<std::uint64_t, 256> PIXEL_SPREAD = [] {
+        std::array<std::uint64_t, 256> table {};
+        for (unsigned b = 0; b < 256; b++) {
+            for (unsigned j = 0; j < 8; j++) {
+                table[b] |= static_cast<std::uint64_t>((b >> (7 - j)) & 0x1) << (8 * j);
+            }
+        }
+        return table;
+    }();
+
+#if defined(__SSSE3__)
+    // PALETTE split into low and high bytes, as 16-entry tables for pshufb
+    alignas(16) constexpr std::array<std::uint8_t, 16> PALETTE_LOW = [] {
+        std::array<std::uint8_t, 16> table {};
+        for (unsigned i = 0; i < 16; i++) table[i] = static_cast<std::uint8_t>(PALETTE[i] & 0xFF);
+        return table;
+    }();
+    alignas(16) constexpr std::array<std::uint8_t, 16> PALETTE_HIGH = [] {
+        std::array<std::uint8_t, 16> table {};
+        for (unsigned i = 0; i < 16; i++) table[i] = static_cast<std::uint8_t>(PALETTE[i] >> 8);
+        return table;
+    }();
+#endif
 
     const char *get_lib_name() {return LIB_NAME.c_str();};
     const char *get_lib_version() {return LIB_VERSION.c_str();};
 
-    // Decompiler
-    bool check_instruction(std::uint16_t inst, std::uint16_t target, std::uint16_t mask) 
+    // Memory access through the platform's address mask, so addresses wrap around like on the real hardware
+    // instead of running off the end. reset() and load_state() keep memory exactly Q::memory_size bytes long.
+    template <typename Q>
+    static inline std::uint8_t memory_at(const Machine &machine, unsigned int address)
     {
-        return ((inst & mask) ^ target) == 0;
+        static_assert((Q::memory_size & (Q::memory_size - 1)) == 0, "memory size must be a power of two");
+        address &= Q::memory_size - 1;
+        return machine.memory[address / PAGE_SIZE][address % PAGE_SIZE];
     }
 
+    // Writes go through edit(), which unshares the page first if the machine was forked
+    template <typename Q>
+    static inline std::uint8_t &writable_memory_at(Machine &machine, unsigned int address)
+    {
+        address &= Q::memory_size - 1;
+        return machine.memory.edit(address / PAGE_SIZE)[address % PAGE_SIZE];
+    }
 
-    void decompile() 
+    // Copy bytes into memory across page boundaries. The range must fit in memory.
+    static void write_bytes(Machine &machine, size_t address, const std::uint8_t *data, size_t size)
     {
-        // Given a rom file, disassemble instructions and print them to the console
-        std::cout << "-- BEGIN DECOMPILATION --\n";
-        char instruction[2] = {0};
-        uint16_t current_address = 0;
-        std::ifstream input("roms/IBM Logo.ch8", std::ios::binary);
+        while (size > 0) {
+            size_t offset = address % PAGE_SIZE;
+            size_t chunk = std::min(size, PAGE_SIZE - offset);
+            std::memcpy(machine.memory.edit(address / PAGE_SIZE).data() + offset, data, chunk);
+            address += chunk;
+            data += chunk;
+            size -= chunk;
+        }
+    }
 
-        while (input.read(instruction, 2)) {
-            std::uint16_t first_byte = static_cast<std::uint16_t>(static_cast<unsigned char>(instruction[0])) << 8;
-            std::uint16_t second_byte = static_cast<std::uint16_t>(static_cast<unsigned char>(instruction[1]));
+    // Zeroed memory with the fonts in place, one image per platform. Every reset machine starts out
+    // sharing these pages, so idle machines only pay for the pages they have written to.
+    static const SharedPages<MemoryPage> &blank_memory(Platform platform)
+    {
+        static const std::array<SharedPages<MemoryPage>, 4> images = [] {
+            std::array<SharedPages<MemoryPage>, 4> result;
+            for (auto candidate : { Platform::modern, Platform::cosmac_vip, Platform::schip, Platform::xochip }) {
+                SharedPages<MemoryPage> pages(static_cast<size_t>(get_memory_size(candidate)) / PAGE_SIZE);
+                std::memcpy(pages.edit(0).data() + FONT_START_ADDRESS, FONTS.data(), FONTS.size());
+                result[static_cast<size_t>(candidate)] = std::move(pages);
+            }
+            return result;
+        }();
+        return images[static_cast<size_t>(platform)];
+    }
 
-            std::uint16_t current_instruction = first_byte | second_byte;
+    static const SharedPages<Plane> &blank_display()
+    {
+        static const SharedPages<Plane> planes(MAX_PLANES);
+        return planes;
+    }
 
-            printf("0x%04x  0x%04x ", current_address, current_instruction); // Print instruction address and value as hex
-            current_address += 2; // Advance to next address
+    // Halt the machine on a genuine error. Kept out of line, so the interpreter loop only pays for the check.
+    // The PC is left on the faulting instruction.
+    [[gnu::cold]] [[gnu::noinline]] static void raise_fault(Machine &machine, Fault fault, std::uint16_t address)
+    {
+        machine.fault = fault;
+        machine.program_counter = address;
+    }
 
-            if (current_instruction == 0x00E0) {
-                // CLS - Clear screen
-                std::cout << "CLS\n";
-
-            } else if (check_instruction(current_instruction, 0xA000, 0xF000)) {
-                // LD I, nnn - Load from address into register I
-                std::uint16_t address = current_instruction & 0x0FFF;
-                std::cout << "LD I, ";
-                printf("0x%04x\n", address);
-
-            } else if (check_instruction(current_instruction, 0x1000, 0xF000)) {
-                // JP - Jump to address
-                std::uint16_t address = current_instruction & 0x0FFF;
-                printf("JP 0x%04x\n", address);
-
-            } else if (current_instruction == 0x00EE) {
-                // RET - Return from subroutine
-                std::cout << "RET\n";
-
-            } else if (check_instruction(current_instruction, 0x6000, 0xF000)) {
-                // LD - Load literal
-                std::uint8_t reg = static_cast<std::uint8_t>((current_instruction & 0x0F00) >> 8);
-                std::uint8_t value = static_cast<std::uint8_t>(current_instruction & 0x00FF);
-                std::cout << "LD V" << unsigned(reg) << ", #" << unsigned(value) << "\n";
-
-            } else if (check_instruction(current_instruction, 0xD000, 0xF000)) {
-                // DRW - Draw
-                std::uint8_t reg_x = static_cast<std::uint8_t>((current_instruction & 0x0F00) >> 8);
-                std::uint8_t reg_y = static_cast<std::uint8_t>((current_instruction & 0x00F0) >> 4);
-                std::uint8_t nibble = static_cast<std::uint8_t>(current_instruction & 0x000F);
-                std::cout << "DRW V" << unsigned(reg_x) << ", V" << unsigned(reg_y) << ", ";
-                printf("0x%01x\n", nibble);
-
-            } else if (check_instruction(current_instruction, 0x7000, 0xF000)) {
-                // ADD - Add value
-                std::uint8_t reg = static_cast<std::uint8_t>((current_instruction & 0x0F00) >> 8);
-                std::uint8_t value = static_cast<std::uint8_t>(current_instruction & 0x00FF);
-                std::cout << "ADD V" << unsigned(reg) << ", #" << unsigned(value) << "\n";
-
-            } else if (check_instruction(current_instruction, 0x3000, 0xF000)) {
-                // SE - Skip next instruction on condition
-                std::uint8_t reg = static_cast<std::uint8_t>((current_instruction & 0x0F00) >> 8);
-                std::uint8_t value = static_cast<std::uint8_t>(current_instruction & 0x00FF);
-                std::cout << "SE V" << unsigned(reg) << ", #" << unsigned(value) << "\n";
-
-            } else if (check_instruction(current_instruction, 0x0, 0xF000)) {
-                // SYS - Jump to a machine code routine
-                std::uint16_t address = current_instruction & 0x0FFF;
-                printf("SYS 0x%04x\n", address);
-
-            } else if (check_instruction(current_instruction, 0xB000, 0xF000)) {
-                // JP - Jump to location nnn + V0
-                std::uint16_t address = current_instruction & 0x0FFF;
-                printf("JP V0, 0x%04x\n", address);
-
-            } else if (check_instruction(current_instruction, 0xC000, 0xF000)) {
-                // RND - Set random value
-                std::uint8_t reg = static_cast<std::uint8_t>((current_instruction & 0x0F00) >> 8);
-                std::uint8_t value = static_cast<std::uint8_t>(current_instruction & 0x00FF);
-                std::cout << "RND V" << unsigned(reg) << ", #" << unsigned(value) << "\n";
-
-            } else if (check_instruction(current_instruction, 0x4000, 0xF000)) {
-                // SNE - Skip next instruction on condition
-                std::uint8_t reg = static_cast<std::uint8_t>((current_instruction & 0x0F00) >> 8);
-                std::uint8_t value = static_cast<std::uint8_t>(current_instruction & 0x00FF);
-                std::cout << "SNE V" << unsigned(reg) << ", #" << unsigned(value) << "\n";
-
-            } else if (check_instruction(current_instruction, 0x8000, 0xF00F)) {
-                // LD - Load from register to register
-                std::uint8_t reg_x = static_cast<std::uint8_t>((current_instruction & 0x0F00) >> 8);
-                std::uint8_t reg_y = static_cast<std::uint8_t>((current_instruction & 0x00F0) >> 4);
-                std::cout << "LD V" << unsigned(reg_x) << ", V" << unsigned(reg_y) << "\n";
-
-            }
-            else {
-                std::cout << "NOOP?\n";
-            }
+    // Skip the next instruction. On XO-CHIP the instruction may be the 4-byte F000 nnnn, which is skipped whole.
+    template <typename Q, bool Profiling>
+    static void skip_next_instruction(Machine &machine, Profile *profile)
+    {
+        if constexpr (Profiling) {
+            profile->skips_taken++;
         }
+        if (Q::xochip_opcodes
+            && memory_at<Q>(machine, machine.program_counter) == 0xF0
+            && memory_at<Q>(machine, machine.program_counter+1) == 0x00) {
+            machine.program_counter += 4;
+        } else {
+            machine.program_counter += 2;
+        }
+    }
 
-        std::cout << "-- END DECOMPILATION --\n";
+    bool check_instruction(std::uint16_t inst, std::uint16_t target, std::uint16_t mask) 
+    {
+        return ((inst & mask) ^ target) == 0;
     }
 
 
-    void dump_memory() 
+    void dump_memory(const Machine &machine) 
     {
         std::ofstream output("out/memory-dump.hex", std::ios::binary | std::ios::out);
 
-        for (uint16_t address = 0; address < MEMORY_SIZE_BYTES; address++) {
-            output.put(static_cast<char>(static_cast<unsigned char>(memory.at(address))));
+        for (size_t page = 0; page < machine.memory.size(); page++) {
+            output.write(reinterpret_cast<const char *>(machine.memory[page].data()), PAGE_SIZE);
         }
 
         output.close();
     }
 
 
-    void dump_display()
+    void dump_display(const Machine &machine)
     {
         std::ofstream output("out/display-dump.txt", std::ios::out);
 
+        // One hex digit per pixel, holding the pixel's bit from every plane
         for (unsigned i=0; i < SCREEN_HEIGHT; i++) {
             for (unsigned j=0; j < SCREEN_WIDTH; j++) {
-                output << static_cast<unsigned int>(display.at(i).at(j));
+                unsigned int color = 0;
+                for (unsigned p=0; p < MAX_PLANES; p++) {
+                    color |= static_cast<unsigned int>((machine.planes[p][i] >> (SCREEN_WIDTH - 1 - j)) & 0x1) << p;
+                }
+                output << std::hex << color;
             }
             output << "\n";
         }
@@ -173,34 +189,42 @@ namespace chip8 {
         output.close();
     }
 
-    void display_registers()
+    void display_registers(const Machine &machine)
     {
-        std::cout << "V0=" << unsigned(registers.at(0)) << " ";
-        std::cout << "V1=" << unsigned(registers.at(1)) << " ";
-        std::cout << "I=" << unsigned(i_register) << " ";
-        std::cout << "PC=" << unsigned(program_counter) << " ";
-        std::cout << "\n";
+        std::printf("V0=%u V1=%u I=%u PC=%u \n", machine.registers[0], machine.registers[1], machine.i_register,
+                    machine.program_counter);
     }
 
 
-    void fetch_decode_execute(unsigned int cycles)
+    // Profiling and Tracing add the counting and the trace records. Without them profile and trace
+    // are unused, and the loop compiles as if they did not exist.
+    template <typename Q, bool Profiling, bool Tracing>
+    static unsigned int execute(Machine &machine, unsigned int cycles, Profile *profile, TraceRecorder *trace)
     {
-        for (unsigned int curr_cycle = 1; curr_cycle <= cycles; curr_cycle++)
-        {
-            global_cycle_number++;
+        static_assert(Q::stack_depth <= MAX_STACK_DEPTH);
 
-            if (global_cycle_number % 12 == 0) {
-                if (delay_timer > 0) delay_timer--;
-                if (sound_timer > 0) sound_timer--;
-            }
+        unsigned int curr_cycle = 0;
+
+        // Held in a local so the counters are not looked up again after every write to the machine
+        std::uint64_t *pc_counts = Profiling ? profile->pc_counts.data() : nullptr;
+
+        for (; curr_cycle < cycles && !machine.waiting_for_vblank && machine.fault == Fault::none; curr_cycle++)
+        {
+            machine.global_cycle_number++;
 
             // Fetch instruction that PC is pointing to
-            std::array<std::uint8_t, 2> raw_instruction;
-            raw_instruction.at(0) = memory.at(program_counter);
-            raw_instruction.at(1) = memory.at(program_counter+1);
+            // Jumps can leave the PC past the end of the 4 KB platforms, which is an error rather than a wrap.
+            std::uint16_t instruction_address = machine.program_counter;
+            if constexpr (Q::memory_size <= 0xFFFF) {
+                if (instruction_address >= Q::memory_size) [[unlikely]] {
+                    raise_fault(machine, Fault::pc_out_of_range, instruction_address);
+                    break;
+                }
+            }
 
             // Decode & Execute
-            std::uint16_t instruction = (raw_instruction.at(0) << 8) | raw_instruction.at(1);
+            std::uint16_t instruction = static_cast<std::uint16_t>(memory_at<Q>(machine, instruction_address) << 8
+                                                                 | memory_at<Q>(machine, instruction_address + 1));
 
             std::uint8_t x = static_cast<std::uint8_t>((instruction & 0x0F00) >> 8);
             std::uint8_t y = static_cast<std::uint8_t>((instruction & 0x00F0) >> 4);
@@ -208,371 +232,669 @@ namespace chip8 {
             std::uint8_t kk = static_cast<std::uint8_t>(instruction & 0x00FF);
             std::uint16_t address_param = instruction & 0x0FFF;
 
-            printf("0x%04x 0x%04x ", program_counter, instruction);
+            machine.program_counter += 2;
+
+            if constexpr (Profiling) {
+                pc_counts[instruction_address]++;
+            }
+
+            // Memory written by the instruction, for the trace
+            [[maybe_unused]] std::uint16_t write_address = 0;
+            [[maybe_unused]] std::uint8_t write_count = 0;
 
-            program_counter += 2;
-            
-            if (instruction == 0x00E0) {
+            switch (decode<Q::xochip_opcodes>(instruction)) {
+            case Opcode::cls: {
                 // CLS - Clear screen
-                std::cout << "CLS\n";
-                for (unsigned i=0; i < SCREEN_HEIGHT; i++) {
-                    display.at(i).fill(0);
+                // On XO-CHIP only the selected planes are cleared.
+                for (unsigned p=0; p < MAX_PLANES; p++) {
+                    if (machine.plane_mask & (1u << p)) {
+                        machine.planes.edit(p).fill(0);
+                    }
                 }
+                break;
+            }
 
-            } else if (instruction == 0x00EE) {
+            case Opcode::ret: {
                 // 00EE - RET
                 // Return from a subroutine.
-                program_counter = stack.back();
-                stack.pop_back();
-                std::cout << "RET\n";
+                if (machine.stack_pointer == 0) [[unlikely]] {
+                    raise_fault(machine, Fault::stack_underflow, instruction_address);
+                    return curr_cycle;
+                }
+                machine.program_counter = machine.stack[--machine.stack_pointer];
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x0000, 0xF000)) {
+            case Opcode::sys: {
                 // 0nnn - SYS addr
                 // Jump to a machine code routine at nnn.
                 // This instruction is only used on the old computers on which Chip-8 was originally implemented. It is ignored by modern interpreters.
-                printf("SYS 0x%04x (NOOP)\n", address_param);
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x1000, 0xF000)) {
+            case Opcode::jp: {
                 // 1nnn - JP addr
                 // Jump to location nnn.
-                program_counter = address_param;
-                printf("JP 0x%04x\n", address_param);
-            
-            } else if (check_instruction(instruction, 0x2000, 0xF000)) {
+                machine.program_counter = address_param;
+                break;
+            }
+
+            case Opcode::call: {
                 // 2nnn - CALL addr
                 // Call subroutine at nnn.
-                stack.push_back(program_counter);
-                program_counter = address_param;
-                printf("CALL 0x%04x\n", address_param);
+                if (machine.stack_pointer >= Q::stack_depth) [[unlikely]] {
+                    raise_fault(machine, Fault::stack_overflow, instruction_address);
+                    return curr_cycle;
+                }
+                machine.stack[machine.stack_pointer++] = machine.program_counter;
+                machine.program_counter = address_param;
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x3000, 0xF000)) {
+            case Opcode::se_byte: {
                 // 3xkk - SE Vx, byte
                 // Skip next instruction if Vx = kk.
-                if (registers.at(x) == kk) 
+                if (machine.registers[x] == kk) 
                 {
-                    program_counter += 2;
+                    skip_next_instruction<Q, Profiling>(machine, profile);
                 }
-                std::cout << "SE V" << unsigned(x) << ", #" << unsigned(kk) << "\n";
-            
-            } else if (check_instruction(instruction, 0x4000, 0xF000)) {
+                break;
+            }
+
+            case Opcode::sne_byte: {
                 // 4xkk - SNE Vx, byte
                 // Skip next instruction if Vx != kk.
-                if (registers.at(x) != kk)
+                if (machine.registers[x] != kk)
                 {
-                    program_counter += 2;
+                    skip_next_instruction<Q, Profiling>(machine, profile);
                 }
-                std::cout << "SNE V" << unsigned(x) << ", #" << unsigned(kk) << "\n";
-
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x5000, 0xF00F)) {
+            case Opcode::se_reg: {
                 // 5xy0 - SE Vx, Vy
                 // Skip next instruction if Vx = Vy.
-                if (registers.at(x) == registers.at(y))
+                if (machine.registers[x] == machine.registers[y])
                 {
-                    program_counter += 2;
+                    skip_next_instruction<Q, Profiling>(machine, profile);
                 }
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x6000, 0xF000)) {
+            case Opcode::store_range: {
+                // 5xy2 - LD [I], Vx-Vy (XO-CHIP)
+                // Store registers Vx through Vy in memory starting at location I, in either order. I is not modified.
+                int step = x <= y ? 1 : -1;
+                for (int reg = x, offset = 0; ; reg += step, offset++) {
+                    writable_memory_at<Q>(machine, machine.i_register + offset) = machine.registers[reg];
+                    if (reg == y) break;
+                }
+                if constexpr (Tracing) {
+                    write_address = machine.i_register;
+                    write_count = static_cast<std::uint8_t>(x <= y ? y - x + 1 : x - y + 1);
+                }
+                break;
+            }
+
+            case Opcode::load_range: {
+                // 5xy3 - LD Vx-Vy, [I] (XO-CHIP)
+                // Read registers Vx through Vy from memory starting at location I, in either order. I is not modified.
+                int step = x <= y ? 1 : -1;
+                for (int reg = x, offset = 0; ; reg += step, offset++) {
+                    machine.registers[reg] = memory_at<Q>(machine, machine.i_register + offset);
+                    if (reg == y) break;
+                }
+                break;
+            }
+
+            case Opcode::ld_byte: {
                 // 6xkk - LD Vx, byte
                 // Set Vx = kk.
-                registers.at(x) = kk;
-                printf("LD V%u, 0x%02x\n", x, kk);
+                machine.registers[x] = kk;
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x7000, 0xF000)) {
+            case Opcode::add_byte: {
                 // 7xkk - ADD Vx, byte
                 // Set Vx = Vx + kk.
-                registers.at(x) += kk;
-                printf("ADD V%u, 0x%02x\n", x, kk);
+                machine.registers[x] += kk;
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x8000, 0xF00F)) {
-                // LD - Load from register to register
-                std::uint8_t reg_x = static_cast<std::uint8_t>((instruction & 0x0F00) >> 8);
-                std::uint8_t reg_y = static_cast<std::uint8_t>((instruction & 0x00F0) >> 4);
-                std::cout << "LD V" << unsigned(reg_x) << ", V" << unsigned(reg_y) << "\n";
+            case Opcode::ld_reg: {
+                // 8xy0 - LD Vx, Vy
+                // Set Vx = Vy.
+                machine.registers[x] = machine.registers[y];
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x8001, 0xF00F)) {
+            case Opcode::or_reg: {
                 // 8xy1 - OR Vx, Vy
                 // Set Vx = Vx OR Vy.
-                registers.at(x) |= registers.at(y);
-                std::cout << "OR V" << unsigned(x) << ", V" << unsigned(y) << "\n";
+                machine.registers[x] |= machine.registers[y];
+                if constexpr (Q::logic_resets_vf) {
+                    machine.registers[0xF] = 0;
+                }
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x8002, 0xF00F)) {
+            case Opcode::and_reg: {
                 // 8xy2 - AND Vx, Vy
                 // Set Vx = Vx AND Vy.
-                registers.at(x) &= registers.at(y);
-                std::cout << "AND V" << unsigned(x) << ", V" << unsigned(y) << "\n";
+                machine.registers[x] &= machine.registers[y];
+                if constexpr (Q::logic_resets_vf) {
+                    machine.registers[0xF] = 0;
+                }
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x8003, 0xF00F)) {
+            case Opcode::xor_reg: {
                 // 8xy3 - XOR Vx, Vy
                 // Set Vx = Vx XOR Vy.
-                registers.at(x) ^= registers.at(y);
-                std::cout << "XOR V" << unsigned(x) << ", V" << unsigned(y) << "\n";
+                machine.registers[x] ^= machine.registers[y];
+                if constexpr (Q::logic_resets_vf) {
+                    machine.registers[0xF] = 0;
+                }
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x8004, 0xF00F)) {
+            case Opcode::add_reg: {
                 // 8xy4 - ADD Vx, Vy
                 // Set Vx = Vx + Vy, set VF = carry.
-                uint16_t result = static_cast<uint16_t>(registers.at(x)) + static_cast<uint16_t>(registers.at(y));
-                registers.at(x) = static_cast<uint8_t>(result);
-                if ((result & 0xF00) > 0)
-                {
-                    registers.at(0xF) = 1;
-                }   
-                std::cout << "ADD V" << unsigned(x) << ", V" << unsigned(y) << "\n";
+                // VF is always written last, so the flag wins when Vx is VF.
+                uint16_t result = static_cast<uint16_t>(machine.registers[x]) + static_cast<uint16_t>(machine.registers[y]);
+                machine.registers[x] = static_cast<uint8_t>(result);
+                machine.registers[0xF] = result > 0xFF ? 1 : 0;
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x8005, 0xF00F)) {
+            case Opcode::sub_reg: {
                 // 8xy5 - SUB Vx, Vy
                 // Set Vx = Vx - Vy, set VF = NOT borrow.
-                if (registers.at(x) > registers.at(y))
-                {
-                    registers.at(0xF) = 1;
-                } else {
-                    registers.at(0xF) = 0;
-                }
-                registers.at(x) -= registers.at(y);   
-                std::cout << "SUB V" << unsigned(x) << ", V" << unsigned(y) << "\n";
+                std::uint8_t not_borrow = machine.registers[x] >= machine.registers[y] ? 1 : 0;
+                machine.registers[x] -= machine.registers[y];
+                machine.registers[0xF] = not_borrow;
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x8006, 0xF00F)) {
+            case Opcode::shr: {
                 // 8xy6 - SHR Vx {, Vy}
-                // Set Vx = Vx SHR 1.
-                if ((registers.at(x) & 0x1) == 0x1)
-                {
-                    registers.at(0xF) = 1;
-                } else {
-                    registers.at(0xF) = 0;
-                }
-                registers.at(x) /= 2;   
-                std::cout << "SHR V" << unsigned(x) << ", V" << unsigned(y) << "\n";
+                // Set Vx = Vx SHR 1, or Vy SHR 1 with the shift quirk.
+                std::uint8_t source = Q::shift_uses_vy ? machine.registers[y] : machine.registers[x];
+                machine.registers[x] = source >> 1;
+                machine.registers[0xF] = source & 0x1;
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x8007, 0xF00F)) {
+            case Opcode::subn: {
                 // 8xy7 - SUBN Vx, Vy
                 // Set Vx = Vy - Vx, set VF = NOT borrow.
-                if (registers.at(y) > registers.at(x))
-                {
-                    registers.at(0xF) = 1;
-                } else {
-                    registers.at(0xF) = 0;
-                }
-                registers.at(x) = registers.at(y) - registers.at(x);   
-                std::cout << "SUBN V" << unsigned(x) << ", V" << unsigned(y) << "\n";
+                std::uint8_t not_borrow = machine.registers[y] >= machine.registers[x] ? 1 : 0;
+                machine.registers[x] = machine.registers[y] - machine.registers[x];
+                machine.registers[0xF] = not_borrow;
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x800E, 0xF00F)) {
+            case Opcode::shl: {
                 // 8xyE - SHL Vx {, Vy}
-                // Set Vx = Vx SHL 1.
-                if ((registers.at(x) & 0x80) == 0x80)
-                {
-                    registers.at(0xF) = 1;
-                } else {
-                    registers.at(0xF) = 0;
-                }
-                registers.at(x) *= 2;   
-                std::cout << "SHL V" << unsigned(x) << ", V" << unsigned(y) << "\n";
+                // Set Vx = Vx SHL 1, or Vy SHL 1 with the shift quirk.
+                std::uint8_t source = Q::shift_uses_vy ? machine.registers[y] : machine.registers[x];
+                machine.registers[x] = static_cast<std::uint8_t>(source << 1);
+                machine.registers[0xF] = source >> 7;
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0x9000, 0xF00F)) {
+            case Opcode::sne_reg: {
                 // 9xy0 - SNE Vx, Vy
                 // Skip next instruction if Vx != Vy.
-                if (registers.at(x) != registers.at(y))
+                if (machine.registers[x] != machine.registers[y])
                 {
-                    program_counter += 2;
+                    skip_next_instruction<Q, Profiling>(machine, profile);
                 }   
-                std::cout << "SNE V" << unsigned(x) << ", V" << unsigned(y) << "\n";
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0xA000, 0xF000)) {
+            case Opcode::ld_i: {
                 // Annn - LD I, addr
                 // Set I = nnn.
-                i_register = address_param;
-                printf("LD I, 0x%04x\n", address_param);
+                machine.i_register = address_param;
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0xB000, 0xF000)) {
+            case Opcode::jp_offset: {
                 // Bnnn - JP V0, addr
-                // Jump to location nnn + V0.
-                program_counter = address_param + static_cast<uint16_t>(registers.at(0));
-                printf("JP V0, 0x%04x\n", address_param);
+                // Jump to location nnn + V0, or xnn + Vx with the jump quirk.
+                std::uint8_t offset_register = Q::jump_uses_vx ? x : 0;
+                machine.program_counter = address_param + static_cast<uint16_t>(machine.registers[offset_register]);
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0xC000, 0xF000)) {
+            case Opcode::rnd: {
                 // Cxkk - RND Vx, byte
                 // Set Vx = random byte AND kk.
-                uint8_t random = static_cast<uint8_t>(rand() % 256);
-                registers.at(x) = (random & kk);
-                std::cout << "RND V" << unsigned(x) << ", #" << unsigned(kk) << "\n";
+                machine.random_state = next_random(machine.random_state);
+                uint8_t random = static_cast<uint8_t>(machine.random_state >> 24);
+                machine.registers[x] = (random & kk);
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0xD000, 0xF000)) {
+            case Opcode::drw: {
                 // Dxyn - DRW Vx, Vy, nibble
                 // Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
-                std::uint8_t x_val = registers.at(x);
-                std::uint8_t y_val = registers.at(y);
-                std::uint8_t bytes_to_read = nibble;
-                
-                // 0,0 coords are at the top left of the screen
-                for (unsigned int i=0; i<bytes_to_read; i++) {
-                    auto row = (y_val + i) % SCREEN_HEIGHT;
-                    std::cout << "ROW" << row << std::endl;
-                    std::cout << i_register+i << std::endl;
-                    auto sprite = memory.at(i_register+i);
-
-                    for (unsigned int j=0; j<8; j++) {
-                        auto column = (x_val + j) % SCREEN_WIDTH;
-                        std::cout << "COL" << row << std::endl;
-                        bool was_set;
-                        if (display.at(row).at(column) == 1) {
-                            was_set = true;
-                        } else {
-                            was_set = false;
-                        }
-
-                        display.at(row).at(column) = display.at(row).at(column) ^ ((sprite >> (7-j)) & 0x1);
-
-                        if (display.at(row).at(column) == 0 && was_set) {
-                            // Bit was erased, so we set VF
-                            registers.at(0xF) = 1;
-                        }
-                    }
+                // XO-CHIP draws to every selected plane, reading one sprite per plane back to back from I,
+                // and Dxy0 draws a 16x16 sprite.
+                std::uint8_t x_val = machine.registers[x];
+                std::uint8_t y_val = machine.registers[y];
+                bool wide = nibble == 0 && Q::xochip_opcodes;
+                unsigned int rows = wide ? 16 : nibble;
+                unsigned int bytes_per_plane = wide ? 32 : nibble;
+                bool collision = false;
+                std::uint16_t address = machine.i_register;
+
+                for (unsigned int p=0; p < MAX_PLANES; p++) {
+                    if ((machine.plane_mask & (1u << p)) == 0) continue;
+
+                    collision |= draw_sprite<Q>(machine.planes.edit(p), [&](unsigned int a) { return memory_at<Q>(machine, a); },
+                                                address, x_val, y_val, rows, wide);
+                    address = static_cast<std::uint16_t>(address + bytes_per_plane);
+                }
+
+                machine.registers[0xF] = collision ? 1 : 0;
+                if constexpr (Profiling) {
+                    profile->draw_collisions += collision ? 1 : 0;
+                }
+
+                if constexpr (Q::display_wait) {
+                    machine.waiting_for_vblank = true;
+                }
+
+                break;
+            }
+
+            case Opcode::ld_i_long: {
+                // F000 nnnn - LD I, long addr (XO-CHIP)
+                // Set I = the 16-bit address stored in the next two bytes.
+                machine.i_register = static_cast<std::uint16_t>((memory_at<Q>(machine, machine.program_counter) << 8) | memory_at<Q>(machine, machine.program_counter+1));
+                machine.program_counter += 2;
+                break;
+            }
+
+            case Opcode::plane: {
+                // Fn01 - PLANE n (XO-CHIP)
+                // Select the bitplanes that CLS and DRW operate on.
+                machine.plane_mask = x;
+                break;
+            }
+
+            case Opcode::skp: {
+                // Ex9E - SKP Vx
+                // Skip next instruction if key with the value of Vx is pressed.
+                if (machine.keys & (1u << (machine.registers[x] & 0xF)))
+                {
+                    skip_next_instruction<Q, Profiling>(machine, profile);
                 }
+                break;
+            }
 
-                std::cout << "DRW V" << unsigned(x) << ", V" << unsigned(nibble) << ", ";
-                printf("0x%01x\n", nibble);
+            case Opcode::sknp: {
+                // ExA1 - SKNP Vx
+                // Skip next instruction if key with the value of Vx is not pressed.
+                if ((machine.keys & (1u << (machine.registers[x] & 0xF))) == 0)
+                {
+                    skip_next_instruction<Q, Profiling>(machine, profile);
+                }
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0xF007, 0xF0FF)) {
+            case Opcode::audio:
+            case Opcode::pitch: {
+                // F002 - AUDIO, Fx3A - PITCH Vx (XO-CHIP)
+                // Load the audio pattern buffer or set the playback pitch. There is no audio output yet, so these are ignored.
+                break;
+            }
+
+            case Opcode::ld_vx_dt: {
                 // Fx07 - LD Vx, DT
                 // Set Vx = delay timer value.
-                registers.at(x) = delay_timer;
-                std::cout << "LD V" << unsigned(x) << ", DT\n";
+                machine.registers[x] = machine.delay_timer;
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0xF015, 0xF0FF)) {
+            case Opcode::ld_key: {
+                // Fx0A - LD Vx, K
+                // Wait for a key press, store the value of the key in Vx.
+                // The key is taken on release, like the COSMAC VIP, and the instruction repeats until then.
+                if (machine.pending_key < 0) {
+                    if (machine.keys != 0) {
+                        machine.pending_key = static_cast<std::int8_t>(std::countr_zero(machine.keys));
+                    }
+                    machine.program_counter -= 2;
+                } else if (machine.keys & (1u << machine.pending_key)) {
+                    machine.program_counter -= 2;
+                } else {
+                    machine.registers[x] = static_cast<std::uint8_t>(machine.pending_key);
+                    machine.pending_key = -1;
+                }
+                break;
+            }
+
+            case Opcode::ld_dt: {
                 // Fx15 - LD DT, Vx
                 // Set delay timer = Vx.
-                delay_timer = registers.at(x);
-                std::cout << "LD DT, V" << unsigned(x) << "\n";
+                machine.delay_timer = machine.registers[x];
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0xF018, 0xF0FF)) {
+            case Opcode::ld_st: {
                 // Fx18 - LD ST, Vx
                 // Set sound timer = Vx.
-                sound_timer = registers.at(x);
-                std::cout << "LD ST, V" << unsigned(x) << "\n";
+                machine.sound_timer = machine.registers[x];
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0xF01E, 0xF0FF)) {
+            case Opcode::add_i: {
                 // Fx1E - ADD I, Vx
                 // Set I = I + Vx.
-                i_register += registers.at(x);
-                std::cout << "ADD I, V" << unsigned(x) << "\n";
+                machine.i_register += machine.registers[x];
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0xF029, 0xF0FF)) {
+            case Opcode::ld_font: {
                 // Fx29 - LD F, Vx
                 // Set I = location of sprite for digit Vx.
-                auto font = registers.at(x);
-                i_register = (font * 5) + 0x50;
-                std::cout << "LD F, V" << unsigned(x) << "\n";
+                auto font = machine.registers[x] & 0xF;
+                machine.i_register = static_cast<std::uint16_t>((font * 5) + FONT_START_ADDRESS);
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0xF033, 0xF0FF)) {
+            case Opcode::bcd: {
                 // Fx33 - LD B, Vx
                 // Store BCD representation of Vx in memory locations I, I+1, and I+2.
-                auto val = registers.at(x);
-
-                memory.at(i_register) = val/100;
-                memory.at(i_register+1) = val/10;
-                memory.at(i_register+2) = val%10;
+                auto val = machine.registers[x];
+
+                writable_memory_at<Q>(machine, machine.i_register) = val/100;
+                writable_memory_at<Q>(machine, machine.i_register+1) = (val/10)%10;
+                writable_memory_at<Q>(machine, machine.i_register+2) = val%10;
+                if constexpr (Tracing) {
+                    write_address = machine.i_register;
+                    write_count = 3;
+                }
                 
-                std::cout << "LD B, V" << unsigned(x) << "\n";
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0xF055, 0xF0FF)) {
+            case Opcode::store: {
                 // Fx55 - LD [I], Vx
                 // Store registers V0 through Vx in memory starting at location I.
-                for (uint16_t i = 0; i < x; i++) {
-                    memory.at(i_register+i) = registers.at(i);
-                } // TODO CHECK
-                std::cout << "LD [I], V" << unsigned(x) << "\n";
+                for (uint16_t i = 0; i <= x; i++) {
+                    writable_memory_at<Q>(machine, machine.i_register+i) = machine.registers[i];
+                }
+                if constexpr (Tracing) {
+                    write_address = machine.i_register;
+                    write_count = static_cast<std::uint8_t>(x + 1);
+                }
+                if constexpr (Q::load_store_increments_i) {
+                    machine.i_register += x + 1;
+                }
+                break;
+            }
 
-            } else if (check_instruction(instruction, 0xF065, 0xF0FF)) {
+            case Opcode::load: {
                 // Fx65 - LD Vx, [I]
                 // Read registers V0 through Vx from memory starting at location I.
-                for (uint16_t i = 0; i < x; i++) {
-                    registers.at(i) = memory.at(i_register+i);
-                } // TODO CHECK
-                std::cout << "LD V" << unsigned(x) << ", [I]\n";
+                for (uint16_t i = 0; i <= x; i++) {
+                    machine.registers[i] = memory_at<Q>(machine, machine.i_register+i);
+                }
+                if constexpr (Q::load_store_increments_i) {
+                    machine.i_register += x + 1;
+                }
+                break;
+            }
 
-            } else {
-                std::cout << "NOOP? " << unsigned(instruction) << "\n";
+            default: {
+                // Not an instruction on this platform
+                raise_fault(machine, Fault::invalid_opcode, instruction_address);
+                return curr_cycle;
+            }
+            }
+
+            // Faulting instructions returned above and are not recorded
+            if constexpr (Tracing) {
+                if (trace->in_pc_range(instruction_address)) {
+                    trace->push({ machine.global_cycle_number, instruction_address, instruction,
+                                  machine.i_register, write_address, machine.registers[x], machine.registers[0xF],
+                                  write_count ? memory_at<Q>(machine, write_address) : std::uint8_t { 0 }, write_count });
+                }
             }
         }
+
+        return curr_cycle;
     }
 
-    void load_rom(const uint8_t *data, size_t size)
+    unsigned int fetch_decode_execute(Machine &machine, unsigned int cycles)
+    {
+        // Pick the quirk profile once per call, so the instruction loop itself is specialized
+        return with_quirks(machine.platform, [&](auto quirks) {
+            return execute<decltype(quirks), false, false>(machine, cycles, nullptr, nullptr);
+        });
+    }
+
+    unsigned int fetch_decode_execute(Machine &machine, unsigned int cycles, Profile &profile)
+    {
+        return with_quirks(machine.platform, [&](auto quirks) {
+            return execute<decltype(quirks), true, false>(machine, cycles, &profile, nullptr);
+        });
+    }
+
+    unsigned int fetch_decode_execute(Machine &machine, unsigned int cycles, TraceRecorder &trace)
+    {
+        return with_quirks(machine.platform, [&](auto quirks) {
+            return execute<decltype(quirks), false, true>(machine, cycles, nullptr, &trace);
+        });
+    }
+
+    static void start_frame(Machine &machine)
+    {
+        // The timers count down at 60 Hz, once per frame
+        if (machine.delay_timer > 0) machine.delay_timer--;
+        if (machine.sound_timer > 0) machine.sound_timer--;
+
+        machine.waiting_for_vblank = false;
+    }
+
+    unsigned int run_frame(Machine &machine, unsigned int cycles)
+    {
+        start_frame(machine);
+        return fetch_decode_execute(machine, cycles);
+    }
+
+    unsigned int run_frame(Machine &machine, unsigned int cycles, Profile &profile)
+    {
+        start_frame(machine);
+        return fetch_decode_execute(machine, cycles, profile);
+    }
+
+    unsigned int run_frame(Machine &machine, unsigned int cycles, TraceRecorder &trace)
+    {
+        start_frame(machine);
+        return fetch_decode_execute(machine, cycles, trace);
+    }
+
+    bool load_rom(Machine &machine, const uint8_t *data, size_t size)
     {
         // Copy program into memory, starting at the default start address
         std::uint16_t address = PROGRAM_START_ADDRESS;
-        
-        // TODO Check for size violation
-        std::memcpy(&memory.at(address), data, size);
 
-        program_counter = PROGRAM_START_ADDRESS;
+        // A machine that was never reset has no memory at all
+        size_t memory_size = static_cast<size_t>(get_memory_size(machine));
+        if (memory_size < address || size > memory_size - address) {
+            raise_fault(machine, Fault::rom_too_large, address);
+            return false;
+        }
+
+        write_bytes(machine, address, data, size);
+
+        machine.program_counter = PROGRAM_START_ADDRESS;
+        return true;
+    }
+
+    void unload_rom(Machine &machine)
+    {
+        reset(machine, machine.platform);
+    }
+
+    void reset(Machine &machine, Platform platform)
+    {
+        machine.platform = platform;
+        machine.program_counter = 0;
+        machine.i_register = 0;
+        machine.delay_timer = 0;
+        machine.sound_timer = 0;
+        machine.plane_mask = 0x1;
+        machine.global_cycle_number = 0;
+        machine.waiting_for_vblank = false;
+        machine.random_state = random_state_for_seed(machine.random_seed);
+        machine.keys = 0;
+        machine.pending_key = -1;
+        machine.registers.fill(0);
+        machine.fault = Fault::none;
+        machine.stack.fill(0);
+        machine.stack_pointer = 0;
+        machine.planes = blank_display();
+
+        // Clearing in place keeps a buffer handed out by get_memory_buffer() valid. Otherwise the
+        // machine shares the blank image until it writes to memory.
+        size_t pages = static_cast<size_t>(get_memory_size(platform)) / PAGE_SIZE;
+        if (machine.memory.size() == pages && machine.memory.is_flat()) {
+            for (size_t page = 0; page < pages; page++) {
+                machine.memory.edit(page).fill(0);
+            }
+            write_bytes(machine, FONT_START_ADDRESS, FONTS.data(), FONTS.size());
+        } else {
+            machine.memory = blank_memory(platform);
+        }
+    }
+
+    void seed_random(Machine &machine, std::uint64_t seed)
+    {
+        machine.random_seed = seed;
+        machine.random_state = random_state_for_seed(seed);
+    }
+
+    Machine fork(const Machine &machine)
+    {
+        return machine;
+    }
+
+    bool make_rom_image(Platform platform, const uint8_t *data, size_t size, RomImage &image)
+    {
+        Machine machine;
+        reset(machine, platform);
+        if (!load_rom(machine, data, size)) {
+            return false;
+        }
+
+        image.platform = platform;
+        image.memory = std::move(machine.memory);
+        return true;
     }
 
-    void unload_rom()
+    void load_rom(Machine &machine, const RomImage &image)
     {
-        reset();
+        reset(machine, image.platform);
+        machine.memory = image.memory;
+        machine.program_counter = PROGRAM_START_ADDRESS;
     }
 
-    void reset()
+    MemoryUsage get_memory_usage(const Machine &machine)
     {
-        program_counter = 0;
-        i_register = 0;
-        delay_timer = 0;
-        sound_timer = 0;
-        registers.fill(0);
-        memory.fill(0);
+        MemoryUsage usage;
+        usage.overhead_bytes = sizeof(Machine);
+        machine.memory.add_usage(usage);
+        machine.planes.add_usage(usage);
+        return usage;
     }
 
-    std::array<std::array<uint16_t, SCREEN_WIDTH>, SCREEN_HEIGHT> get_video_buffer() {
-        auto result = std::array<std::array<uint16_t, SCREEN_WIDTH>, SCREEN_HEIGHT> {};
-        
+    void get_video_buffer(const Machine &machine, Framebuffer &output)
+    {
+        // Composite the planes 8 pixels at a time: spread each plane byte into one byte per pixel,
+        // merge the planes into a palette index per pixel and look all 8 indexes up at once.
         for (size_t i = 0; i < SCREEN_HEIGHT; i++) {
-            for (size_t j = 0; j < SCREEN_WIDTH; j++) {
-                if (display.at(i).at(j) == 1)
-                {
-                    result.at(i).at(j) = 0xffff;
+            for (size_t column = 0; column < SCREEN_WIDTH / 8; column++) {
+                unsigned shift = static_cast<unsigned>(SCREEN_WIDTH - 8 * (column + 1));
+                std::uint64_t indexes = 0;
+                for (size_t p = 0; p < MAX_PLANES; p++) {
+                    indexes |= PIXEL_SPREAD[(machine.planes[p][i] >> shift) & 0xFF] << p;
                 }
+
+                std::uint16_t *pixels = &output[i][column * 8];
+#if defined(__SSSE3__)
+                __m128i lookup = _mm_cvtsi64_si128(static_cast<long long>(indexes));
+                __m128i low = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(PALETTE_LOW.data())), lookup);
+                __m128i high = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(PALETTE_HIGH.data())), lookup);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels), _mm_unpacklo_epi8(low, high));
+#else
+                for (size_t j = 0; j < 8; j++) {
+                    pixels[j] = PALETTE[(indexes >> (8 * j)) & 0xF];
+                }
+#endif
             }
         }
+    }
 
-        return result;
-    }
-
-    void startup()
-    {
-        // Load fonts
-        std::array<std::uint8_t, 0x50> fonts {
-            0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-            0x20, 0x60, 0x20, 0x20, 0x70, // 1
-            0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-            0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-            0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-            0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-            0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-            0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-            0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-            0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-            0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-            0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-            0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-            0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-            0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-            0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-        };
-
-        for (std::uint16_t i = 0; (i + 0x50) <= 0x9F; i++)
-        {
-            memory.at(i + 0x50) = fonts.at(i);
+    const char *get_platform_name(Platform platform)
+    {
+        switch (platform) {
+            case Platform::modern: return "modern";
+            case Platform::cosmac_vip: return "cosmac_vip";
+            case Platform::schip: return "schip";
+            case Platform::xochip: return "xochip";
         }
+        return "unknown";
+    }
 
-        // Seed random
-        srand((unsigned) time(NULL));
+    bool parse_platform_name(const char *name, Platform &platform)
+    {
+        for (auto candidate : { Platform::modern, Platform::cosmac_vip, Platform::schip, Platform::xochip }) {
+            if (std::strcmp(name, get_platform_name(candidate)) == 0) {
+                platform = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Fault get_fault(const Machine &machine)
+    {
+        return machine.fault;
     }
 
-    std::array<uint8_t, MEMORY_SIZE_BYTES>::pointer get_memory_buffer() 
+    const char *describe_fault(Fault fault)
     {
-        return memory.data();
+        switch (fault) {
+            case Fault::none: return "no fault";
+            case Fault::stack_overflow: return "stack overflow";
+            case Fault::stack_underflow: return "stack underflow";
+            case Fault::rom_too_large: return "ROM does not fit in memory";
+            case Fault::pc_out_of_range: return "program counter out of range";
+            case Fault::invalid_opcode: return "invalid opcode";
+        }
+        return "unknown fault";
+    }
+
+    uint8_t* get_memory_buffer(Machine &machine) 
+    {
+        MemoryPage *pages = machine.memory.flatten();
+        return pages ? pages->data() : nullptr;
+    }
+
+    int get_memory_size(const Machine &machine) {
+        return static_cast<int>(machine.memory.size() * PAGE_SIZE);
     }
 
-    int get_memory_size() {
-        return MEMORY_SIZE_BYTES;
+    int get_memory_size(Platform platform) {
+        return with_quirks(platform, [](auto quirks) {
+            return static_cast<int>(decltype(quirks)::memory_size);
+        });
     }
-}
\ No newline at end of file
+}
@@ -1,38 +1,188 @@
+#pragma once
+
 #include <cstdint>
 #include <cstddef>
+#include <span>
 #include <string>
 #include <array>
+#include <vector>
+#include "pages.h"
 
 namespace chip8 {
     inline constexpr int SCREEN_HEIGHT = 32;
     inline constexpr int SCREEN_WIDTH = 64;
 
+    // XO-CHIP can draw to up to four bitplanes, classic CHIP-8 only ever touches the first one
+    inline constexpr int MAX_PLANES = 4;
+
+    // Each platform selects a quirk profile, see quirks.h
+    enum class Platform : std::uint8_t {
+        modern,     // The common behaviour of modern interpreters, 4 KB of memory
+        cosmac_vip, // The original COSMAC VIP interpreter, 4 KB of memory
+        schip,      // SUPER-CHIP 1.1, 4 KB of memory
+        xochip,     // XO-CHIP, 64 KB of memory and up to four bitplanes
+    };
+
+    // Storage for the subroutine stack. Each quirk profile sets how many levels it may actually use.
+    inline constexpr int MAX_STACK_DEPTH = 16;
+
+    // Conditions that halt the machine until it is reset. The PC is left on the faulting instruction.
+    enum class Fault : std::uint8_t {
+        none,
+        stack_overflow,  // 2nnn with every stack level in use
+        stack_underflow, // 00EE with an empty stack
+        rom_too_large,   // load_rom was given more bytes than fit after 0x200
+        pc_out_of_range, // A jump or return left the PC outside of memory
+        invalid_opcode,  // An instruction the platform does not have
+    };
+
+    // A display row packed one bit per pixel, with the leftmost pixel in the most significant bit
+    using PlaneRow = std::uint64_t;
+    using Plane = std::array<PlaneRow, SCREEN_HEIGHT>;
+
+    using MemoryPage = std::array<std::uint8_t, PAGE_SIZE>;
+
+    using Framebuffer = std::array<std::array<std::uint16_t, SCREEN_WIDTH>, SCREEN_HEIGHT>;
+
+    struct Machine {
+        Platform platform = Platform::modern;
+
+        std::uint16_t program_counter = 0;
+        std::uint16_t i_register = 0;
+        std::uint8_t delay_timer = 0;
+        std::uint8_t sound_timer = 0;
+        std::uint8_t plane_mask = 0x1; // Planes selected by Fn01, one bit per plane
+        std::uint32_t global_cycle_number = 0;
+        bool waiting_for_vblank = false; // Set by DRW on platforms with the display wait quirk
+
+        std::uint64_t random_seed = 0;  // Restores random_state on reset, see seed_random()
+        std::uint32_t random_state = 1; // Cxkk generator, never zero
+
+        std::uint16_t keys = 0;         // Keypad state, bit n is set while key n is held
+        std::int8_t pending_key = -1;   // Key pressed during Fx0A, stored once it is released
+
+        Fault fault = Fault::none;
+
+        std::array<std::uint8_t, 16> registers {};
+        std::array<std::uint16_t, MAX_STACK_DEPTH> stack {};
+        std::uint8_t stack_pointer = 0; // Number of return addresses on the stack
+
+        // Display and memory are copy-on-write, so copying a machine is cheap, see fork()
+        SharedPages<Plane> planes { MAX_PLANES };
+
+        // Sized by the platform, so classic ROMs keep their 4 KB footprint
+        SharedPages<MemoryPage> memory;
+    };
+
+    // Memory access by address for code outside the interpreter. The address must be below get_memory_size().
+    inline std::uint8_t read_memory(const Machine &machine, std::size_t address)
+    {
+        return machine.memory[address / PAGE_SIZE][address % PAGE_SIZE];
+    }
+
+    inline void write_memory(Machine &machine, std::size_t address, std::uint8_t value)
+    {
+        machine.memory.edit(address / PAGE_SIZE)[address % PAGE_SIZE] = value;
+    }
+
+    // Short platform names as used by romdb.inc and the command line tools, e.g. "cosmac_vip"
+    const char *get_platform_name(Platform platform);
+
+    bool parse_platform_name(const char *name, Platform &platform);
+
     const char *get_lib_name();
     const char *get_lib_version();
 
     bool check_instruction(std::uint16_t inst, std::uint16_t target, std::uint16_t mask);
-    
-    void decompile();
 
-    void dump_memory();
+    void dump_memory(const Machine &machine);
+
+    void dump_display(const Machine &machine);
+
+    void display_registers(const Machine &machine);
+
+    // Execute up to cycles instructions, stopping early while waiting for vblank. Returns the number executed.
+    unsigned int fetch_decode_execute(Machine &machine, unsigned int cycles);
+
+    // Run one 60 Hz frame: tick the timers, end any vblank wait and execute up to cycles instructions
+    unsigned int run_frame(Machine &machine, unsigned int cycles);
+
+    // Returns false, and sets Fault::rom_too_large, when the ROM does not fit in memory or the machine was never reset
+    bool load_rom(Machine &machine, const uint8_t *data, size_t size);
+
+    // The same for a ROM wherever it lives, e.g. in a mapped file or ROM pack (rompack.h). The bytes go
+    // straight into the machine's memory, so callers need no buffer of their own.
+    inline bool load_rom(Machine &machine, std::span<const std::uint8_t> rom)
+    {
+        return load_rom(machine, rom.data(), rom.size());
+    }
+
+    void unload_rom(Machine &machine);
+
+    /*
+        Memory as reset() and load_rom() leave it, built once so many machines can start the same ROM.
+        Machines loaded from an image share its pages, the ROM and fonts included, and only copy a
+        page on their first write to it. The image may be destroyed while machines still use it.
+    */
+    struct RomImage {
+        Platform platform = Platform::modern;
+        SharedPages<MemoryPage> memory;
+    };
+
+    // Returns false when the ROM does not fit in memory
+    bool make_rom_image(Platform platform, const uint8_t *data, size_t size, RomImage &image);
+
+    // Reset the machine to the image's platform and load its ROM
+    void load_rom(Machine &machine, const RomImage &image);
+
+    void reset(Machine &machine, Platform platform);
+
+    // Restart the Cxkk random sequence from seed, now and after every reset. Machines start with seed 0.
+    void seed_random(Machine &machine, std::uint64_t seed);
+
+    // An independent copy of a machine that shares memory and display pages with it until either side
+    // writes to them, e.g. for tree search. Copying a Machine does the same.
+    Machine fork(const Machine &machine);
+
+    /*
+        Heap and struct bytes behind one machine. Pages shared with other machines or ROM images count
+        in full under shared_bytes; proportional_bytes splits them between their users, so it can be
+        summed over machines for capacity planning without counting shared pages twice.
+    */
+    MemoryUsage get_memory_usage(const Machine &machine);
+
+    void get_video_buffer(const Machine &machine, Framebuffer &output);
 
-    void dump_display();
+    Fault get_fault(const Machine &machine);
 
-    void display_registers();
+    const char *describe_fault(Fault fault);
 
-    void fetch_decode_execute(unsigned int cycles);
+    // Memory as one flat buffer, e.g. for frontends that poke at RAM. Gathering it copies any pages the
+    // machine shares; the buffer stays valid across reset() and load_state(), but not across forks. Writes
+    // through it are not tracked, so call machine.memory.mark_all_dirty() before update_state_hash().
+    uint8_t* get_memory_buffer(Machine &machine);
 
-    void load_rom(const uint8_t *data, size_t size);
+    int get_memory_size(const Machine &machine);
 
-    void unload_rom();
+    int get_memory_size(Platform platform);
 
-    void reset();
+    // Save states. The size only depends on the platform, so it stays fixed while a game is loaded.
+    size_t get_state_size(const Machine &machine);
 
-    std::array<std::array<uint16_t, SCREEN_WIDTH>, SCREEN_HEIGHT> get_video_buffer();
+    bool save_state(const Machine &machine, uint8_t *data, size_t size);
 
-    uint8_t* get_memory_buffer();
+    bool load_state(Machine &machine, const uint8_t *data, size_t size);
 
-    int get_memory_size();
+    // Cached page hashes for update_state_hash(). Use one per machine.
+    struct StateHash {
+        std::vector<std::uint64_t> page_hashes;     // Memory pages, then display planes
+        std::uint64_t pages = 0;                    // Sum of page_hashes
+    };
 
-    void startup();
-}
\ No newline at end of file
+    /*
+        A hash of everything save_state() writes, e.g. to compare netplay peers every frame. Only pages
+        written since the previous call are hashed again, so an idle frame costs about as much as
+        hashing the registers. Equal machine states give equal hashes on every host.
+    */
+    std::uint64_t update_state_hash(Machine &machine, StateHash &state);
+}
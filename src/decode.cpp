@@ -0,0 +1,29 @@
+#include "decode.h"
+
+namespace chip8 {
+    namespace {
+        DecodeTable build_decode_table(bool xochip)
+        {
+            DecodeTable table {};
+
+            // Fill in the forms last to first, so earlier forms overwrite the ones they take precedence over.
+            // Each form only visits its own instructions, by counting down through the bits its mask leaves free.
+            for (std::size_t form = INSTRUCTION_FORMS.size(); form-- > 0; ) {
+                const InstructionForm &f = INSTRUCTION_FORMS[form];
+                if (f.xochip && !xochip) {
+                    continue;
+                }
+
+                const std::uint16_t free_bits = static_cast<std::uint16_t>(~f.mask);
+                for (std::uint16_t bits = free_bits; ; bits = static_cast<std::uint16_t>((bits - 1) & free_bits)) {
+                    table[f.match | bits] = static_cast<std::uint8_t>(form);
+                    if (bits == 0) break;
+                }
+            }
+
+            return table;
+        }
+    }
+
+    const std::array<DecodeTable, 2> DECODE_TABLES { build_decode_table(false), build_decode_table(true) };
+}
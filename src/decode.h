@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Instruction decoding shared by the interpreter and the disassembler
+namespace chip8 {
+    enum class Opcode : std::uint8_t {
+        cls, ret, sys, jp, call,
+        se_byte, sne_byte, se_reg, store_range, load_range,
+        ld_byte, add_byte,
+        ld_reg, or_reg, and_reg, xor_reg, add_reg, sub_reg, shr, subn, shl,
+        sne_reg, ld_i, jp_offset, rnd, drw, skp, sknp,
+        ld_i_long, plane, audio, ld_vx_dt, ld_key, ld_dt, ld_st, add_i, ld_font, bcd, pitch, store, load,
+        invalid,
+    };
+
+    inline constexpr std::size_t OPCODE_COUNT = static_cast<std::size_t>(Opcode::invalid) + 1;
+
+    /*
+        One instruction form. An instruction matches when (instruction & mask) == match; the first
+        matching form wins. Operands in the text are filled in by the disassembler:
+            {x} {y}   register numbers, as one hex digit
+            {n}       the low nibble
+            {kk}      the low byte
+            {nnn}     the low 12 bits
+            {long}    the 16-bit word after the instruction
+    */
+    struct InstructionForm {
+        std::uint16_t match;
+        std::uint16_t mask;
+        Opcode opcode;
+        bool xochip;            // Only decoded on XO-CHIP
+        const char *text;
+    };
+
+    inline constexpr std::array<InstructionForm, 42> INSTRUCTION_FORMS { {
+        { 0x00E0, 0xFFFF, Opcode::cls, false, "CLS" },
+        { 0x00EE, 0xFFFF, Opcode::ret, false, "RET" },
+        { 0x0000, 0xF000, Opcode::sys, false, "SYS {nnn}" },
+        { 0x1000, 0xF000, Opcode::jp, false, "JP {nnn}" },
+        { 0x2000, 0xF000, Opcode::call, false, "CALL {nnn}" },
+        { 0x3000, 0xF000, Opcode::se_byte, false, "SE V{x}, {kk}" },
+        { 0x4000, 0xF000, Opcode::sne_byte, false, "SNE V{x}, {kk}" },
+        { 0x5000, 0xF00F, Opcode::se_reg, false, "SE V{x}, V{y}" },
+        { 0x5002, 0xF00F, Opcode::store_range, true, "LD [I], V{x}-V{y}" },
+        { 0x5003, 0xF00F, Opcode::load_range, true, "LD V{x}-V{y}, [I]" },
+        { 0x6000, 0xF000, Opcode::ld_byte, false, "LD V{x}, {kk}" },
+        { 0x7000, 0xF000, Opcode::add_byte, false, "ADD V{x}, {kk}" },
+        { 0x8000, 0xF00F, Opcode::ld_reg, false, "LD V{x}, V{y}" },
+        { 0x8001, 0xF00F, Opcode::or_reg, false, "OR V{x}, V{y}" },
+        { 0x8002, 0xF00F, Opcode::and_reg, false, "AND V{x}, V{y}" },
+        { 0x8003, 0xF00F, Opcode::xor_reg, false, "XOR V{x}, V{y}" },
+        { 0x8004, 0xF00F, Opcode::add_reg, false, "ADD V{x}, V{y}" },
+        { 0x8005, 0xF00F, Opcode::sub_reg, false, "SUB V{x}, V{y}" },
+        { 0x8006, 0xF00F, Opcode::shr, false, "SHR V{x}, V{y}" },
+        { 0x8007, 0xF00F, Opcode::subn, false, "SUBN V{x}, V{y}" },
+        { 0x800E, 0xF00F, Opcode::shl, false, "SHL V{x}, V{y}" },
+        { 0x9000, 0xF00F, Opcode::sne_reg, false, "SNE V{x}, V{y}" },
+        { 0xA000, 0xF000, Opcode::ld_i, false, "LD I, {nnn}" },
+        { 0xB000, 0xF000, Opcode::jp_offset, false, "JP V0, {nnn}" },
+        { 0xC000, 0xF000, Opcode::rnd, false, "RND V{x}, {kk}" },
+        { 0xD000, 0xF000, Opcode::drw, false, "DRW V{x}, V{y}, {n}" },
+        { 0xE09E, 0xF0FF, Opcode::skp, false, "SKP V{x}" },
+        { 0xE0A1, 0xF0FF, Opcode::sknp, false, "SKNP V{x}" },
+        { 0xF000, 0xFFFF, Opcode::ld_i_long, true, "LD I, {long}" },
+        { 0xF001, 0xF0FF, Opcode::plane, true, "PLANE {x}" },
+        { 0xF002, 0xFFFF, Opcode::audio, true, "AUDIO" },
+        { 0xF007, 0xF0FF, Opcode::ld_vx_dt, false, "LD V{x}, DT" },
+        { 0xF00A, 0xF0FF, Opcode::ld_key, false, "LD V{x}, K" },
+        { 0xF015, 0xF0FF, Opcode::ld_dt, false, "LD DT, V{x}" },
+        { 0xF018, 0xF0FF, Opcode::ld_st, false, "LD ST, V{x}" },
+        { 0xF01E, 0xF0FF, Opcode::add_i, false, "ADD I, V{x}" },
+        { 0xF029, 0xF0FF, Opcode::ld_font, false, "LD F, V{x}" },
+        { 0xF033, 0xF0FF, Opcode::bcd, false, "LD B, V{x}" },
+        { 0xF03A, 0xF0FF, Opcode::pitch, true, "PITCH V{x}" },
+        { 0xF055, 0xF0FF, Opcode::store, false, "LD [I], V{x}" },
+        { 0xF065, 0xF0FF, Opcode::load, false, "LD V{x}, [I]" },
+        { 0x0000, 0x0000, Opcode::invalid, false, "DW {word}" },   // Matches anything left over
+    } };
+
+    // SUPER-CHIP's Bxnn jumps to xnn + Vx rather than nnn + V0. It decodes to the same opcode, so the table
+    // keeps the classic form and the disassembler swaps in this one on platforms with jump_uses_vx.
+    inline constexpr InstructionForm JP_OFFSET_VX_FORM { 0xB000, 0xF000, Opcode::jp_offset, false, "JP V{x}, {nnn}" };
+
+    // Index into INSTRUCTION_FORMS for every 16-bit instruction: classic platforms first, then XO-CHIP.
+    // Filled in during static initialization, see decode.cpp.
+    using DecodeTable = std::array<std::uint8_t, 0x10000>;
+    extern const std::array<DecodeTable, 2> DECODE_TABLES;
+
+    template <bool Xochip>
+    inline const InstructionForm &decode_form(std::uint16_t instruction)
+    {
+        return INSTRUCTION_FORMS[DECODE_TABLES[Xochip][instruction]];
+    }
+
+    template <bool Xochip>
+    inline Opcode decode(std::uint16_t instruction)
+    {
+        return decode_form<Xochip>(instruction).opcode;
+    }
+
+    // Bytes taken by an instruction: XO-CHIP's F000 nnnn carries its address in the next word
+    inline unsigned int instruction_size(Opcode opcode)
+    {
+        return opcode == Opcode::ld_i_long ? 4 : 2;
+    }
+}
@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <array>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <vector>
+#include "difftest.h"
+#include "disassembler.h"
+#include "lanes.h"
+#include "ops.h"
+#include "profile.h"
+#include "reference.h"
+#include "trace.h"
+
+namespace chip8 {
+    namespace {
+        [[gnu::format(printf, 2, 3)]] void append(std::string &text, const char *format, ...)
+        {
+            char buffer[256];
+            va_list args;
+            va_start(args, format);
+            int length = std::vsnprintf(buffer, sizeof(buffer), format, args);
+            va_end(args);
+            text.append(buffer, static_cast<std::size_t>(std::clamp(length, 0, static_cast<int>(sizeof(buffer)) - 1)));
+        }
+
+        constexpr std::array<const char *, 16> REGISTER_NAMES {
+            "V0", "V1", "V2", "V3", "V4", "V5", "V6", "V7", "V8", "V9", "VA", "VB", "VC", "VD", "VE", "VF",
+        };
+
+        constexpr std::array<const char *, BACKEND_COUNT> BACKEND_NAMES { "interpreter", "profiling", "tracing", "lanes" };
+
+        // Keys held during a frame: now and then a single key, so Ex9E, ExA1 and Fx0A all see presses and releases
+        std::uint16_t get_frame_keys(std::uint64_t key_seed, std::uint32_t frame, std::size_t lane)
+        {
+            if (key_seed == 0) {
+                return 0;
+            }
+            std::uint32_t random = random_state_for_seed(key_seed + (static_cast<std::uint64_t>(frame) << 16) + lane);
+            return (random >> 4) % 4 == 0 ? static_cast<std::uint16_t>(1u << (random & 0xF)) : 0;
+        }
+
+        // The instruction at the PC, captured before it runs and only disassembled for a report
+        struct InstructionBytes {
+            std::uint16_t address = 0;
+            bool in_memory = false;
+            std::array<std::uint8_t, 4> code {};
+            Platform platform = Platform::modern;
+        };
+
+        InstructionBytes get_instruction(const Machine &machine)
+        {
+            InstructionBytes instruction;
+            std::size_t size = static_cast<std::size_t>(get_memory_size(machine));
+            instruction.address = machine.program_counter;
+            instruction.in_memory = machine.program_counter < size;
+            instruction.platform = machine.platform;
+            if (instruction.in_memory) {
+                for (std::size_t i = 0; i < instruction.code.size(); i++) {
+                    instruction.code[i] = read_memory(machine, (machine.program_counter + i) % size);
+                }
+            }
+            return instruction;
+        }
+
+        // As the disassembler shows it, without the newline
+        std::string describe_instruction(const InstructionBytes &instruction)
+        {
+            if (!instruction.in_memory) {
+                char line[32];
+                std::snprintf(line, sizeof(line), "0x%04x  (outside memory)", instruction.address);
+                return line;
+            }
+
+            char line[MAX_DISASSEMBLY_LINE];
+            std::size_t offset = 0;
+            std::size_t length = disassemble(instruction.code, offset, instruction.address, instruction.platform, line);
+            return std::string(line, length > 0 ? length - 1 : 0);
+        }
+
+        // First differing byte of two equally long buffers and how many differ in all
+        template <typename T>
+        std::size_t count_differences(const T *a, const T *b, std::size_t count, std::size_t &first)
+        {
+            std::size_t differences = 0;
+            for (std::size_t i = 0; i < count; i++) {
+                if (a[i] != b[i]) {
+                    if (differences++ == 0) first = i;
+                }
+            }
+            return differences;
+        }
+
+        void report_divergence(DiffResult &result, std::uint32_t frame, const std::string &where, const std::string &differences)
+        {
+            result.status = DiffStatus::diverged;
+            append(result.report, "diverged in frame %u %s\n", frame, where.c_str());
+            result.report += differences;
+        }
+
+        // See compare_machines()
+        std::string compare_state(const Machine &reference, const Machine &other, const char *other_name)
+        {
+            std::string text;
+            auto field = [&](const char *field_name, unsigned int expected, unsigned int actual, int digits) {
+                if (expected != actual) {
+                    append(text, "  %s: reference 0x%0*x, %s 0x%0*x\n", field_name, digits, expected, other_name, digits, actual);
+                }
+            };
+
+            if (reference.platform != other.platform) {
+                append(text, "  platform: reference %s, %s %s\n", get_platform_name(reference.platform), other_name,
+                       get_platform_name(other.platform));
+                return text;
+            }
+            if (reference.fault != other.fault) {
+                append(text, "  fault: reference \"%s\", %s \"%s\"\n", describe_fault(reference.fault), other_name,
+                       describe_fault(other.fault));
+            }
+
+            field("PC", reference.program_counter, other.program_counter, 4);
+            field("I", reference.i_register, other.i_register, 4);
+            for (int reg = 0; reg < 16; reg++) {
+                field(REGISTER_NAMES[reg], reference.registers[reg], other.registers[reg], 2);
+            }
+            field("DT", reference.delay_timer, other.delay_timer, 2);
+            field("ST", reference.sound_timer, other.sound_timer, 2);
+            field("plane mask", reference.plane_mask, other.plane_mask, 1);
+            field("cycle", reference.global_cycle_number, other.global_cycle_number, 8);
+            field("waiting for vblank", reference.waiting_for_vblank, other.waiting_for_vblank, 1);
+            field("random state", reference.random_state, other.random_state, 8);
+            field("keys", reference.keys, other.keys, 4);
+            field("pending key", static_cast<std::uint8_t>(reference.pending_key), static_cast<std::uint8_t>(other.pending_key), 2);
+
+            field("SP", reference.stack_pointer, other.stack_pointer, 2);
+            for (int level = 0; level < std::min(reference.stack_pointer, other.stack_pointer); level++) {
+                if (reference.stack[level] != other.stack[level]) {
+                    char name[24];
+                    std::snprintf(name, sizeof(name), "stack[%d]", level);
+                    field(name, reference.stack[level], other.stack[level], 4);
+                }
+            }
+
+            for (std::size_t plane = 0; plane < MAX_PLANES; plane++) {
+                std::size_t row = 0;
+                std::size_t rows = count_differences(reference.planes[plane].data(), other.planes[plane].data(), SCREEN_HEIGHT, row);
+                if (rows > 0) {
+                    append(text, "  display plane %zu row %zu: reference %016llx, %s %016llx (%zu rows differ)\n", plane, row,
+                           static_cast<unsigned long long>(reference.planes[plane][row]), other_name,
+                           static_cast<unsigned long long>(other.planes[plane][row]), rows);
+                }
+            }
+
+            if (reference.memory.size() != other.memory.size()) {
+                append(text, "  memory size: reference %zu, %s %zu\n", reference.memory.size() * PAGE_SIZE, other_name,
+                       other.memory.size() * PAGE_SIZE);
+                return text;
+            }
+            std::size_t first_address = 0, bytes = 0;
+            for (std::size_t page = 0; page < reference.memory.size(); page++) {
+                // Pages still shared with the ROM image are equal without looking
+                if (&reference.memory[page] == &other.memory[page]) {
+                    continue;
+                }
+                std::size_t first = 0;
+                std::size_t differing = count_differences(reference.memory[page].data(), other.memory[page].data(), PAGE_SIZE, first);
+                if (differing > 0 && bytes == 0) {
+                    first_address = page * PAGE_SIZE + first;
+                }
+                bytes += differing;
+            }
+            if (bytes > 0) {
+                append(text, "  memory[0x%04zx]: reference 0x%02x, %s 0x%02x (%zu bytes differ)\n", first_address,
+                       read_memory(reference, first_address), other_name, read_memory(other, first_address), bytes);
+            }
+
+            return text;
+        }
+
+        // Backends the interpreter provides, stepped one instruction at a time
+        DiffResult run_stepped(Backend backend, std::span<const std::uint8_t> rom, const DiffOptions &options)
+        {
+            DiffResult result;
+            const char *name = get_backend_name(backend);
+
+            Machine reference, machine;
+            for (Machine *m : { &reference, &machine }) {
+                seed_random(*m, options.seed);
+                reset(*m, options.platform);
+                if (!load_rom(*m, rom.data(), rom.size())) {
+                    result.status = DiffStatus::unsupported;
+                    result.report = "ROM does not fit in memory\n";
+                    return result;
+                }
+            }
+
+            Profile profile;
+            TraceRecorder trace(1 << 10);
+            auto start_frame = [&] {
+                switch (backend) {
+                    case Backend::profiling: run_frame(machine, 0, profile); break;
+                    case Backend::tracing: run_frame(machine, 0, trace); break;
+                    default: run_frame(machine, 0); break;
+                }
+            };
+            auto step = [&] {
+                switch (backend) {
+                    case Backend::profiling: return fetch_decode_execute(machine, 1, profile);
+                    case Backend::tracing: return fetch_decode_execute(machine, 1, trace);
+                    default: return fetch_decode_execute(machine, 1);
+                }
+            };
+
+            // Memory is compared in full after every step rather than by dirty pages, so a backend that
+            // forgets to mark a page is still caught, and the machine's dirty bits stay as it left them
+            auto compare = [&] { return compare_state(reference, machine, name); };
+
+            for (; result.frames < options.frames; ) {
+                std::uint32_t frame = result.frames++;
+                reference.keys = machine.keys = get_frame_keys(options.key_seed, frame, 0);
+                reference_start_frame(reference);
+                start_frame();
+
+                std::string differences = compare();
+                if (!differences.empty()) {
+                    report_divergence(result, frame, "at the start of the frame", differences);
+                    return result;
+                }
+
+                for (unsigned int cycle = 0; cycle < options.cycles_per_frame; cycle++) {
+                    InstructionBytes instruction = get_instruction(reference);
+                    unsigned int expected = reference_step(reference);
+                    unsigned int executed = step();
+                    result.steps += expected;
+
+                    differences = compare();
+                    if (expected != executed) {
+                        append(differences, "  executed: reference %u, %s %u\n", expected, name, executed);
+                    }
+                    if (!differences.empty()) {
+                        std::string where = "after " + describe_instruction(instruction);
+                        append(where, " (cycle %u)", reference.global_cycle_number);
+                        report_divergence(result, frame, where, differences);
+                        return result;
+                    }
+
+                    if (expected == 0) {
+                        // Faulted or waiting for vblank, and both agree
+                        break;
+                    }
+                }
+            }
+
+            return result;
+        }
+
+        // The lane engine only runs whole frames, so lanes are compared once a frame
+        DiffResult run_lanes(std::span<const std::uint8_t> rom, const DiffOptions &options)
+        {
+            DiffResult result;
+
+            Lanes lanes;
+            if (!reset_lanes(lanes, options.platform, options.lane_count, rom.data(), rom.size(), options.seed)) {
+                result.status = DiffStatus::unsupported;
+                result.report = options.platform == Platform::xochip ? "the lane engine does not run XO-CHIP\n"
+                                                                     : "ROM does not fit in memory\n";
+                return result;
+            }
+
+            std::vector<Machine> references(options.lane_count);
+            for (std::size_t lane = 0; lane < references.size(); lane++) {
+                seed_random(references[lane], options.seed + lane);
+                reset(references[lane], options.platform);
+                load_rom(references[lane], rom.data(), rom.size());
+            }
+
+            Machine extracted;
+            for (; result.frames < options.frames; ) {
+                std::uint32_t frame = result.frames++;
+                for (std::size_t lane = 0; lane < references.size(); lane++) {
+                    std::uint16_t keys = get_frame_keys(options.key_seed, frame, lane);
+                    set_lane_keys(lanes, lane, keys);
+                    references[lane].keys = keys;
+                }
+
+                run_lanes_frame(lanes, options.cycles_per_frame);
+
+                for (std::size_t lane = 0; lane < references.size(); lane++) {
+                    Machine &reference = references[lane];
+                    std::uint32_t first_cycle = reference.global_cycle_number + 1;
+                    std::optional<InstructionBytes> last_instruction;
+
+                    reference_start_frame(reference);
+                    for (unsigned int cycle = 0; cycle < options.cycles_per_frame; cycle++) {
+                        last_instruction = get_instruction(reference);
+                        if (reference_step(reference) == 0) break;
+                        result.steps++;
+                    }
+
+                    extract_lane(lanes, lane, extracted);
+                    std::string differences = compare_machines(reference, extracted, "lanes");
+                    if (!differences.empty()) {
+                        std::string where;
+                        append(where, "on lane %zu, within cycles %u-%u", lane, first_cycle, reference.global_cycle_number);
+                        if (last_instruction) {
+                            where += ", the last of them " + describe_instruction(*last_instruction);
+                        }
+                        report_divergence(result, frame, where, differences);
+                        return result;
+                    }
+                }
+            }
+
+            return result;
+        }
+    }
+
+    const char *get_backend_name(Backend backend)
+    {
+        return BACKEND_NAMES[static_cast<std::size_t>(backend)];
+    }
+
+    bool parse_backend_name(const char *name, Backend &backend)
+    {
+        for (std::size_t i = 0; i < BACKEND_NAMES.size(); i++) {
+            if (std::strcmp(name, BACKEND_NAMES[i]) == 0) {
+                backend = static_cast<Backend>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    DiffResult run_differential(Backend backend, std::span<const std::uint8_t> rom, const DiffOptions &options)
+    {
+        return backend == Backend::lanes ? run_lanes(rom, options) : run_stepped(backend, rom, options);
+    }
+
+    std::string compare_machines(const Machine &reference, const Machine &other, const char *other_name)
+    {
+        return compare_state(reference, other, other_name);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include "chip8.h"
+
+namespace chip8 {
+    /*
+        Differential testing: run an execution backend in lockstep with the reference interpreter
+        (reference.h) and compare the whole machine state as they go, stopping at the first
+        difference. Backends that can be stepped one instruction at a time are compared after
+        every instruction; the lane engine only runs whole frames, so it is compared after every
+        frame, each lane against its own reference machine.
+    */
+    enum class Backend : std::uint8_t {
+        interpreter,    // fetch_decode_execute()
+        profiling,      // fetch_decode_execute() with a Profile
+        tracing,        // fetch_decode_execute() with a TraceRecorder that has no file open
+        lanes,          // run_lanes_frame(), 4 KB platforms only
+    };
+
+    inline constexpr std::size_t BACKEND_COUNT = 4;
+
+    const char *get_backend_name(Backend backend);
+
+    bool parse_backend_name(const char *name, Backend &backend);
+
+    struct DiffOptions {
+        Platform platform = Platform::modern;
+        unsigned int cycles_per_frame = 700 / 60;
+        std::uint32_t frames = 600;
+        std::uint64_t seed = 0;         // Random seed of the machines; lane n uses seed + n
+        std::uint64_t key_seed = 0;     // Pseudo-random keys held each frame, 0 for none
+        std::size_t lane_count = 8;     // Lanes run by the lane engine
+    };
+
+    enum class DiffStatus : std::uint8_t {
+        match,          // Every compared state was equal
+        diverged,       // See DiffResult::report
+        unsupported,    // The backend cannot run this platform, or the ROM does not load
+    };
+
+    struct DiffResult {
+        DiffStatus status = DiffStatus::match;
+        std::uint32_t frames = 0;       // Frames run, including the one that diverged
+        std::uint64_t steps = 0;        // Instructions the reference executed
+        std::string report;             // Where the runs split and every field that differs
+    };
+
+    DiffResult run_differential(Backend backend, std::span<const std::uint8_t> rom, const DiffOptions &options);
+
+    // One line per differing field, e.g. "  V3: reference 0x12, interpreter 0x13". Empty if the states are equal.
+    // Only the live part of the stack is compared.
+    std::string compare_machines(const Machine &reference, const Machine &other, const char *other_name);
+}
@@ -0,0 +1,149 @@
+/*
+    Differential tester: runs each ROM on the execution backends in lockstep with the reference
+    interpreter and reports the first place where any of them disagrees. Meant for sweeping a
+    whole ROM set after changing the interpreter or the lane engine; the exit status is 1 if any
+    backend diverged.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "../chip8.h"
+#include "../difftest.h"
+#include "../romdb.h"
+
+static void usage(const char *program)
+{
+    std::fprintf(stderr,
+        "usage: %s [options] rom...\n"
+        "  --platform NAME      modern, cosmac_vip, schip or xochip (default: ROM database, then modern)\n"
+        "  --backend NAME       interpreter, profiling, tracing, lanes or all (default: all)\n"
+        "  --frames N           frames to run (default: 600)\n"
+        "  --cycles N           instructions per frame (default: ROM database, then %u)\n"
+        "  --seed N             seed for the machines' random numbers (default: 0)\n"
+        "  --keys N             hold pseudo-random keys drawn from seed N, 0 for none (default: 1)\n"
+        "  --lanes N            lanes to run on the lane engine (default: 8)\n",
+        program, chip8::DiffOptions {}.cycles_per_frame);
+}
+
+static bool read_file(const char *path, std::vector<std::uint8_t> &data)
+{
+    std::FILE *input = std::fopen(path, "rb");
+    if (!input) {
+        return false;
+    }
+
+    data.clear();
+    std::uint8_t chunk[4096];
+    while (std::size_t count = std::fread(chunk, 1, sizeof(chunk), input)) {
+        data.insert(data.end(), chunk, chunk + count);
+    }
+
+    bool ok = !std::ferror(input);
+    std::fclose(input);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    bool platform_given = false, cycles_given = false, all_backends = true;
+    chip8::Backend only_backend = chip8::Backend::interpreter;
+    chip8::DiffOptions options;
+    options.key_seed = 1;
+    std::vector<const char *> rom_paths;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (arg[0] != '-' || arg[1] == '\0') {
+            rom_paths.push_back(arg);
+            continue;
+        }
+
+        if (!value) {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+
+        char *end = nullptr;
+        unsigned long long number = std::strtoull(value, &end, 0);
+        bool is_number = *value != '\0' && *end == '\0';
+
+        if (std::strcmp(arg, "--platform") == 0) {
+            if (!chip8::parse_platform_name(value, options.platform)) {
+                std::fprintf(stderr, "unknown platform '%s'\n", value);
+                return 2;
+            }
+            platform_given = true;
+        } else if (std::strcmp(arg, "--backend") == 0) {
+            all_backends = std::strcmp(value, "all") == 0;
+            if (!all_backends && !chip8::parse_backend_name(value, only_backend)) {
+                std::fprintf(stderr, "unknown backend '%s'\n", value);
+                return 2;
+            }
+        } else if (!is_number) {
+            std::fprintf(stderr, "%s expects a number\n", arg);
+            return 2;
+        } else if (std::strcmp(arg, "--frames") == 0) {
+            options.frames = static_cast<std::uint32_t>(number);
+        } else if (std::strcmp(arg, "--cycles") == 0) {
+            options.cycles_per_frame = static_cast<unsigned int>(number);
+            cycles_given = true;
+        } else if (std::strcmp(arg, "--seed") == 0) {
+            options.seed = number;
+        } else if (std::strcmp(arg, "--keys") == 0) {
+            options.key_seed = number;
+        } else if (std::strcmp(arg, "--lanes") == 0 && number > 0) {
+            options.lane_count = static_cast<std::size_t>(number);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (rom_paths.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int diverged = 0;
+    std::vector<std::uint8_t> rom;
+    for (const char *path : rom_paths) {
+        if (!read_file(path, rom)) {
+            std::fprintf(stderr, "cannot read %s\n", path);
+            return 1;
+        }
+
+        chip8::DiffOptions rom_options = options;
+        const chip8::RomInfo *info = chip8::identify_rom(rom.data(), rom.size());
+        if (info && !platform_given) rom_options.platform = info->platform;
+        if (info && !cycles_given) rom_options.cycles_per_frame = info->cycles_per_frame;
+
+        for (std::size_t i = 0; i < chip8::BACKEND_COUNT; i++) {
+            chip8::Backend backend = static_cast<chip8::Backend>(i);
+            if (!all_backends && backend != only_backend) {
+                continue;
+            }
+
+            chip8::DiffResult result = chip8::run_differential(backend, rom, rom_options);
+            const char *name = chip8::get_backend_name(backend);
+            switch (result.status) {
+                case chip8::DiffStatus::match:
+                    std::printf("ok    %s %s %s: %u frames, %llu instructions\n", path, chip8::get_platform_name(rom_options.platform),
+                                name, result.frames, static_cast<unsigned long long>(result.steps));
+                    break;
+                case chip8::DiffStatus::unsupported:
+                    std::printf("skip  %s %s %s: %s", path, chip8::get_platform_name(rom_options.platform), name, result.report.c_str());
+                    break;
+                case chip8::DiffStatus::diverged:
+                    std::printf("FAIL  %s %s %s: %s", path, chip8::get_platform_name(rom_options.platform), name, result.report.c_str());
+                    diverged++;
+                    break;
+            }
+        }
+    }
+
+    return diverged == 0 ? 0 : 1;
+}
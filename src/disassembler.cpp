@@ -0,0 +1,127 @@
+#include "decode.h"
+#include "disassembler.h"
+#include "quirks.h"
+
+namespace chip8 {
+    namespace {
+        constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+        char *write_text(char *out, std::string_view text)
+        {
+            for (char c : text) {
+                *out++ = c;
+            }
+            return out;
+        }
+
+        // 0x followed by the given number of lowercase hex digits
+        char *write_hex(char *out, unsigned int value, int digits)
+        {
+            *out++ = '0';
+            *out++ = 'x';
+            for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4) {
+                *out++ = HEX_DIGITS[(value >> shift) & 0xF];
+            }
+            return out;
+        }
+
+        // Fill in the placeholders of a form's text, see InstructionForm
+        char *write_operands(char *out, const char *text, std::uint16_t instruction, std::uint16_t next_word)
+        {
+            while (*text) {
+                if (*text != '{') {
+                    *out++ = *text++;
+                    continue;
+                }
+
+                text++;
+                std::size_t length = 0;
+                while (text[length] != '}') {
+                    length++;
+                }
+                std::string_view name(text, length);
+                text += length + 1;
+
+                if (name == "x") {
+                    *out++ = "0123456789ABCDEF"[(instruction >> 8) & 0xF];
+                } else if (name == "y") {
+                    *out++ = "0123456789ABCDEF"[(instruction >> 4) & 0xF];
+                } else if (name == "n") {
+                    out = write_hex(out, instruction & 0xF, 1);
+                } else if (name == "kk") {
+                    out = write_hex(out, instruction & 0xFF, 2);
+                } else if (name == "nnn") {
+                    out = write_hex(out, instruction & 0xFFF, 3);
+                } else if (name == "long") {
+                    out = write_hex(out, next_word, 4);
+                } else {
+                    out = write_hex(out, instruction, 4);
+                }
+            }
+            return out;
+        }
+
+        // Write the line for the instruction at offset, which must be inside code. Returns the end
+        // of the line and sets size to the bytes the instruction takes.
+        template <typename Q>
+        char *write_line(std::span<const std::uint8_t> code, std::size_t offset, std::uint16_t base, char *out, std::size_t &size)
+        {
+            out = write_hex(out, static_cast<std::uint16_t>(base + offset), 4);
+            out = write_text(out, "  ");
+
+            std::size_t remaining = code.size() - offset;
+            if (remaining == 1) {
+                size = 1;
+                out = write_hex(out, code[offset], 2);
+                out = write_text(out, "    DB ");
+                out = write_hex(out, code[offset], 2);
+                *out++ = '\n';
+                return out;
+            }
+
+            std::uint16_t instruction = static_cast<std::uint16_t>(code[offset] << 8 | code[offset + 1]);
+            const InstructionForm *form = &decode_form<Q::xochip_opcodes>(instruction);
+            if (Q::jump_uses_vx && form->opcode == Opcode::jp_offset) {
+                form = &JP_OFFSET_VX_FORM;
+            }
+            size = instruction_size(form->opcode);
+
+            std::uint16_t next_word = 0;
+            if (size > remaining) {
+                // F000 cut off by the end of the code
+                form = &INSTRUCTION_FORMS.back();
+                size = 2;
+            } else if (size == 4) {
+                next_word = static_cast<std::uint16_t>(code[offset + 2] << 8 | code[offset + 3]);
+            }
+
+            out = write_hex(out, instruction, 4);
+            out = write_text(out, "  ");
+            out = write_operands(out, form->text, instruction, next_word);
+            *out++ = '\n';
+            return out;
+        }
+
+        template <typename Q>
+        std::size_t write_lines(std::span<const std::uint8_t> code, std::size_t &offset, std::uint16_t base, std::span<char> buffer)
+        {
+            char *out = buffer.data();
+            char *end = buffer.data() + buffer.size();
+
+            while (offset < code.size() && static_cast<std::size_t>(end - out) >= MAX_DISASSEMBLY_LINE) {
+                std::size_t size = 0;
+                out = write_line<Q>(code, offset, base, out, size);
+                offset += size;
+            }
+            return static_cast<std::size_t>(out - buffer.data());
+        }
+    }
+
+    std::size_t disassemble(std::span<const std::uint8_t> code, std::size_t &offset, std::uint16_t base,
+                            Platform platform, std::span<char> buffer)
+    {
+        return with_quirks(platform, [&](auto quirks) {
+            return write_lines<decltype(quirks)>(code, offset, base, buffer);
+        });
+    }
+}
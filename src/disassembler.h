@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include "chip8.h"
+
+namespace chip8 {
+    /*
+        Disassembles CHIP-8 code with the interpreter's decode table, so an instruction is listed
+        exactly as the given platform would run it. Code is read from a byte span loaded at a base
+        address, and each instruction becomes one line:
+
+            0x0200  0xa22a  LD I, 0x22a
+
+        Words that are not instructions on the platform are listed as DW, a trailing odd byte as
+        DB. Nothing allocates: lines are written into a caller-supplied buffer or handed to a sink.
+    */
+
+    // Longest line written, including its newline
+    inline constexpr std::size_t MAX_DISASSEMBLY_LINE = 48;
+
+    // Disassemble from offset into buffer, whole lines only, and advance offset past them. Returns
+    // the number of characters written, which is 0 once offset reaches the end of code or if
+    // buffer cannot hold a single line.
+    std::size_t disassemble(std::span<const std::uint8_t> code, std::size_t &offset, std::uint16_t base,
+                            Platform platform, std::span<char> buffer);
+
+    // Disassemble all of code, calling sink(std::string_view) with successive chunks of whole lines
+    template <typename Sink>
+    void disassemble(std::span<const std::uint8_t> code, std::uint16_t base, Platform platform, Sink &&sink)
+    {
+        std::array<char, 4096> buffer;
+        std::size_t offset = 0;
+        while (std::size_t length = disassemble(code, offset, base, platform, buffer)) {
+            sink(std::string_view(buffer.data(), length));
+        }
+    }
+}
@@ -0,0 +1,199 @@
+/*
+    Disassembler: lists every instruction of one or more ROMs, decoded the way the core would run
+    them on the chosen platform. Output is buffered in large writes, so whole ROM sets can be
+    indexed quickly.
+
+    With --cfg it analyzes control flow instead of sweeping linearly: "listing" disassembles only
+    reachable code and shows everything else as data, while "dot", "json" and "binary" export the
+    control flow graph of a single ROM.
+
+    ROMs are mapped rather than read, and --pack takes a whole ROM pack (rompack.h) at once, so
+    disassembling a large ROM set costs no more I/O than mapping one file.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../cfg.h"
+#include "../chip8.h"
+#include "../disassembler.h"
+#include "../ops.h"
+#include "../romdb.h"
+#include "../rompack.h"
+
+static void usage(const char *program)
+{
+    std::fprintf(stderr,
+        "usage: %s [options] rom...\n"
+        "  --platform NAME      modern, cosmac_vip, schip or xochip (default: ROM database, then modern)\n"
+        "  --base ADDR          address the ROM is loaded at (default: 0x%03x)\n"
+        "  --cfg FORMAT         listing, dot, json or binary: follow control flow from the base address\n"
+        "  --pack FILE          disassemble every ROM in the ROM pack FILE, after any ROMs given\n",
+        program, static_cast<unsigned int>(chip8::PROGRAM_START_ADDRESS));
+}
+
+static void write_output(std::string_view text)
+{
+    std::fwrite(text.data(), 1, text.size(), stdout);
+}
+
+// Bytes from start to end as DB lines of up to eight
+static void print_data(std::span<const std::uint8_t> rom, std::uint16_t base, std::size_t start, std::size_t end)
+{
+    for (std::size_t line = start; line < end; line += 8) {
+        std::printf("0x%04x  DB ", static_cast<unsigned int>(static_cast<std::uint16_t>(base + line)));
+        for (std::size_t i = line; i < end && i < line + 8; i++) {
+            std::printf(i == line ? "0x%02x" : ", 0x%02x", rom[i]);
+        }
+        std::putchar('\n');
+    }
+}
+
+// Reachable code block by block, with the bytes in between as data
+static void print_listing(std::span<const std::uint8_t> rom, std::uint16_t base, const chip8::ControlFlowGraph &cfg)
+{
+    std::size_t offset = 0;
+    for (const chip8::BasicBlock &block : cfg.blocks) {
+        std::size_t start = block.start - base;
+        if (start < offset) {
+            // Overlaps the previous block, through a jump into the middle of an instruction
+            continue;
+        }
+        print_data(rom, base, offset, start);
+        std::span<const std::uint8_t> code(rom.data() + start, block.end - block.start);
+        chip8::disassemble(code, block.start, cfg.platform, write_output);
+        offset = block.end - base;
+    }
+    print_data(rom, base, offset, rom.size());
+}
+
+int main(int argc, char **argv)
+{
+    bool platform_given = false;
+    chip8::Platform platform = chip8::Platform::modern;
+    unsigned long base = chip8::PROGRAM_START_ADDRESS;
+    std::string_view cfg_format;
+    std::vector<const char *> rom_paths;
+    std::vector<const char *> pack_paths;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (arg[0] != '-' || arg[1] == '\0') {
+            rom_paths.push_back(arg);
+            continue;
+        }
+
+        if (!value) {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+
+        if (std::strcmp(arg, "--platform") == 0) {
+            if (!chip8::parse_platform_name(value, platform)) {
+                std::fprintf(stderr, "unknown platform '%s'\n", value);
+                return 2;
+            }
+            platform_given = true;
+        } else if (std::strcmp(arg, "--pack") == 0) {
+            pack_paths.push_back(value);
+        } else if (std::strcmp(arg, "--base") == 0) {
+            char *end = nullptr;
+            base = std::strtoul(value, &end, 0);
+            if (*value == '\0' || *end != '\0' || base > 0xFFFF) {
+                std::fprintf(stderr, "--base expects an address up to 0xffff\n");
+                return 2;
+            }
+        } else if (std::strcmp(arg, "--cfg") == 0) {
+            cfg_format = value;
+            if (cfg_format != "listing" && cfg_format != "dot" && cfg_format != "json" && cfg_format != "binary") {
+                std::fprintf(stderr, "unknown --cfg format '%s'\n", value);
+                return 2;
+            }
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (rom_paths.empty() && pack_paths.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int status = 0;
+    std::string error;
+    std::vector<chip8::RomPack> packs(pack_paths.size());
+    std::size_t rom_count = rom_paths.size();
+    for (std::size_t i = 0; i < pack_paths.size(); i++) {
+        if (!packs[i].open(pack_paths[i], error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            status = 1;
+            continue;
+        }
+        rom_count += packs[i].size();
+    }
+
+    bool exports_graph = !cfg_format.empty() && cfg_format != "listing";
+    if (exports_graph && rom_count > 1) {
+        std::fprintf(stderr, "--cfg %s takes a single ROM\n", std::string(cfg_format).c_str());
+        return 2;
+    }
+
+    static char output_buffer[1 << 16];
+    std::setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+
+    auto disassemble_rom = [&](std::string_view name, std::span<const std::uint8_t> rom) {
+        chip8::Platform rom_platform = platform;
+        if (!platform_given) {
+            const chip8::RomInfo *info = chip8::identify_rom(rom.data(), rom.size());
+            rom_platform = info ? info->platform : chip8::Platform::modern;
+        }
+
+        if (rom_count > 1) {
+            std::printf("%.*s: platform=%s\n", static_cast<int>(name.size()), name.data(), chip8::get_platform_name(rom_platform));
+        }
+
+        std::uint16_t rom_base = static_cast<std::uint16_t>(base);
+        if (cfg_format.empty()) {
+            chip8::disassemble(rom, rom_base, rom_platform, write_output);
+            return;
+        }
+
+        chip8::ControlFlowGraph cfg = chip8::analyze_control_flow(rom, rom_base, rom_platform);
+        if (cfg_format == "listing") {
+            print_listing(rom, rom_base, cfg);
+        } else if (cfg_format == "dot") {
+            write_output(chip8::cfg_to_dot(cfg, rom));
+        } else if (cfg_format == "json") {
+            write_output(chip8::cfg_to_json(cfg));
+        } else {
+            std::vector<std::uint8_t> data = chip8::save_cfg(cfg);
+            std::fwrite(data.data(), 1, data.size(), stdout);
+        }
+    };
+
+    chip8::MappedFile file;
+    for (const char *path : rom_paths) {
+        if (!file.open(path, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            status = 1;
+            continue;
+        }
+        disassemble_rom(path, file.data());
+    }
+
+    for (std::size_t i = 0; i < packs.size(); i++) {
+        for (const chip8::PackedRom &rom : packs[i]) {
+            std::string name = std::string(pack_paths[i]) + ":" + std::string(rom.name);
+            disassemble_rom(name, rom.data);
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,35 @@
+/*
+    Fuzz target for differential testing: every backend runs the input in lockstep with the
+    reference interpreter (see difftest.h), and any divergence aborts with the report.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include "../difftest.h"
+#include "fuzz_input.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size)
+{
+    fuzz::Input input;
+    if (!fuzz::parse_input(data, size, input)) {
+        return 0;
+    }
+
+    chip8::DiffOptions options;
+    options.platform = input.platform;
+    options.cycles_per_frame = input.cycles_per_frame;
+    options.frames = fuzz::FRAMES;
+    options.key_seed = input.key_seed;
+    options.lane_count = 4;
+
+    for (std::size_t i = 0; i < chip8::BACKEND_COUNT; i++) {
+        chip8::Backend backend = static_cast<chip8::Backend>(i);
+        chip8::DiffResult result = chip8::run_differential(backend, input.rom, options);
+        if (result.status == chip8::DiffStatus::diverged) {
+            std::fprintf(stderr, "%s (%s): %s", chip8::get_backend_name(backend), chip8::get_platform_name(input.platform),
+                         result.report.c_str());
+            std::abort();
+        }
+    }
+
+    return 0;
+}
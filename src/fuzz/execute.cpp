@@ -0,0 +1,51 @@
+/*
+    Fuzz target for the interpreter: runs arbitrary ROMs for a bounded number of frames with
+    changing keys, then checks that the machine is still consistent and survives a save state
+    round trip unchanged.
+*/
+#include <vector>
+#include "../chip8.h"
+#include "../ops.h"
+#include "fuzz_input.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size)
+{
+    fuzz::Input input;
+    if (!fuzz::parse_input(data, size, input)) {
+        return 0;
+    }
+
+    chip8::Machine machine;
+    chip8::reset(machine, input.platform);
+    if (!chip8::load_rom(machine, input.rom.data(), input.rom.size())) {
+        return 0;
+    }
+
+    std::uint32_t keys = input.key_seed;
+    for (std::uint32_t frame = 0; frame < fuzz::FRAMES && chip8::get_fault(machine) == chip8::Fault::none; frame++) {
+        keys = chip8::next_random(keys | 0x10000);
+        machine.keys = static_cast<std::uint16_t>(keys);
+        if (chip8::run_frame(machine, input.cycles_per_frame) > input.cycles_per_frame) {
+            __builtin_trap();
+        }
+    }
+
+    if (machine.stack_pointer > chip8::MAX_STACK_DEPTH || machine.pending_key >= 16) {
+        __builtin_trap();
+    }
+
+    chip8::Framebuffer framebuffer;
+    chip8::get_video_buffer(machine, framebuffer);
+
+    std::vector<std::uint8_t> state(chip8::get_state_size(machine));
+    std::vector<std::uint8_t> restored_state(state.size());
+    chip8::Machine restored;
+    if (!chip8::save_state(machine, state.data(), state.size())
+        || !chip8::load_state(restored, state.data(), state.size())
+        || !chip8::save_state(restored, restored_state.data(), restored_state.size())
+        || state != restored_state) {
+        __builtin_trap();
+    }
+
+    return 0;
+}
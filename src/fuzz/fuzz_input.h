@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include "../chip8.h"
+
+/*
+    Input layout shared by the fuzz targets: a three byte header, then the ROM.
+        platform            taken modulo the number of platforms
+        cycles per frame    1 to 64
+        key seed            pseudo-random keys for the differential target, 0 for none
+    scripts/seed_fuzz_corpus.py turns a directory of ROMs into seed inputs in this layout.
+*/
+namespace fuzz {
+    inline constexpr std::size_t HEADER_SIZE = 3;
+
+    // Frames each input runs for, so every run stays short
+    inline constexpr std::uint32_t FRAMES = 60;
+
+    struct Input {
+        chip8::Platform platform;
+        unsigned int cycles_per_frame;
+        std::uint8_t key_seed;
+        std::span<const std::uint8_t> rom;
+    };
+
+    inline bool parse_input(const std::uint8_t *data, std::size_t size, Input &input)
+    {
+        if (size < HEADER_SIZE) {
+            return false;
+        }
+        input.platform = static_cast<chip8::Platform>(data[0] % 4);
+        input.cycles_per_frame = 1u + data[1] % 64;
+        input.key_seed = data[2];
+        input.rom = std::span(data + HEADER_SIZE, size - HEADER_SIZE);
+        return true;
+    }
+}
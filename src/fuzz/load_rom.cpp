@@ -0,0 +1,65 @@
+/*
+    Fuzz target for ROM loading: arbitrary bytes of any length go through load_rom(), ROM images
+    and the lane engine's reset. Loading must either copy the ROM in place or refuse it with
+    Fault::rom_too_large, and every path must leave the same memory behind.
+*/
+#include <cstring>
+#include <vector>
+#include "../chip8.h"
+#include "../lanes.h"
+#include "../ops.h"
+#include "../romdb.h"
+#include "fuzz_input.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size)
+{
+    fuzz::Input input;
+    if (!fuzz::parse_input(data, size, input)) {
+        return 0;
+    }
+    chip8::Platform platform = input.platform;
+    const std::uint8_t *rom = input.rom.data();
+    std::size_t rom_size = input.rom.size();
+
+    chip8::identify_rom(rom, rom_size);
+
+    chip8::Machine machine;
+    chip8::reset(machine, platform);
+    bool fits = rom_size <= static_cast<std::size_t>(chip8::get_memory_size(platform)) - chip8::PROGRAM_START_ADDRESS;
+    if (chip8::load_rom(machine, rom, rom_size) != fits) {
+        __builtin_trap();
+    }
+    if (!fits) {
+        if (chip8::get_fault(machine) != chip8::Fault::rom_too_large) {
+            __builtin_trap();
+        }
+        return 0;
+    }
+
+    const std::uint8_t *memory = chip8::get_memory_buffer(machine);
+    if (rom_size > 0 && std::memcmp(memory + chip8::PROGRAM_START_ADDRESS, rom, rom_size) != 0) {
+        __builtin_trap();
+    }
+
+    // Machines started from a shared image see the same memory
+    chip8::RomImage image;
+    chip8::Machine from_image;
+    if (!chip8::make_rom_image(platform, rom, rom_size, image)) {
+        __builtin_trap();
+    }
+    chip8::load_rom(from_image, image);
+    std::size_t memory_size = static_cast<std::size_t>(chip8::get_memory_size(machine));
+    if (std::memcmp(chip8::get_memory_buffer(from_image), memory, memory_size) != 0) {
+        __builtin_trap();
+    }
+
+    if (platform != chip8::Platform::xochip) {
+        chip8::Lanes lanes;
+        if (!chip8::reset_lanes(lanes, platform, 3, rom, rom_size)
+            || std::memcmp(chip8::get_lane_memory(lanes, 2), memory, memory_size) != 0) {
+            __builtin_trap();
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+/*
+    Stand-in for the libFuzzer driver on compilers without -fsanitize=fuzzer: runs a fuzz target
+    once over each file given, or each file in each directory given. Useful for replaying a crash
+    or a corpus under the sanitizers.
+*/
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size);
+
+static bool replay(const std::filesystem::path &path)
+{
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        std::fprintf(stderr, "cannot read %s\n", path.string().c_str());
+        return false;
+    }
+    std::vector<std::uint8_t> data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    LLVMFuzzerTestOneInput(data.data(), data.size());
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    std::size_t inputs = 0;
+    for (int i = 1; i < argc; i++) {
+        std::error_code error;
+        if (std::filesystem::is_directory(argv[i], error)) {
+            for (const auto &entry : std::filesystem::directory_iterator(argv[i])) {
+                if (entry.is_regular_file() && !replay(entry.path())) return 1;
+                inputs++;
+            }
+        } else {
+            if (!replay(argv[i])) return 1;
+            inputs++;
+        }
+    }
+    std::printf("replayed %zu inputs\n", inputs);
+    return 0;
+}
@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <bit>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+#include "gym.h"
+#include "../lanes.h"
+#include "../reward.h"
+#include "../romdb.h"
+
+namespace {
+    constexpr unsigned int DEFAULT_CYCLES_PER_FRAME = 700 / 60;
+
+    // splitmix64, used for the sticky action draws
+    std::uint64_t next_random(std::uint64_t &state)
+    {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    bool is_valid_downsample(std::uint32_t downsample)
+    {
+        return downsample == 0 || (downsample <= 8 && std::has_single_bit(downsample));
+    }
+}
+
+struct chip8_gym {
+    chip8_gym_config config;
+    chip8::Lanes lanes;
+    unsigned int cycles_per_frame;
+
+    std::vector<std::uint16_t> held_keys;       // Action in effect on the last frame, for sticky actions
+    std::vector<std::uint64_t> random_state;
+    std::vector<std::uint8_t> pixels;
+    std::vector<float> rewards;
+    std::vector<std::uint8_t> dones;
+    std::vector<std::uint32_t> episode_frames;
+
+    chip8::RewardProgram reward_program;
+    std::vector<std::int64_t> reward_previous;  // slot_count values per environment
+    std::string error;
+};
+
+namespace {
+    void update_pixels(chip8_gym &gym)
+    {
+        const std::uint32_t d = gym.config.downsample;
+        if (d == 0) {
+            return;
+        }
+
+        const std::size_t rows = chip8::SCREEN_HEIGHT / d;
+        const std::size_t columns = chip8::SCREEN_WIDTH / d;
+        const unsigned int area = d * d;
+        const chip8::PlaneRow block_mask = (chip8::PlaneRow { 1 } << d) - 1;
+
+        std::uint8_t *out = gym.pixels.data();
+        for (std::size_t env = 0; env < gym.config.num_envs; env++) {
+            const chip8::Plane &plane = chip8::get_lane_display(gym.lanes, env);
+            for (std::size_t row = 0; row < rows; row++) {
+                for (std::size_t column = 0; column < columns; column++) {
+                    const unsigned int shift = static_cast<unsigned int>(chip8::SCREEN_WIDTH - d * (column + 1));
+                    unsigned int lit = 0;
+                    for (std::size_t y = row * d; y < (row + 1) * d; y++) {
+                        lit += static_cast<unsigned int>(std::popcount((plane[y] >> shift) & block_mask));
+                    }
+                    *out++ = static_cast<std::uint8_t>(lit * 255 / area);
+                }
+            }
+        }
+    }
+
+    void start_episode(chip8_gym &gym, std::size_t env)
+    {
+        chip8::reset_lane(gym.lanes, env);
+        gym.held_keys[env] = 0;
+        gym.episode_frames[env] = 0;
+
+        const std::size_t slots = gym.reward_program.slot_count;
+        chip8::start_reward(gym.reward_program, chip8::get_lane_memory(gym.lanes, env), gym.lanes.memory_size,
+                            gym.reward_previous.data() + env * slots);
+    }
+}
+
+extern "C" {
+    void chip8_gym_default_config(chip8_gym_config *config)
+    {
+        *config = {};
+        config->num_envs = 1;
+        config->platform = CHIP8_GYM_PLATFORM_AUTO;
+        config->frameskip = 1;
+    }
+
+    chip8_gym *chip8_gym_create(const uint8_t *rom, size_t size, const chip8_gym_config *config)
+    {
+        if (config->num_envs == 0 || config->frameskip == 0 || !is_valid_downsample(config->downsample)
+            || !(config->sticky_action_probability >= 0 && config->sticky_action_probability <= 1)) {
+            return nullptr;
+        }
+
+        const chip8::RomInfo *info = chip8::identify_rom(rom, size);
+
+        chip8::Platform platform;
+        switch (config->platform) {
+            case CHIP8_GYM_PLATFORM_AUTO: platform = info ? info->platform : chip8::Platform::modern; break;
+            case CHIP8_GYM_PLATFORM_MODERN: platform = chip8::Platform::modern; break;
+            case CHIP8_GYM_PLATFORM_COSMAC_VIP: platform = chip8::Platform::cosmac_vip; break;
+            case CHIP8_GYM_PLATFORM_SCHIP: platform = chip8::Platform::schip; break;
+            default: return nullptr;
+        }
+
+        chip8_gym *gym = new (std::nothrow) chip8_gym {};
+        if (!gym) {
+            return nullptr;
+        }
+
+        gym->config = *config;
+        gym->cycles_per_frame = config->cycles_per_frame ? config->cycles_per_frame
+                              : info ? info->cycles_per_frame : DEFAULT_CYCLES_PER_FRAME;
+
+        // Fails for XO-CHIP ROMs picked by the database, or a ROM that does not fit
+        if (!chip8::reset_lanes(gym->lanes, platform, config->num_envs, rom, size, config->seed)) {
+            delete gym;
+            return nullptr;
+        }
+
+        const std::size_t envs = config->num_envs;
+        gym->held_keys.assign(envs, 0);
+        gym->random_state.resize(envs);
+        for (std::size_t env = 0; env < envs; env++) {
+            gym->random_state[env] = config->seed + env;
+            next_random(gym->random_state[env]);
+        }
+        if (config->downsample) {
+            gym->pixels.assign(envs * (chip8::SCREEN_HEIGHT / config->downsample) * (chip8::SCREEN_WIDTH / config->downsample), 0);
+        }
+        gym->rewards.assign(envs, 0);
+        gym->dones.assign(envs, 0);
+        gym->episode_frames.assign(envs, 0);
+
+        return gym;
+    }
+
+    void chip8_gym_destroy(chip8_gym *gym)
+    {
+        delete gym;
+    }
+
+    void chip8_gym_reset(chip8_gym *gym)
+    {
+        for (std::size_t env = 0; env < gym->config.num_envs; env++) {
+            start_episode(*gym, env);
+            gym->rewards[env] = 0;
+            gym->dones[env] = 0;
+        }
+        update_pixels(*gym);
+    }
+
+    void chip8_gym_step(chip8_gym *gym, const uint16_t *actions)
+    {
+        const std::size_t envs = gym->config.num_envs;
+        const float sticky = gym->config.sticky_action_probability;
+
+        std::fill(gym->rewards.begin(), gym->rewards.end(), 0.0f);
+        std::fill(gym->dones.begin(), gym->dones.end(), 0);
+
+        for (std::uint32_t frame = 0; frame < gym->config.frameskip; frame++) {
+            for (std::size_t env = 0; env < envs; env++) {
+                // Environments that finished earlier in the step are paused until the reset below
+                if (gym->dones[env]) {
+                    chip8::set_lane_paused(gym->lanes, env, true);
+                    continue;
+                }
+                if (sticky == 0 || (next_random(gym->random_state[env]) >> 40) >= sticky * (1 << 24)) {
+                    gym->held_keys[env] = actions[env];
+                }
+                chip8::set_lane_keys(gym->lanes, env, gym->held_keys[env]);
+            }
+
+            chip8::run_lanes_frame(gym->lanes, gym->cycles_per_frame);
+
+            for (std::size_t env = 0; env < envs; env++) {
+                if (!gym->dones[env]) gym->episode_frames[env]++;
+            }
+
+            chip8::evaluate_lane_rewards(gym->reward_program, gym->lanes, gym->reward_previous.data(),
+                                         gym->rewards.data(), gym->dones.data());
+
+            for (std::size_t env = 0; env < envs; env++) {
+                if (gym->dones[env]) {
+                    continue;
+                }
+                if (chip8::get_lane_fault(gym->lanes, env) != chip8::Fault::none
+                    || gym->episode_frames[env] == gym->config.max_episode_frames) {
+                    gym->dones[env] = 1;
+                }
+            }
+        }
+
+        for (std::size_t env = 0; env < envs; env++) {
+            if (gym->dones[env]) {
+                start_episode(*gym, env);
+            }
+        }
+
+        update_pixels(*gym);
+    }
+
+    int chip8_gym_set_reward_spec(chip8_gym *gym, const char *spec)
+    {
+        chip8::RewardProgram program;
+        if (!chip8::compile_reward_spec(spec, program, gym->error)) {
+            return 0;
+        }
+
+        gym->reward_program = std::move(program);
+        gym->reward_previous.assign(gym->config.num_envs * gym->reward_program.slot_count, 0);
+        chip8_gym_reset(gym);
+        return 1;
+    }
+
+    const char *chip8_gym_last_error(const chip8_gym *gym)
+    {
+        return gym->error.c_str();
+    }
+
+    uint32_t chip8_gym_num_envs(const chip8_gym *gym)
+    {
+        return gym->config.num_envs;
+    }
+
+    const uint64_t *chip8_gym_observations(const chip8_gym *gym)
+    {
+        return gym->lanes.planes.front().data();
+    }
+
+    const uint8_t *chip8_gym_pixels(const chip8_gym *gym)
+    {
+        return gym->pixels.empty() ? nullptr : gym->pixels.data();
+    }
+
+    const float *chip8_gym_rewards(const chip8_gym *gym)
+    {
+        return gym->rewards.data();
+    }
+
+    const uint8_t *chip8_gym_dones(const chip8_gym *gym)
+    {
+        return gym->dones.data();
+    }
+
+    const uint32_t *chip8_gym_episode_frames(const chip8_gym *gym)
+    {
+        return gym->episode_frames.data();
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef CHIP8_GYM_H
+#define CHIP8_GYM_H
+
+/*
+    C interface for reinforcement learning: a batch of environments running one ROM, stepped
+    together on the lockstep lane engine. Meant to be built as a shared library and driven from
+    Python through ctypes or cffi.
+
+    Observations, rewards and done flags live in buffers owned by the batch. The pointers stay
+    valid until the batch is destroyed and are updated in place by every step, so nothing is
+    copied per step unless the downsampled pixel view is enabled.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  define CHIP8_GYM_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#  define CHIP8_GYM_API __attribute__((visibility("default")))
+#else
+#  define CHIP8_GYM_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    CHIP8_GYM_PLATFORM_AUTO = -1,       /* From the ROM database, modern if the ROM is unknown */
+    CHIP8_GYM_PLATFORM_MODERN = 0,
+    CHIP8_GYM_PLATFORM_COSMAC_VIP = 1,
+    CHIP8_GYM_PLATFORM_SCHIP = 2
+};
+
+typedef struct chip8_gym_config {
+    uint32_t num_envs;
+    int32_t platform;                   /* A CHIP8_GYM_PLATFORM_* value. XO-CHIP is not supported. */
+    uint32_t cycles_per_frame;          /* 0 for the ROM database, then the default of 11 */
+    uint32_t frameskip;                 /* Frames run per step with the same action, at least 1 */
+    float sticky_action_probability;    /* Chance each frame of repeating the previous action instead */
+    uint32_t max_episode_frames;        /* Episodes end after this many frames, 0 for no limit */
+    uint32_t downsample;                /* Side of the square averaged into one pixel (1, 2, 4 or 8), 0 for no pixel view */
+    uint64_t seed;                      /* Seeds the sticky action draws and each environment's random numbers */
+} chip8_gym_config;
+
+typedef struct chip8_gym chip8_gym;
+
+/* Fill in a single environment with no frameskip, sticky actions or episode limit */
+CHIP8_GYM_API void chip8_gym_default_config(chip8_gym_config *config);
+
+/* Returns NULL if the configuration is invalid or the ROM does not fit. The ROM is copied. */
+CHIP8_GYM_API chip8_gym *chip8_gym_create(const uint8_t *rom, size_t size, const chip8_gym_config *config);
+
+CHIP8_GYM_API void chip8_gym_destroy(chip8_gym *gym);
+
+/* Start a new episode in every environment */
+CHIP8_GYM_API void chip8_gym_reset(chip8_gym *gym);
+
+/*
+    Advance every environment by one step. actions holds num_envs key masks, bit k set while
+    CHIP-8 key k is held. An episode ends on a fault, after max_episode_frames or when a done rule
+    holds. An environment whose episode ends is reset at the end of the step, so its observation
+    is already the start of the next episode while its done flag is set.
+*/
+CHIP8_GYM_API void chip8_gym_step(chip8_gym *gym, const uint16_t *actions);
+
+/*
+    Compute rewards and episode ends from memory with the rules in spec (see reward.h for the
+    format), replacing any earlier rules, and reset every environment. Returns 0 and leaves the
+    old rules in place if the spec is malformed.
+*/
+CHIP8_GYM_API int chip8_gym_set_reward_spec(chip8_gym *gym, const char *spec);
+
+/* Describes why the last chip8_gym_set_reward_spec call failed */
+CHIP8_GYM_API const char *chip8_gym_last_error(const chip8_gym *gym);
+
+CHIP8_GYM_API uint32_t chip8_gym_num_envs(const chip8_gym *gym);
+
+/*
+    The 1-bit displays: num_envs x 32 rows of uint64_t, leftmost pixel in the most significant bit.
+    This is the emulator's own display memory.
+*/
+CHIP8_GYM_API const uint64_t *chip8_gym_observations(const chip8_gym *gym);
+
+/* num_envs x (32 / downsample) x (64 / downsample) bytes, 0 to 255, or NULL when downsample is 0 */
+CHIP8_GYM_API const uint8_t *chip8_gym_pixels(const chip8_gym *gym);
+
+/* Reward of the last step for each environment, summed over its frames */
+CHIP8_GYM_API const float *chip8_gym_rewards(const chip8_gym *gym);
+
+/* 1 for each environment whose episode ended in the last step */
+CHIP8_GYM_API const uint8_t *chip8_gym_dones(const chip8_gym *gym);
+
+/* Frames into the current episode for each environment */
+CHIP8_GYM_API const uint32_t *chip8_gym_episode_frames(const chip8_gym *gym);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
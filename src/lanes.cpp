@@ -0,0 +1,601 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <functional>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "lanes.h"
+#include "ops.h"
+#include "quirks.h"
+
+namespace chip8 {
+    namespace {
+        /*
+            Lanes fetch from the same address of their own memory every step. With memory a power of
+            two apart those all land in one cache set and keep evicting each other, so each lane's
+            memory is padded by a cache line.
+        */
+        constexpr std::size_t LANE_MEMORY_PADDING = 64;
+
+        // Most cycles a block runs before starting over with fresh counts, which are 16 bits
+        constexpr unsigned int MAX_LANE_RUN = 0xFFFF;
+
+        // Comparison results: all ones in lanes where the comparison held
+        using LaneMask8 = std::int8_t __attribute__((vector_size(LANE_BLOCK)));
+        using LaneMask16 = std::int16_t __attribute__((vector_size(LANE_BLOCK * 2)));
+        using LaneMask32 = std::int32_t __attribute__((vector_size(LANE_BLOCK * 4)));
+
+        template <typename V, typename M>
+        inline V select(M mask, V if_true, V if_false)
+        {
+            return (if_true & (V) mask) | (if_false & ~(V) mask);
+        }
+
+        inline LaneMask8 narrow(LaneMask16 mask) { return __builtin_convertvector(mask, LaneMask8); }
+        inline LaneMask16 widen(LaneMask8 mask) { return __builtin_convertvector(mask, LaneMask16); }
+        inline LaneWords to_words(LaneBytes bytes) { return __builtin_convertvector(bytes, LaneWords); }
+
+        /*
+            GCC splits arithmetic on vectors wider than the target's registers into register-sized
+            pieces, but lowers comparisons of them one element at a time. Comparisons go through
+            compare(), which splits them the same way.
+        */
+#if defined(__AVX512BW__)
+        constexpr std::size_t REGISTER_BYTES = 64;
+#elif defined(__AVX2__)
+        constexpr std::size_t REGISTER_BYTES = 32;
+#else
+        constexpr std::size_t REGISTER_BYTES = 16;
+#endif
+        using BytePiece = std::uint8_t __attribute__((vector_size(std::min(REGISTER_BYTES, sizeof(LaneBytes)))));
+        using WordPiece = std::uint16_t __attribute__((vector_size(std::min(REGISTER_BYTES, sizeof(LaneWords)))));
+
+        template <typename Piece, typename Mask, typename V, typename Op>
+        inline Mask compare_pieces(V a, V b, Op op)
+        {
+            Mask result;
+            for (std::size_t offset = 0; offset < sizeof(V); offset += sizeof(Piece)) {
+                Piece x, y;
+                std::memcpy(&x, reinterpret_cast<const char *>(&a) + offset, sizeof(Piece));
+                std::memcpy(&y, reinterpret_cast<const char *>(&b) + offset, sizeof(Piece));
+                auto piece = op(x, y);
+                std::memcpy(reinterpret_cast<char *>(&result) + offset, &piece, sizeof(Piece));
+            }
+            return result;
+        }
+
+        template <typename Op>
+        inline LaneMask8 compare(LaneBytes a, LaneBytes b, Op op) { return compare_pieces<BytePiece, LaneMask8>(a, b, op); }
+
+        template <typename Op>
+        inline LaneMask16 compare(LaneWords a, LaneWords b, Op op) { return compare_pieces<WordPiece, LaneMask16>(a, b, op); }
+
+        template <typename V> inline auto equal(V a, V b) { return compare(a, b, std::equal_to<>()); }
+        template <typename V> inline auto not_equal(V a, V b) { return compare(a, b, std::not_equal_to<>()); }
+        template <typename V> inline auto less(V a, V b) { return compare(a, b, std::less<>()); }
+        template <typename V> inline auto greater_equal(V a, V b) { return compare(a, b, std::greater_equal<>()); }
+
+        // 1 in lanes where the mask is set, for storing flags in VF
+        inline LaneBytes to_flag(LaneMask8 mask) { return (LaneBytes) mask & 1; }
+
+        // One bit per lane, lane 0 in bit 0, so loops over lanes can skip the ones not in a mask
+        using LaneBits = std::uint32_t;
+        static_assert(LANE_BLOCK == 32, "LaneBits holds one bit per lane");
+
+        inline LaneBits lane_bits(LaneMask8 mask)
+        {
+#if defined(__AVX2__)
+            __m256i bytes;
+            std::memcpy(&bytes, &mask, sizeof(bytes));
+            return static_cast<LaneBits>(_mm256_movemask_epi8(bytes));
+#elif defined(__SSE2__)
+            __m128i low, high;
+            std::memcpy(&low, &mask, sizeof(low));
+            std::memcpy(&high, reinterpret_cast<const char *>(&mask) + sizeof(low), sizeof(high));
+            return static_cast<LaneBits>(_mm_movemask_epi8(low)) | static_cast<LaneBits>(_mm_movemask_epi8(high)) << 16;
+#else
+            LaneBits bits = 0;
+            for (int lane = 0; lane < LANE_BLOCK; lane++) {
+                bits |= static_cast<LaneBits>(mask[lane] != 0) << lane;
+            }
+            return bits;
+#endif
+        }
+
+        inline LaneBits lane_bits(LaneMask16 mask) { return lane_bits(narrow(mask)); }
+
+        inline bool any(LaneMask16 mask) { return lane_bits(mask) != 0; }
+
+        // Call f(lane) for every lane set in bits, lowest first
+        template <typename F>
+        inline void for_each_bit(LaneBits bits, F &&f)
+        {
+            for (; bits != 0; bits &= bits - 1) {
+                f(std::countr_zero(bits));
+            }
+        }
+
+        // Pages of written_pages, which must cover all of a 4 KB memory
+        constexpr unsigned int WRITTEN_PAGE_SHIFT = 6;
+
+        inline std::uint64_t written_page(std::uint16_t address)
+        {
+            return std::uint64_t { 1 } << (address >> WRITTEN_PAGE_SHIFT);
+        }
+
+        struct BlockContext {
+            Lanes &lanes;
+            LaneBlock &block;
+            std::size_t first_lane;
+
+            std::uint8_t *memory(int lane) { return lanes.memory.data() + (first_lane + lane) * lanes.memory_stride; }
+
+            // Stores go through here, so the block knows which code can still be fetched from initial_memory
+            std::uint8_t &store(int lane, std::uint16_t address)
+            {
+                block.written_pages |= written_page(address);
+                return memory(lane)[address];
+            }
+            Plane &plane(int lane) { return lanes.planes[first_lane + lane]; }
+        };
+
+        // Fault the lanes in mask and leave their PC on the instruction
+        [[gnu::cold]] void raise_lane_fault(LaneBlock &block, LaneMask16 mask, Fault fault)
+        {
+            block.fault = select(narrow(mask), (LaneBytes) {} + static_cast<std::uint8_t>(fault), block.fault);
+            block.program_counter = select(mask, block.program_counter - 2, block.program_counter);
+        }
+
+        // Execute one opcode on every lane in group. The PCs have already been advanced past it.
+        template <typename Q>
+        void execute_group(BlockContext &context, std::uint16_t instruction, LaneMask16 group)
+        {
+            LaneBlock &block = context.block;
+            auto &V = block.registers;
+
+            const LaneMask8 group8 = narrow(group);
+            const unsigned x = (instruction & 0x0F00) >> 8;
+            const unsigned y = (instruction & 0x00F0) >> 4;
+            const unsigned nibble = instruction & 0x000F;
+            const std::uint8_t kk = static_cast<std::uint8_t>(instruction & 0x00FF);
+            const std::uint16_t address_param = instruction & 0x0FFF;
+
+            auto set_register = [&](unsigned reg, LaneBytes value) { V[reg] = select(group8, value, V[reg]); };
+            auto skip_if = [&](LaneMask8 condition) {
+                LaneMask16 taken = widen(condition) & group;
+                block.program_counter = select(taken, block.program_counter + 2, block.program_counter);
+            };
+            auto for_each_lane = [&](auto &&f) { for_each_bit(lane_bits(group8), f); };
+
+            switch (instruction >> 12) {
+                case 0x0:
+                    if (instruction == 0x00E0) {
+                        for_each_lane([&](int lane) { context.plane(lane).fill(0); });
+                    } else if (instruction == 0x00EE) {
+                        LaneMask16 underflow = group & widen(equal(block.stack_pointer, LaneBytes {}));
+                        LaneMask16 returning = group & ~underflow;
+                        LaneWords depth = to_words(block.stack_pointer);
+                        for (int level = 0; level < Q::stack_depth; level++) {
+                            block.program_counter = select(returning & equal(depth, (LaneWords) {} + static_cast<std::uint16_t>(level + 1)), block.stack[level], block.program_counter);
+                        }
+                        block.stack_pointer = select(narrow(returning), block.stack_pointer - 1, block.stack_pointer);
+                        if (any(underflow)) raise_lane_fault(block, underflow, Fault::stack_underflow);
+                    }
+                    // 0nnn - SYS addr is ignored
+                    break;
+
+                case 0x1:
+                    block.program_counter = select(group, (LaneWords) {} + address_param, block.program_counter);
+                    break;
+
+                case 0x2: {
+                    LaneWords depth = to_words(block.stack_pointer);
+                    LaneMask16 overflow = group & greater_equal(depth, (LaneWords) {} + Q::stack_depth);
+                    LaneMask16 calling = group & ~overflow;
+                    for (int level = 0; level < Q::stack_depth; level++) {
+                        block.stack[level] = select(calling & equal(depth, (LaneWords) {} + static_cast<std::uint16_t>(level)), block.program_counter, block.stack[level]);
+                    }
+                    block.program_counter = select(calling, (LaneWords) {} + address_param, block.program_counter);
+                    block.stack_pointer = select(narrow(calling), block.stack_pointer + 1, block.stack_pointer);
+                    if (any(overflow)) raise_lane_fault(block, overflow, Fault::stack_overflow);
+                    break;
+                }
+
+                case 0x3: skip_if(equal(V[x], (LaneBytes) {} + kk)); break;
+                case 0x4: skip_if(not_equal(V[x], (LaneBytes) {} + kk)); break;
+
+                case 0x5:
+                    if (nibble != 0) {
+                        raise_lane_fault(block, group, Fault::invalid_opcode);
+                        break;
+                    }
+                    skip_if(equal(V[x], V[y]));
+                    break;
+
+                case 0x6: set_register(x, (LaneBytes) {} + kk); break;
+                case 0x7: set_register(x, V[x] + kk); break;
+
+                case 0x8: {
+                    // Flags are computed before any register is written, and VF is written last
+                    LaneBytes vx = V[x], vy = V[y];
+                    LaneBytes source = Q::shift_uses_vy ? vy : vx;
+                    switch (nibble) {
+                        case 0x0: set_register(x, vy); break;
+                        case 0x1: set_register(x, vx | vy); if (Q::logic_resets_vf) set_register(0xF, (LaneBytes) {}); break;
+                        case 0x2: set_register(x, vx & vy); if (Q::logic_resets_vf) set_register(0xF, (LaneBytes) {}); break;
+                        case 0x3: set_register(x, vx ^ vy); if (Q::logic_resets_vf) set_register(0xF, (LaneBytes) {}); break;
+                        case 0x4: {
+                            LaneBytes sum = vx + vy;
+                            set_register(x, sum);
+                            set_register(0xF, to_flag(less(sum, vx)));
+                            break;
+                        }
+                        case 0x5: set_register(x, vx - vy); set_register(0xF, to_flag(greater_equal(vx, vy))); break;
+                        case 0x6: set_register(x, source >> 1); set_register(0xF, source & 1); break;
+                        case 0x7: set_register(x, vy - vx); set_register(0xF, to_flag(greater_equal(vy, vx))); break;
+                        case 0xE: set_register(x, source << 1); set_register(0xF, source >> 7); break;
+                        default: raise_lane_fault(block, group, Fault::invalid_opcode); break;
+                    }
+                    break;
+                }
+
+                case 0x9:
+                    if (nibble != 0) {
+                        raise_lane_fault(block, group, Fault::invalid_opcode);
+                        break;
+                    }
+                    skip_if(not_equal(V[x], V[y]));
+                    break;
+
+                case 0xA:
+                    block.i_register = select(group, (LaneWords) {} + address_param, block.i_register);
+                    break;
+
+                case 0xB: {
+                    LaneWords offset = to_words(V[Q::jump_uses_vx ? x : 0]);
+                    block.program_counter = select(group, offset + address_param, block.program_counter);
+                    break;
+                }
+
+                case 0xC: {
+                    LaneCounts random = next_random(block.random_state);
+                    block.random_state = select(__builtin_convertvector(group, LaneMask32), random, block.random_state);
+                    set_register(x, __builtin_convertvector(random >> 24, LaneBytes) & kk);
+                    break;
+                }
+
+                case 0xD: {
+                    LaneBytes collisions {};
+                    for_each_lane([&](int lane) {
+                        const std::uint8_t *memory = context.memory(lane);
+                        collisions[lane] = draw_sprite<Q>(context.plane(lane), [&](unsigned int address) { return memory[address & (Q::memory_size - 1)]; },
+                                                          block.i_register[lane], V[x][lane], V[y][lane], nibble, false);
+                    });
+                    set_register(0xF, collisions);
+                    if constexpr (Q::display_wait) {
+                        block.waiting_for_vblank = select(group8, (LaneBytes) {} + 1, block.waiting_for_vblank);
+                    }
+                    break;
+                }
+
+                case 0xE: {
+                    // Shifted as 32-bit lanes, which AVX2 can shift by a count per lane
+                    LaneCounts pressed = (__builtin_convertvector(block.keys, LaneCounts) >> __builtin_convertvector(V[x] & 0xF, LaneCounts)) & 1;
+                    LaneMask8 down = __builtin_convertvector(-(LaneMask32) pressed, LaneMask8);
+                    if (kk == 0x9E) {
+                        skip_if(down);
+                    } else if (kk == 0xA1) {
+                        skip_if(~down);
+                    } else {
+                        raise_lane_fault(block, group, Fault::invalid_opcode);
+                    }
+                    break;
+                }
+
+                case 0xF:
+                    switch (kk) {
+                        case 0x07: set_register(x, block.delay_timer); break;
+                        case 0x15: block.delay_timer = select(group8, V[x], block.delay_timer); break;
+                        case 0x18: block.sound_timer = select(group8, V[x], block.sound_timer); break;
+                        case 0x1E: block.i_register = select(group, block.i_register + to_words(V[x]), block.i_register); break;
+                        case 0x29:
+                            block.i_register = select(group, to_words(V[x] & 0xF) * 5 + FONT_START_ADDRESS, block.i_register);
+                            break;
+
+                        case 0x0A:
+                            // Same press-and-release handling as the interpreter, per lane
+                            for_each_lane([&](int lane) {
+                                std::int8_t &pending = context.lanes.pending_key[context.first_lane + lane];
+                                std::uint16_t keys = block.keys[lane];
+                                if (pending < 0) {
+                                    if (keys != 0) pending = static_cast<std::int8_t>(std::countr_zero(keys));
+                                    block.program_counter[lane] -= 2;
+                                } else if (keys & (1u << pending)) {
+                                    block.program_counter[lane] -= 2;
+                                } else {
+                                    V[x][lane] = static_cast<std::uint8_t>(pending);
+                                    pending = -1;
+                                }
+                            });
+                            break;
+
+                        case 0x33:
+                            for_each_lane([&](int lane) {
+                                std::uint8_t value = V[x][lane];
+                                std::uint16_t address = block.i_register[lane];
+                                context.store(lane, address & (Q::memory_size - 1)) = value / 100;
+                                context.store(lane, (address + 1) & (Q::memory_size - 1)) = (value / 10) % 10;
+                                context.store(lane, (address + 2) & (Q::memory_size - 1)) = value % 10;
+                            });
+                            break;
+
+                        case 0x55:
+                        case 0x65:
+                            for_each_lane([&](int lane) {
+                                std::uint8_t *memory = context.memory(lane);
+                                std::uint16_t address = block.i_register[lane];
+                                for (unsigned reg = 0; reg <= x; reg++) {
+                                    std::uint16_t cell = (address + reg) & (Q::memory_size - 1);
+                                    if (kk == 0x55) {
+                                        context.store(lane, cell) = V[reg][lane];
+                                    } else {
+                                        V[reg][lane] = memory[cell];
+                                    }
+                                }
+                            });
+                            if constexpr (Q::load_store_increments_i) {
+                                block.i_register = select(group, block.i_register + static_cast<std::uint16_t>(x + 1), block.i_register);
+                            }
+                            break;
+
+                        default:
+                            raise_lane_fault(block, group, Fault::invalid_opcode);
+                            break;
+                    }
+                    break;
+            }
+        }
+
+        template <typename Q>
+        std::uint64_t run_block(Lanes &lanes, std::size_t block_index, unsigned int cycles)
+        {
+            static_assert(Q::memory_size >> WRITTEN_PAGE_SHIFT <= 64, "written_pages has a bit per page");
+            LaneBlock &block = lanes.blocks[block_index];
+            BlockContext context { lanes, block, block_index * LANE_BLOCK };
+            std::uint64_t executed = 0;
+
+            // Lanes past lane_count only pad out the last block
+            LaneMask16 valid {};
+            for (int lane = 0; lane < LANE_BLOCK; lane++) {
+                valid[lane] = context.first_lane + lane < lanes.lane_count ? -1 : 0;
+            }
+            LaneMask8 running = equal(block.paused, LaneBytes {});
+            valid &= widen(running);
+            if (!any(valid)) {
+                return 0;
+            }
+
+            // The timers count down at 60 Hz, once per frame
+            block.delay_timer -= to_flag(not_equal(block.delay_timer, LaneBytes {}) & running);
+            block.sound_timer -= to_flag(not_equal(block.sound_timer, LaneBytes {}) & running);
+            block.waiting_for_vblank = select(running, (LaneBytes) {}, block.waiting_for_vblank);
+
+            // Each lane's cycle count goes up by the steps it took part in, added up whenever the set changes
+            LaneMask16 counting {};
+            LaneBits counting_bits = 0;
+            std::uint32_t steps = 0;
+            auto count_steps = [&] {
+                block.cycles += (LaneCounts) __builtin_convertvector(counting, LaneMask32) & steps;
+                steps = 0;
+            };
+
+            /*
+                Every lane runs cycles instructions, but not necessarily in the same steps. Once lanes
+                split up, only those furthest behind (at the lowest PC) run, so the rest wait for them
+                and the block runs in lockstep again, as a branch skipping one instruction would
+                otherwise put lanes out of step for good. Counts left are kept in 16 bits, so a long
+                frame is run in pieces.
+            */
+            for (unsigned int started = 0; started < cycles; started += MAX_LANE_RUN) {
+                LaneWords left = (LaneWords) {} + static_cast<std::uint16_t>(std::min(cycles - started, MAX_LANE_RUN));
+                for (;;) {
+                    LaneMask16 active = valid & not_equal(left, LaneWords {})
+                                      & widen(equal(block.fault, LaneBytes {}) & equal(block.waiting_for_vblank, LaneBytes {}));
+                    LaneBits active_bits = lane_bits(active);
+                    if (active_bits == 0) {
+                        break;
+                    }
+
+                    // A lane with its PC off the end faults, taking a cycle as in the interpreter
+                    LaneMask16 out_of_range = active & greater_equal(block.program_counter, (LaneWords) {} + Q::memory_size);
+                    if (any(out_of_range)) {
+                        block.fault = select(narrow(out_of_range), (LaneBytes) {} + static_cast<std::uint8_t>(Fault::pc_out_of_range), block.fault);
+                        block.cycles += (LaneCounts) __builtin_convertvector(out_of_range, LaneMask32) & 1;
+                        continue;
+                    }
+
+                    std::uint16_t pc = block.program_counter[std::countr_zero(active_bits)];
+                    LaneMask16 group = active & equal(block.program_counter, (LaneWords) {} + pc);
+                    LaneBits group_bits = lane_bits(group);
+                    if (group_bits != active_bits) {
+                        for_each_bit(active_bits & ~group_bits, [&](int lane) { pc = std::min(pc, block.program_counter[lane]); });
+                        group = active & equal(block.program_counter, (LaneWords) {} + pc);
+                        group_bits = lane_bits(group);
+                    }
+
+                    if (group_bits != counting_bits) {
+                        count_steps();
+                        counting = group;
+                        counting_bits = group_bits;
+                    }
+                    steps++;
+                    left += (LaneWords) group;  // The mask is -1 in the group
+                    executed += static_cast<unsigned int>(std::popcount(group_bits));
+                    block.program_counter = select(group, block.program_counter + 2, block.program_counter);
+
+                    // While no lane of the block has stored to the code, they all run the ROM's instruction
+                    const std::uint16_t second_byte = (pc + 1) & (Q::memory_size - 1);
+                    if ((block.written_pages & (written_page(pc) | written_page(second_byte))) == 0) {
+                        const std::uint8_t *code = lanes.initial_memory.data();
+                        execute_group<Q>(context, static_cast<std::uint16_t>(code[pc] << 8 | code[second_byte]), group);
+                        continue;
+                    }
+
+                    // Otherwise each lane reads its own copy, and every distinct opcode runs once, masked to its lanes
+                    LaneWords instructions {};
+                    for_each_bit(group_bits, [&](int lane) {
+                        const std::uint8_t *memory = context.memory(lane);
+                        instructions[lane] = static_cast<std::uint16_t>(memory[pc] << 8 | memory[second_byte]);
+                    });
+                    for (LaneBits remaining_bits = group_bits; remaining_bits != 0; ) {
+                        std::uint16_t instruction = instructions[std::countr_zero(remaining_bits)];
+                        LaneMask16 same = group & equal(instructions, (LaneWords) {} + instruction);
+                        group &= ~same;
+                        remaining_bits &= ~lane_bits(same);
+                        execute_group<Q>(context, instruction, same);
+                    }
+                }
+            }
+            count_steps();
+
+            return executed;
+        }
+    }
+
+    bool reset_lanes(Lanes &lanes, Platform platform, std::size_t lane_count, const uint8_t *rom, size_t size,
+                     std::uint64_t seed)
+    {
+        if (platform == Platform::xochip) {
+            return false;
+        }
+
+        // Build one machine the usual way and copy it into every lane
+        Machine machine;
+        reset(machine, platform);
+        if (!load_rom(machine, rom, size)) {
+            return false;
+        }
+
+        std::size_t block_count = (lane_count + LANE_BLOCK - 1) / LANE_BLOCK;
+
+        lanes.platform = platform;
+        lanes.lane_count = lane_count;
+        lanes.memory_size = static_cast<std::size_t>(get_memory_size(machine));
+        lanes.memory_stride = lanes.memory_size + LANE_MEMORY_PADDING;
+        lanes.seed = seed;
+        lanes.blocks.assign(block_count, LaneBlock {});
+        lanes.planes.assign(lane_count, Plane {});
+        lanes.pending_key.assign(lane_count, -1);
+
+        const std::uint8_t *image = get_memory_buffer(machine);
+        lanes.initial_memory.assign(image, image + lanes.memory_size);
+        lanes.memory.assign(lane_count * lanes.memory_stride, 0);
+        for (std::size_t lane = 0; lane < lane_count; lane++) {
+            std::memcpy(lanes.memory.data() + lane * lanes.memory_stride, lanes.initial_memory.data(), lanes.memory_size);
+        }
+
+        for (auto &block : lanes.blocks) {
+            block.program_counter = (LaneWords) {} + PROGRAM_START_ADDRESS;
+        }
+        for (std::size_t lane = 0; lane < lanes.blocks.size() * LANE_BLOCK; lane++) {
+            lanes.blocks[lane / LANE_BLOCK].random_state[lane % LANE_BLOCK] = random_state_for_seed(seed + lane);
+        }
+
+        return true;
+    }
+
+    void reset_lane(Lanes &lanes, std::size_t lane)
+    {
+        LaneBlock &block = lanes.blocks[lane / LANE_BLOCK];
+        const int index = static_cast<int>(lane % LANE_BLOCK);
+
+        block.program_counter[index] = PROGRAM_START_ADDRESS;
+        block.i_register[index] = 0;
+        block.keys[index] = 0;
+        for (auto &reg : block.registers) reg[index] = 0;
+        block.delay_timer[index] = 0;
+        block.sound_timer[index] = 0;
+        block.stack_pointer[index] = 0;
+        block.fault[index] = 0;
+        block.waiting_for_vblank[index] = 0;
+        block.paused[index] = 0;
+        for (auto &level : block.stack) level[index] = 0;
+        block.cycles[index] = 0;
+
+        lanes.planes[lane].fill(0);
+        lanes.pending_key[lane] = -1;
+        std::memcpy(lanes.memory.data() + lane * lanes.memory_stride, lanes.initial_memory.data(), lanes.memory_size);
+    }
+
+    std::uint64_t run_lanes_frame(Lanes &lanes, unsigned int cycles)
+    {
+        return with_quirks(lanes.platform, [&](auto quirks) -> std::uint64_t {
+            using Q = decltype(quirks);
+            if constexpr (Q::xochip_opcodes) {
+                return 0;
+            } else {
+                std::uint64_t executed = 0;
+                for (std::size_t block = 0; block < lanes.blocks.size(); block++) {
+                    executed += run_block<Q>(lanes, block, cycles);
+                }
+                return executed;
+            }
+        });
+    }
+
+    void set_lane_keys(Lanes &lanes, std::size_t lane, std::uint16_t keys)
+    {
+        lanes.blocks[lane / LANE_BLOCK].keys[lane % LANE_BLOCK] = keys;
+    }
+
+    void set_lane_paused(Lanes &lanes, std::size_t lane, bool paused)
+    {
+        lanes.blocks[lane / LANE_BLOCK].paused[lane % LANE_BLOCK] = paused ? 1 : 0;
+    }
+
+    Fault get_lane_fault(const Lanes &lanes, std::size_t lane)
+    {
+        return static_cast<Fault>(lanes.blocks[lane / LANE_BLOCK].fault[lane % LANE_BLOCK]);
+    }
+
+    const Plane &get_lane_display(const Lanes &lanes, std::size_t lane)
+    {
+        return lanes.planes[lane];
+    }
+
+    const std::uint8_t *get_lane_memory(const Lanes &lanes, std::size_t lane)
+    {
+        return lanes.memory.data() + lane * lanes.memory_stride;
+    }
+
+    void extract_lane(const Lanes &lanes, std::size_t lane, Machine &machine)
+    {
+        const LaneBlock &block = lanes.blocks[lane / LANE_BLOCK];
+        const int index = static_cast<int>(lane % LANE_BLOCK);
+
+        reset(machine, lanes.platform);
+        machine.program_counter = block.program_counter[index];
+        machine.i_register = block.i_register[index];
+        machine.delay_timer = block.delay_timer[index];
+        machine.sound_timer = block.sound_timer[index];
+        machine.global_cycle_number = block.cycles[index];
+        machine.random_seed = lanes.seed + lane;
+        machine.random_state = block.random_state[index];
+        machine.waiting_for_vblank = block.waiting_for_vblank[index] != 0;
+        machine.keys = block.keys[index];
+        machine.pending_key = lanes.pending_key[lane];
+        machine.fault = static_cast<Fault>(block.fault[index]);
+
+        for (int reg = 0; reg < 16; reg++) {
+            machine.registers[reg] = block.registers[reg][index];
+        }
+        machine.stack_pointer = block.stack_pointer[index];
+        for (int level = 0; level < MAX_STACK_DEPTH; level++) {
+            machine.stack[level] = block.stack[level][index];
+        }
+
+        machine.planes.edit(0) = lanes.planes[lane];
+        std::memcpy(get_memory_buffer(machine), get_lane_memory(lanes, lane), lanes.memory_size);
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "chip8.h"
+
+namespace chip8 {
+    /*
+        Lockstep engine for running many copies of one ROM with different inputs. Machine state is
+        kept as structure-of-arrays in blocks of LANE_BLOCK lanes. Every step, the lanes of a block
+        at one PC execute its instruction together as vector operations masked to those lanes. When
+        lanes are at different PCs, those at the lowest go first, so the others wait for them and the
+        block falls back into lockstep. Every lane still runs its full count of instructions a frame.
+        Memory and sprite work stays per lane.
+
+        The vector types use the GCC/Clang vector extensions, so the width of the generated code
+        follows the target (SSE2, AVX2 or AVX-512). Only the 4 KB platforms are supported.
+    */
+    inline constexpr int LANE_BLOCK = 32;
+
+    using LaneBytes = std::uint8_t __attribute__((vector_size(LANE_BLOCK)));
+    using LaneWords = std::uint16_t __attribute__((vector_size(LANE_BLOCK * 2)));
+    using LaneCounts = std::uint32_t __attribute__((vector_size(LANE_BLOCK * 4)));
+
+    struct LaneBlock {
+        LaneWords program_counter;
+        LaneWords i_register;
+        LaneWords keys;
+        std::array<LaneBytes, 16> registers;
+        LaneBytes delay_timer;
+        LaneBytes sound_timer;
+        LaneBytes stack_pointer;
+        LaneBytes fault;               // A Fault per lane
+        LaneBytes waiting_for_vblank;
+        LaneBytes paused;              // Nonzero lanes sit out frames entirely, see set_lane_paused
+        std::array<LaneWords, MAX_STACK_DEPTH> stack;
+        LaneCounts cycles;             // Instructions executed by each lane
+        LaneCounts random_state;       // Cxkk generator per lane, as in Machine
+        std::uint64_t written_pages;   // Bit n: some lane stored to bytes 64n to 64n + 63 of its memory
+    };
+
+    struct Lanes {
+        Platform platform = Platform::modern;
+        std::size_t lane_count = 0;
+        std::size_t memory_size = 0;
+        std::size_t memory_stride = 0;        // Bytes from one lane's memory to the next, see get_lane_memory
+        std::uint64_t seed = 0;               // Lane n draws random numbers like a machine seeded with seed + n
+
+        std::vector<LaneBlock> blocks;
+        std::vector<std::uint8_t> memory;     // memory_size bytes per lane, memory_stride apart
+        std::vector<Plane> planes;            // Classic platforms only draw to the first plane
+        std::vector<std::int8_t> pending_key; // Fx0A state per lane
+        std::vector<std::uint8_t> initial_memory; // Fonts and ROM, for resetting single lanes
+    };
+
+    // Start lane_count copies of a ROM. Returns false for XO-CHIP or a ROM that does not fit.
+    bool reset_lanes(Lanes &lanes, Platform platform, std::size_t lane_count, const uint8_t *rom, size_t size,
+                     std::uint64_t seed = 0);
+
+    // Put one lane back to the state reset_lanes left it in, leaving the others running. The lane's
+    // random sequence carries on rather than restarting, so successive episodes differ.
+    void reset_lane(Lanes &lanes, std::size_t lane);
+
+    // Run one 60 Hz frame on every lane, up to cycles instructions each. Returns the instructions executed.
+    std::uint64_t run_lanes_frame(Lanes &lanes, unsigned int cycles);
+
+    void set_lane_keys(Lanes &lanes, std::size_t lane, std::uint16_t keys);
+
+    // A paused lane neither executes nor ticks its timers until it is unpaused or reset
+    void set_lane_paused(Lanes &lanes, std::size_t lane, bool paused);
+
+    Fault get_lane_fault(const Lanes &lanes, std::size_t lane);
+
+    const Plane &get_lane_display(const Lanes &lanes, std::size_t lane);
+
+    // Lane memory is read-only outside the engine, which fetches unmodified code once per block
+    const std::uint8_t *get_lane_memory(const Lanes &lanes, std::size_t lane);
+
+    // Copy one lane out into an ordinary machine, e.g. to compare it with the interpreter
+    void extract_lane(const Lanes &lanes, std::size_t lane, Machine &machine);
+}
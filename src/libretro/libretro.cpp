@@ -19,6 +19,8 @@ along with emu-chip8. If not, see <http://www.gnu.org/licenses/>.
 // Includes
 #include <cstdint>
 #include <cstring>
+#include <ctime>
+#include <optional>
 
 #if _MSC_VER >= 1910 && !__INTEL_COMPILER
 #include "win32.h"
@@ -26,10 +28,29 @@ along with emu-chip8. If not, see <http://www.gnu.org/licenses/>.
 
 #include "libretro.h"
 #include "../chip8.h"   
+#include "../romdb.h"
 
-constexpr int CYCLES_PER_FRAME = 700;
+// From newer versions of libretro.h
+#ifndef RETRO_ENVIRONMENT_SET_SERIALIZATION_QUIRKS
+#define RETRO_ENVIRONMENT_SET_SERIALIZATION_QUIRKS 44
+#endif
+
+// Roughly 700 instructions per second, for ROMs missing from the database
+constexpr int CYCLES_PER_FRAME = 700 / 60;
 unsigned long cycles_per_frame = CYCLES_PER_FRAME;
 
+static chip8::KeyMap keymap = chip8::DEFAULT_KEYMAP;
+
+static chip8::Machine machine;
+static chip8::Framebuffer framebuffer;
+static chip8::Fault reported_fault = chip8::Fault::none;
+
+// Netplay desync checks, see get_log_state_hash_option()
+static bool log_state_hash = false;
+static chip8::StateHash state_hash;
+// Set once the frontend has the RAM pointer. Its writes bypass the dirty bits the hash relies on.
+static bool memory_handed_out = false;
+
 // Callbacks
 static retro_log_printf_t log_cb;
 static retro_video_refresh_t video_cb;
@@ -41,6 +62,58 @@ static retro_audio_sample_batch_t audio_batch_cb;
 
 unsigned retro_api_version(void) { return RETRO_API_VERSION; }
 
+// Core options
+// Returns nothing when the platform is left on Auto, so the ROM database decides
+static std::optional<chip8::Platform> get_platform_option()
+{
+    struct retro_variable var = { "emuchip8_platform", nullptr };
+
+    if (!environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) || !var.value) {
+        return std::nullopt;
+    }
+
+    if (std::strcmp(var.value, "Modern") == 0) return chip8::Platform::modern;
+    if (std::strcmp(var.value, "COSMAC VIP") == 0) return chip8::Platform::cosmac_vip;
+    if (std::strcmp(var.value, "SCHIP 1.1") == 0) return chip8::Platform::schip;
+    if (std::strcmp(var.value, "XO-CHIP") == 0) return chip8::Platform::xochip;
+
+    return std::nullopt;
+}
+
+// By default every session draws the same random numbers, so recorded inputs replay the same way.
+// Per session gives each game a new seed; netplay still stays in sync, since save states carry the generator.
+static std::uint64_t get_random_seed()
+{
+    struct retro_variable var = { "emuchip8_random_seed", nullptr };
+
+    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && std::strcmp(var.value, "Per session") == 0) {
+        return static_cast<std::uint64_t>(std::time(nullptr));
+    }
+
+    return 0;
+}
+
+// Log a hash of the whole machine every frame, so netplay peers can compare logs to find the
+// frame they diverged on. Lines are keyed by the cycle count, which rollbacks restore along with the state.
+static bool get_log_state_hash_option()
+{
+    struct retro_variable var = { "emuchip8_state_hash", nullptr };
+
+    return environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && std::strcmp(var.value, "On") == 0;
+}
+
+// RetroPad button ids, in the order of chip8::Button
+static constexpr unsigned BUTTON_IDS[chip8::BUTTON_COUNT] = {
+    RETRO_DEVICE_ID_JOYPAD_UP, RETRO_DEVICE_ID_JOYPAD_DOWN, RETRO_DEVICE_ID_JOYPAD_LEFT, RETRO_DEVICE_ID_JOYPAD_RIGHT,
+    RETRO_DEVICE_ID_JOYPAD_A, RETRO_DEVICE_ID_JOYPAD_B, RETRO_DEVICE_ID_JOYPAD_X, RETRO_DEVICE_ID_JOYPAD_Y,
+    RETRO_DEVICE_ID_JOYPAD_L, RETRO_DEVICE_ID_JOYPAD_R, RETRO_DEVICE_ID_JOYPAD_SELECT, RETRO_DEVICE_ID_JOYPAD_START,
+};
+
+static const char *KEY_NAMES[16] = {
+    "Key 0", "Key 1", "Key 2", "Key 3", "Key 4", "Key 5", "Key 6", "Key 7",
+    "Key 8", "Key 9", "Key A", "Key B", "Key C", "Key D", "Key E", "Key F",
+};
+
 // Cheats
 void retro_cheat_reset(void) {}
 void retro_cheat_set([[maybe_unused]] unsigned index, [[maybe_unused]] bool enabled, [[maybe_unused]] const char *code) {
@@ -49,38 +122,40 @@ void retro_cheat_set([[maybe_unused]] unsigned index, [[maybe_unused]] bool enab
 // Load a cartridge
 bool retro_load_game(const struct retro_game_info *info)
 {
-    // Set the controller descriptor
-    struct retro_input_descriptor desc[] = {
-            { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT,  "Left" },
-            { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP,    "Up" },
-            { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_DOWN,  "Down" },
-            { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_RIGHT, "Right" },
-            { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_A,     "1" },
-            { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_B,     "2" },
-            { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_X,     "3" },
-            { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_Y,     "4" },
-            { 0, RETRO_DEVICE_ANALOG, RETRO_DEVICE_INDEX_ANALOG_LEFT, RETRO_DEVICE_ID_ANALOG_X,  "Analog X" },
-            { 0, RETRO_DEVICE_ANALOG, RETRO_DEVICE_INDEX_ANALOG_LEFT, RETRO_DEVICE_ID_ANALOG_Y,  "Analog Y" },
-
-            { 1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT,  "Left" },
-            { 1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP,    "Up" },
-            { 1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_DOWN,  "Down" },
-            { 1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_RIGHT, "Right" },
-            { 1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_A,     "1" },
-            { 1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_B,     "2" },
-            { 1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_X,     "3" },
-            { 1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_Y,     "4" },
-            { 1, RETRO_DEVICE_ANALOG, RETRO_DEVICE_INDEX_ANALOG_LEFT, RETRO_DEVICE_ID_ANALOG_X,  "Analog X" },
-            { 1, RETRO_DEVICE_ANALOG, RETRO_DEVICE_INDEX_ANALOG_LEFT, RETRO_DEVICE_ID_ANALOG_Y,  "Analog Y" },
-            { 1, RETRO_DEVICE_NONE, 0, 0,  nullptr },
-    };
+    const chip8::RomInfo *rom = nullptr;
+    if (info && info->data) {
+        rom = chip8::identify_rom((const uint8_t*) info->data, info->size);
+    }
+
+    if (rom && log_cb) {
+        log_cb(RETRO_LOG_INFO, "Identified ROM: %s\n", rom->title);
+    }
+
+    // The core option wins over the database, and the database over the defaults
+    chip8::Platform platform = get_platform_option().value_or(rom ? rom->platform : chip8::Platform::modern);
+    cycles_per_frame = rom ? rom->cycles_per_frame : CYCLES_PER_FRAME;
+    keymap = rom ? rom->keymap : chip8::DEFAULT_KEYMAP;
+
+    // Set the controller descriptor from the key mapping
+    struct retro_input_descriptor desc[chip8::BUTTON_COUNT + 1] = {};
+    unsigned int mapped = 0;
+    for (unsigned int button = 0; button < chip8::BUTTON_COUNT; button++) {
+        if (keymap[button] == chip8::NO_KEY) continue;
+        desc[mapped++] = { 0, RETRO_DEVICE_JOYPAD, 0, BUTTON_IDS[button], KEY_NAMES[keymap[button]] };
+    }
+    desc[mapped] = { 0, RETRO_DEVICE_NONE, 0, 0, nullptr };
 
     environ_cb(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, desc);
 
-    chip8::reset();
+    chip8::seed_random(machine, get_random_seed());
+    chip8::reset(machine, platform);
+    log_state_hash = get_log_state_hash_option();
 
     if (info && info->data) { // ensure there is ROM data
-        chip8::load_rom((const  uint8_t*) info->data, info->size);
+        if (!chip8::load_rom(machine, (const  uint8_t*) info->data, info->size)) {
+            if (log_cb) log_cb(RETRO_LOG_ERROR, "Could not load ROM: %s\n", chip8::describe_fault(chip8::get_fault(machine)));
+            return false;
+        }
     }
 
     return true;
@@ -89,7 +164,7 @@ bool retro_load_game(const struct retro_game_info *info)
 bool retro_load_game_special([[maybe_unused]] unsigned game_type, [[maybe_unused]] const struct retro_game_info *info, [[maybe_unused]] size_t num_info) { return false; }
 
 // Unload the cartridge
-void retro_unload_game(void) { chip8::unload_rom(); }
+void retro_unload_game(void) { chip8::unload_rom(machine); }
 
 unsigned retro_get_region(void) { return RETRO_REGION_PAL; }
 
@@ -100,7 +175,8 @@ void retro_set_controller_port_device([[maybe_unused]] unsigned port, [[maybe_un
 void *retro_get_memory_data(unsigned id)
 { 
     if (id == RETRO_MEMORY_SYSTEM_RAM) {
-        return chip8::get_memory_buffer();
+        memory_handed_out = true;
+        return chip8::get_memory_buffer(machine);
     }
 
     return nullptr;
@@ -109,16 +185,16 @@ void *retro_get_memory_data(unsigned id)
 size_t retro_get_memory_size(unsigned id)
 {
     if (id == RETRO_MEMORY_SYSTEM_RAM) {
-        return (size_t) chip8::get_memory_size();
+        return (size_t) chip8::get_memory_size(machine);
     }
 
     return 0; 
 }
 
 // Serialisation methods
-size_t retro_serialize_size(void) { return 0; }
-bool retro_serialize([[maybe_unused]] void *data, [[maybe_unused]] size_t size) { return false; }
-bool retro_unserialize([[maybe_unused]] const void *data, [[maybe_unused]] size_t size) { return false; }
+size_t retro_serialize_size(void) { return chip8::get_state_size(machine); }
+bool retro_serialize(void *data, size_t size) { return chip8::save_state(machine, (uint8_t*) data, size); }
+bool retro_unserialize(const void *data, size_t size) { return chip8::load_state(machine, (const uint8_t*) data, size); }
 
 // End of retrolib
 void retro_deinit(void) { }
@@ -128,6 +204,9 @@ void retro_set_environment(retro_environment_t cb) {
   environ_cb = cb;
 
   struct retro_variable variables[] = {
+      { "emuchip8_platform", "Platform (restart); Auto|Modern|COSMAC VIP|SCHIP 1.1|XO-CHIP" },
+      { "emuchip8_random_seed", "Random numbers (restart); Fixed|Per session" },
+      { "emuchip8_state_hash", "Log state hash every frame (restart); Off|On" },
       { NULL, NULL },
   };
 
@@ -156,7 +235,11 @@ void retro_init(void)
     // the performance level is guide to frontend to give an idea of how intensive this core is to run
     environ_cb(RETRO_ENVIRONMENT_SET_PERFORMANCE_LEVEL, &level);
 
-    chip8::startup();
+    chip8::reset(machine, chip8::Platform::modern);
+
+    // States are complete, fixed in size for a loaded game and little endian on every host
+    std::uint64_t quirks = 0;
+    environ_cb(RETRO_ENVIRONMENT_SET_SERIALIZATION_QUIRKS, &quirks);
 }
 
 
@@ -169,7 +252,7 @@ void retro_get_system_info(struct retro_system_info *info)
     info->library_name = chip8::get_lib_name();
     info->library_version = chip8::get_lib_version();
     info->need_fullpath = false;
-    info->valid_extensions = "ch8";
+    info->valid_extensions = "ch8|xo8";
 }
 
 /*
@@ -194,14 +277,41 @@ void retro_get_system_av_info(struct retro_system_av_info *info) {
 
 void retro_reset(void)
 {
-    chip8::reset();
+    chip8::reset(machine, machine.platform);
 }
 
 // Run a single frame with our chip8 emulator
 void retro_run(void)
 {
-    chip8::fetch_decode_execute(10u);
-    
-    video_cb(chip8::get_video_buffer().begin(),
+    input_poll_cb();
+
+    std::uint16_t keys = 0;
+    for (unsigned int button = 0; button < chip8::BUTTON_COUNT; button++) {
+        if (keymap[button] != chip8::NO_KEY && input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, BUTTON_IDS[button])) {
+            keys |= static_cast<std::uint16_t>(1u << keymap[button]);
+        }
+    }
+    machine.keys = keys;
+
+    chip8::run_frame(machine, cycles_per_frame);
+
+    // A faulted machine stays halted, only report it once
+    if (chip8::get_fault(machine) != reported_fault) {
+        reported_fault = chip8::get_fault(machine);
+        if (reported_fault != chip8::Fault::none && log_cb) {
+            log_cb(RETRO_LOG_ERROR, "Machine halted at 0x%04x: %s\n", machine.program_counter, chip8::describe_fault(reported_fault));
+        }
+    }
+
+    if (log_state_hash && log_cb) {
+        if (memory_handed_out) {
+            machine.memory.mark_all_dirty();
+        }
+        log_cb(RETRO_LOG_DEBUG, "cycle %u state %016llx\n", machine.global_cycle_number,
+               static_cast<unsigned long long>(chip8::update_state_hash(machine, state_hash)));
+    }
+
+    chip8::get_video_buffer(machine, framebuffer);
+    video_cb(framebuffer.data(),
         chip8::SCREEN_WIDTH, chip8::SCREEN_HEIGHT, sizeof(uint16_t) * chip8::SCREEN_WIDTH);
 }
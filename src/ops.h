@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include "chip8.h"
+
+// Instruction semantics shared by the interpreter and the lane engine
+namespace chip8 {
+    /*
+        The first CHIP-8 interpreter (on the COSMAC VIP computer) was also located in RAM, from address 000 to 1FF. 
+        It would expect a CHIP-8 program to be loaded into memory after it, starting at address 0x200
+    */
+    inline constexpr uint16_t PROGRAM_START_ADDRESS = 0x200;
+
+    //  For some reason, it’s become popular to put fonts at 050–09F. We will follow this "convention".
+    inline constexpr uint16_t FONT_START_ADDRESS = 0x50;
+
+    // Cxkk draws from a xorshift32 generator kept in each machine, so a run repeats exactly for the
+    // same seed. The state must never be zero; seeds are mixed with the splitmix64 finalizer first.
+    inline std::uint32_t random_state_for_seed(std::uint64_t seed)
+    {
+        seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ull;
+        seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBull;
+        seed ^= seed >> 31;
+        std::uint32_t state = static_cast<std::uint32_t>(seed ^ (seed >> 32));
+        return state ? state : 1;
+    }
+
+    // Works on a single state or, in the lane engine, a vector of them. The top byte is the random byte.
+    template <typename T>
+    inline T next_random(T state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // XOR a sprite into one plane, wrapping around or clipping at the screen edges depending on the quirk.
+    // Returns whether any lit pixel was erased.
+    // read_memory(address) returns the byte at an address, wrapped to the platform's memory size.
+    template <typename Q, typename ReadMemory>
+    inline bool draw_sprite(Plane &plane, ReadMemory &&read_memory, std::uint16_t address,
+                            std::uint8_t x, std::uint8_t y, unsigned int rows, bool wide)
+    {
+        bool collision = false;
+
+        // The starting position always wraps, only the sprite's pixels may be clipped
+        x %= SCREEN_WIDTH;
+        y %= SCREEN_HEIGHT;
+
+        if constexpr (!Q::sprites_wrap) {
+            rows = std::min(rows, static_cast<unsigned int>(SCREEN_HEIGHT - y));
+        }
+
+        // 0,0 coords are at the top left of the screen
+        for (unsigned int i=0; i<rows; i++) {
+            PlaneRow sprite;
+            if (wide) {
+                sprite = static_cast<PlaneRow>(read_memory(address + 2*i)) << 56
+                       | static_cast<PlaneRow>(read_memory(address + 2*i + 1)) << 48;
+            } else {
+                sprite = static_cast<PlaneRow>(read_memory(address + i)) << 56;
+            }
+
+            PlaneRow bits;
+            if constexpr (Q::sprites_wrap) {
+                bits = std::rotr(sprite, x);
+            } else {
+                bits = sprite >> x;
+            }
+            PlaneRow &row = plane[(y + i) % SCREEN_HEIGHT];
+
+            collision |= (row & bits) != 0;
+            row ^= bits;
+        }
+
+        return collision;
+    }
+}
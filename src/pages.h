@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace chip8 {
+    // Granularity of copy-on-write for machine memory. Each display plane is a page of its own.
+    inline constexpr std::size_t PAGE_SIZE = 256;
+
+    // Enough for XO-CHIP's 64 KB of memory
+    inline constexpr std::size_t MAX_PAGES = 256;
+
+    // Heap memory held by one or more page arrays, see get_memory_usage()
+    struct MemoryUsage {
+        std::size_t private_bytes = 0;      // Blocks nothing else uses
+        std::size_t shared_bytes = 0;       // Blocks also used by other machines or ROM images
+        double proportional_bytes = 0;      // Private bytes plus each shared block split evenly between its users
+        std::size_t overhead_bytes = 0;     // Page tables and the machine itself
+    };
+
+    /*
+        An array of pages that is copied lazily. Copying the array shares every page, and a page is
+        only duplicated when one of the arrays sharing it is about to write to it.
+
+        Pages live in reference-counted blocks: a freshly made array is one contiguous block, and
+        pages split off by a write get a block of their own. Each array holds one reference to every
+        block it uses, so a copy costs one count increment per block rather than per page, and a
+        block counts as shared while more than one array uses it. Counts are atomic, so copies of one
+        array may be used and destroyed on different threads; a single array is not thread-safe.
+
+        Every page handed out by edit() is marked dirty until clear_dirty(), so callers can redo work
+        for changed pages only. Copying, moving or assigning marks every page of the target dirty.
+    */
+    template <typename Page>
+    class SharedPages {
+        static_assert(std::is_trivially_destructible_v<Page>);
+
+    public:
+        SharedPages() = default;
+
+        // count zeroed pages in one block, at most MAX_PAGES
+        explicit SharedPages(std::size_t count)
+        {
+            if (count > MAX_PAGES) {
+                throw std::length_error("too many pages");
+            }
+            Block *block = allocate_block(count);
+            blocks.push_back(block);
+            entries.resize(count);
+            for (std::size_t i = 0; i < count; i++) {
+                entries[i] = { &block->pages()[i], block };
+            }
+            mark_all_dirty();
+        }
+
+        SharedPages(const SharedPages &other) : entries(other.entries), blocks(other.blocks)
+        {
+            for (Block *block : blocks) {
+                block->references.fetch_add(1, std::memory_order_relaxed);
+            }
+            mark_all_dirty();
+        }
+
+        SharedPages(SharedPages &&other) noexcept
+            : entries(std::exchange(other.entries, {})), blocks(std::exchange(other.blocks, {}))
+        {
+            mark_all_dirty();
+        }
+
+        SharedPages &operator=(SharedPages other) noexcept
+        {
+            entries.swap(other.entries);
+            blocks.swap(other.blocks);
+            mark_all_dirty();
+            return *this;
+        }
+
+        ~SharedPages()
+        {
+            for (Block *block : blocks) {
+                release(block);
+            }
+        }
+
+        std::size_t size() const { return entries.size(); }
+
+        const Page &operator[](std::size_t index) const { return *entries[index].page; }
+
+        // A page that is safe to modify, copying it first if it is shared
+        Page &edit(std::size_t index)
+        {
+            Entry &entry = entries[index];
+            if (entry.block->references.load(std::memory_order_acquire) != 1) [[unlikely]] {
+                detach(entry);
+            }
+            dirty[index / 64] |= std::uint64_t { 1 } << (index % 64);
+            return *entry.page;
+        }
+
+        // Call f(index) for every dirty page, in order
+        template <typename F>
+        void for_each_dirty(F &&f) const
+        {
+            for (std::size_t word = 0; word * 64 < entries.size(); word++) {
+                for (std::uint64_t bits = dirty[word]; bits != 0; bits &= bits - 1) {
+                    std::size_t index = word * 64 + static_cast<std::size_t>(std::countr_zero(bits));
+                    if (index < entries.size()) {
+                        f(index);
+                    }
+                }
+            }
+        }
+
+        void clear_dirty()
+        {
+            dirty.fill(0);
+        }
+
+        // For writes that bypass edit(), e.g. through the buffer flatten() returns
+        void mark_all_dirty()
+        {
+            dirty.fill(~std::uint64_t { 0 });
+        }
+
+        bool is_shared(std::size_t index) const
+        {
+            return entries[index].block->references.load(std::memory_order_relaxed) != 1;
+        }
+
+        // Whether the pages are private and in one block, as flatten() leaves them
+        bool is_flat() const
+        {
+            if (blocks.size() != 1 || is_shared(0)) {
+                return false;
+            }
+            for (std::size_t i = 0; i < entries.size(); i++) {
+                if (entries[i].page != &blocks.front()->pages()[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Whole blocks are counted, including pages a write has since split off
+        void add_usage(MemoryUsage &usage) const
+        {
+            for (const Block *block : blocks) {
+                std::size_t bytes = sizeof(Block) + block->page_count * sizeof(Page);
+                std::uint32_t users = block->references.load(std::memory_order_relaxed);
+                if (users == 1) {
+                    usage.private_bytes += bytes;
+                } else {
+                    usage.shared_bytes += bytes;
+                }
+                usage.proportional_bytes += static_cast<double>(bytes) / users;
+            }
+            usage.overhead_bytes += entries.capacity() * sizeof(Entry) + blocks.capacity() * sizeof(Block *);
+        }
+
+        // Make every page private and contiguous, for callers that need one flat buffer. Writing
+        // through the result is only safe until the array is copied, assigned to or destroyed.
+        Page *flatten()
+        {
+            if (entries.empty()) {
+                return nullptr;
+            }
+
+            if (is_flat()) {
+                return blocks.front()->pages();
+            }
+
+            Block *block = allocate_block(entries.size());
+            for (std::size_t i = 0; i < entries.size(); i++) {
+                block->pages()[i] = *entries[i].page;
+                entries[i] = { &block->pages()[i], block };
+            }
+            for (Block *old : blocks) {
+                release(old);
+            }
+            blocks.assign(1, block);
+            return block->pages();
+        }
+
+    private:
+        static constexpr std::size_t BLOCK_ALIGNMENT = 64;
+
+        // Header of a single allocation holding the pages after it
+        struct alignas(BLOCK_ALIGNMENT) Block {
+            std::atomic<std::uint32_t> references;       // Arrays using any page of the block
+            std::uint32_t page_count;
+
+            Page *pages() { return reinterpret_cast<Page *>(this + 1); }
+        };
+
+        struct Entry {
+            Page *page;
+            Block *block;
+        };
+
+        std::vector<Entry> entries;
+        std::vector<Block *> blocks;    // Every block the entries point into, once each
+        std::array<std::uint64_t, MAX_PAGES / 64> dirty {};    // One bit per page, kept inline so copies do not allocate
+
+        static Block *allocate_block(std::size_t count)
+        {
+            static_assert(alignof(Page) <= BLOCK_ALIGNMENT);
+
+            void *storage = ::operator new(sizeof(Block) + count * sizeof(Page), std::align_val_t { BLOCK_ALIGNMENT });
+            Block *block = new (storage) Block;
+            block->references.store(1, std::memory_order_relaxed);
+            block->page_count = static_cast<std::uint32_t>(count);
+            for (std::size_t i = 0; i < count; i++) {
+                new (&block->pages()[i]) Page {};
+            }
+            return block;
+        }
+
+        static void release(Block *block)
+        {
+            if (block->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                // Pages are trivially destructible
+                block->~Block();
+                ::operator delete(static_cast<void *>(block), std::align_val_t { BLOCK_ALIGNMENT });
+            }
+        }
+
+        // Move one page into a block of its own, and let go of the old block once no page uses it
+        void detach(Entry &entry)
+        {
+            Block *old = entry.block;
+            Block *block = allocate_block(1);
+            block->pages()[0] = *entry.page;
+            entry = { block->pages(), block };
+            blocks.push_back(block);
+
+            for (const Entry &other : entries) {
+                if (other.block == old) {
+                    return;
+                }
+            }
+            blocks.erase(std::find(blocks.begin(), blocks.end(), old));
+            release(old);
+        }
+    };
+}
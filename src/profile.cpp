@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <array>
+#include <cstdarg>
+#include <cstdio>
+#include <numeric>
+#include "cfg.h"
+#include "decode.h"
+#include "disassembler.h"
+#include "profile.h"
+#include "quirks.h"
+
+namespace chip8 {
+    namespace {
+        [[gnu::format(printf, 2, 3)]] void append(std::string &text, const char *format, ...)
+        {
+            char buffer[256];
+            va_list args;
+            va_start(args, format);
+            int length = std::vsnprintf(buffer, sizeof(buffer), format, args);
+            va_end(args);
+            text.append(buffer, static_cast<std::size_t>(std::clamp(length, 0, static_cast<int>(sizeof(buffer)) - 1)));
+        }
+
+        double percent(std::uint64_t part, std::uint64_t whole)
+        {
+            return whole == 0 ? 0.0 : 100.0 * static_cast<double>(part) / static_cast<double>(whole);
+        }
+
+        // The form text without its braces, e.g. "DRW Vx, Vy, n"
+        std::string class_name(Opcode opcode, bool jump_uses_vx)
+        {
+            if (opcode == Opcode::invalid) {
+                return "invalid or outside the ROM";
+            }
+
+            const char *text = JP_OFFSET_VX_FORM.text;
+            if (opcode != Opcode::jp_offset || !jump_uses_vx) {
+                for (const InstructionForm &form : INSTRUCTION_FORMS) {
+                    if (form.opcode == opcode) {
+                        text = form.text;
+                        break;
+                    }
+                }
+            }
+
+            std::string name;
+            for (const char *c = text; *c; c++) {
+                if (*c != '{' && *c != '}') {
+                    name += *c;
+                }
+            }
+            return name;
+        }
+
+        // One line of disassembly without its newline, or a placeholder outside the code
+        std::string disassemble_at(std::span<const std::uint8_t> code, std::uint16_t base, Platform platform, std::uint16_t address)
+        {
+            if (address < base || static_cast<std::size_t>(address - base) >= code.size()) {
+                char line[32];
+                std::snprintf(line, sizeof(line), "0x%04x  (outside the ROM)", address);
+                return line;
+            }
+
+            // The buffer holds a single line, so only one instruction is written
+            char line[MAX_DISASSEMBLY_LINE];
+            std::size_t offset = 0;
+            std::size_t length = disassemble(code.subspan(address - base), offset, address, platform, line);
+            return std::string(line, length > 0 ? length - 1 : 0);
+        }
+    }
+
+    std::uint64_t Profile::get_cycles() const
+    {
+        return std::accumulate(pc_counts.begin(), pc_counts.end(), std::uint64_t { 0 });
+    }
+
+    std::string format_profile_report(const Profile &profile, std::span<const std::uint8_t> code, std::uint16_t base,
+                                      Platform platform, std::size_t top)
+    {
+        std::string text;
+        std::uint64_t cycles = profile.get_cycles();
+
+        // Cycles per instruction class, with anything outside the code counted as invalid
+        std::array<std::uint64_t, OPCODE_COUNT> opcode_counts {};
+        with_quirks(platform, [&](auto quirks) {
+            for (std::size_t address = 0; address < profile.pc_counts.size(); address++) {
+                Opcode opcode = Opcode::invalid;
+                if (address >= base && address - base + 1 < code.size()) {
+                    opcode = decode<decltype(quirks)::xochip_opcodes>(
+                        static_cast<std::uint16_t>(code[address - base] << 8 | code[address - base + 1]));
+                }
+                opcode_counts[static_cast<std::size_t>(opcode)] += profile.pc_counts[address];
+            }
+        });
+        auto count = [&](Opcode opcode) { return opcode_counts[static_cast<std::size_t>(opcode)]; };
+
+        std::uint64_t draws = count(Opcode::drw);
+        std::uint64_t skips = count(Opcode::se_byte) + count(Opcode::sne_byte) + count(Opcode::se_reg)
+                            + count(Opcode::sne_reg) + count(Opcode::skp) + count(Opcode::sknp);
+        append(text, "cycles=%llu draws=%llu (%.1f%%) collisions=%llu (%.1f%% of draws) skips=%llu taken=%llu (%.1f%%)\n",
+               static_cast<unsigned long long>(cycles), static_cast<unsigned long long>(draws), percent(draws, cycles),
+               static_cast<unsigned long long>(profile.draw_collisions), percent(profile.draw_collisions, draws),
+               static_cast<unsigned long long>(skips), static_cast<unsigned long long>(profile.skips_taken),
+               percent(profile.skips_taken, skips));
+
+        // Instruction classes, busiest first
+        std::vector<Opcode> opcodes;
+        for (std::size_t i = 0; i < OPCODE_COUNT; i++) {
+            if (opcode_counts[i] != 0) {
+                opcodes.push_back(static_cast<Opcode>(i));
+            }
+        }
+        std::stable_sort(opcodes.begin(), opcodes.end(), [&](Opcode a, Opcode b) { return count(a) > count(b); });
+
+        text += "\ninstruction classes\n      cycles   share  class\n";
+        bool jump_uses_vx = with_quirks(platform, [](auto quirks) { return decltype(quirks)::jump_uses_vx; });
+        for (Opcode opcode : opcodes) {
+            append(text, "%12llu  %5.1f%%  %s\n", static_cast<unsigned long long>(count(opcode)),
+                   percent(count(opcode), cycles), class_name(opcode, jump_uses_vx).c_str());
+        }
+
+        // Basic blocks, busiest first, with the cycles of each instruction in them
+        ControlFlowGraph cfg = analyze_control_flow(code, base, platform);
+        std::vector<std::uint64_t> block_cycles(cfg.blocks.size());
+        std::uint64_t attributed = 0;
+        for (std::size_t i = 0; i < cfg.blocks.size(); i++) {
+            const BasicBlock &block = cfg.blocks[i];
+            block_cycles[i] = std::accumulate(profile.pc_counts.begin() + block.start, profile.pc_counts.begin() + block.end,
+                                              std::uint64_t { 0 });
+            attributed += block_cycles[i];
+        }
+
+        std::vector<std::size_t> blocks(cfg.blocks.size());
+        std::iota(blocks.begin(), blocks.end(), std::size_t { 0 });
+        std::stable_sort(blocks.begin(), blocks.end(), [&](std::size_t a, std::size_t b) { return block_cycles[a] > block_cycles[b]; });
+
+        text += "\nhottest blocks\n      cycles   share  block\n";
+        for (std::size_t i = 0; i < std::min(top, blocks.size()) && block_cycles[blocks[i]] != 0; i++) {
+            const BasicBlock &block = cfg.blocks[blocks[i]];
+            append(text, "%12llu  %5.1f%%  0x%04x-0x%04x %s\n", static_cast<unsigned long long>(block_cycles[blocks[i]]),
+                   percent(block_cycles[blocks[i]], cycles), block.start, block.end, get_block_end_name(block.kind));
+
+            for (std::uint32_t address = block.start; address < block.end; address++) {
+                if (cfg.bytes[address - base] == ByteKind::instruction) {
+                    append(text, "%12llu          %s\n", static_cast<unsigned long long>(profile.pc_counts[address]),
+                           disassemble_at(code, base, platform, static_cast<std::uint16_t>(address)).c_str());
+                }
+            }
+        }
+        // Code reached through Bnnn, modified at run time or outside the ROM
+        append(text, "%12llu  %5.1f%%  unattributed\n", static_cast<unsigned long long>(cycles - attributed),
+               percent(cycles - attributed, cycles));
+
+        // Single instructions, busiest first
+        std::vector<std::uint16_t> addresses;
+        for (std::size_t address = 0; address < profile.pc_counts.size(); address++) {
+            if (profile.pc_counts[address] != 0) {
+                addresses.push_back(static_cast<std::uint16_t>(address));
+            }
+        }
+        std::size_t shown = std::min(top, addresses.size());
+        std::partial_sort(addresses.begin(), addresses.begin() + static_cast<std::ptrdiff_t>(shown), addresses.end(),
+                          [&](std::uint16_t a, std::uint16_t b) {
+                              return profile.pc_counts[a] != profile.pc_counts[b] ? profile.pc_counts[a] > profile.pc_counts[b] : a < b;
+                          });
+
+        text += "\nhottest instructions\n      cycles   share  instruction\n";
+        for (std::size_t i = 0; i < shown; i++) {
+            std::uint64_t executed = profile.pc_counts[addresses[i]];
+            append(text, "%12llu  %5.1f%%  %s\n", static_cast<unsigned long long>(executed), percent(executed, cycles),
+                   disassemble_at(code, base, platform, addresses[i]).c_str());
+        }
+
+        return text;
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+#include "chip8.h"
+
+namespace chip8 {
+    /*
+        Execution counts gathered by the profiling variants of run_frame() and fetch_decode_execute().
+        These run a separate instantiation of the interpreter, so the plain functions do no counting
+        at all. One profile may collect over many frames, or over several machines running the same ROM.
+
+        Only the address of each instruction is counted as it runs, which keeps the overhead to one
+        increment. Instruction classes are worked out afterwards from the code at those addresses.
+    */
+    struct Profile {
+        std::vector<std::uint64_t> pc_counts = std::vector<std::uint64_t>(0x10000); // Instructions started at each address, including one that faulted
+        std::uint64_t skips_taken = 0;      // Skip instructions whose condition held
+        std::uint64_t draw_collisions = 0;  // DRW instructions that set VF
+
+        std::uint64_t get_cycles() const;
+    };
+
+    unsigned int fetch_decode_execute(Machine &machine, unsigned int cycles, Profile &profile);
+
+    unsigned int run_frame(Machine &machine, unsigned int cycles, Profile &profile);
+
+    /*
+        Text report of where the cycles went: totals with DRW and skip-taken rates, cycles per
+        instruction class, then the top hottest basic blocks and instructions, annotated with their
+        disassembly from code loaded at base. Blocks come from analyze_control_flow(); cycles at
+        addresses outside them, e.g. reached through Bnnn, are reported as unattributed. Classes
+        are decoded from code too, so code the ROM rewrites while running is counted as loaded.
+    */
+    std::string format_profile_report(const Profile &profile, std::span<const std::uint8_t> code, std::uint16_t base,
+                                      Platform platform, std::size_t top = 20);
+}
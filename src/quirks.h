@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include "chip8.h"
+
+namespace chip8 {
+    /*
+        CHIP-8 variants disagree on a handful of instructions. Each platform gets a quirk profile,
+        and the interpreter is instantiated once per profile so the choices compile away.
+    */
+    template <Platform P>
+    struct Quirks;
+
+    // What most modern interpreters (and this one, historically) do
+    template <>
+    struct Quirks<Platform::modern> {
+        static constexpr Platform platform = Platform::modern;
+        static constexpr std::size_t memory_size = 4096;
+        static constexpr bool xochip_opcodes = false;
+        static constexpr int stack_depth = 16;            // Subroutine levels, at most MAX_STACK_DEPTH
+
+        static constexpr bool shift_uses_vy = false;       // 8xy6/8xyE shift Vy instead of Vx
+        static constexpr bool load_store_increments_i = false; // Fx55/Fx65 leave I = I + x + 1
+        static constexpr bool jump_uses_vx = false;        // Bxnn jumps to xnn + Vx instead of nnn + V0
+        static constexpr bool logic_resets_vf = false;     // 8xy1/8xy2/8xy3 clear VF
+        static constexpr bool sprites_wrap = true;         // Sprites wrap around the screen edges instead of clipping
+        static constexpr bool display_wait = false;        // DRW waits for the next frame before continuing
+    };
+
+    // The original interpreter on the COSMAC VIP
+    template <>
+    struct Quirks<Platform::cosmac_vip> {
+        static constexpr Platform platform = Platform::cosmac_vip;
+        static constexpr std::size_t memory_size = 4096;
+        static constexpr bool xochip_opcodes = false;
+        static constexpr int stack_depth = 12;
+
+        static constexpr bool shift_uses_vy = true;
+        static constexpr bool load_store_increments_i = true;
+        static constexpr bool jump_uses_vx = false;
+        static constexpr bool logic_resets_vf = true;
+        static constexpr bool sprites_wrap = false;
+        static constexpr bool display_wait = true;
+    };
+
+    // SUPER-CHIP 1.1 on the HP 48
+    template <>
+    struct Quirks<Platform::schip> {
+        static constexpr Platform platform = Platform::schip;
+        static constexpr std::size_t memory_size = 4096;
+        static constexpr bool xochip_opcodes = false;
+        static constexpr int stack_depth = 16;
+
+        static constexpr bool shift_uses_vy = false;
+        static constexpr bool load_store_increments_i = false;
+        static constexpr bool jump_uses_vx = true;
+        static constexpr bool logic_resets_vf = false;
+        static constexpr bool sprites_wrap = false;
+        static constexpr bool display_wait = false;
+    };
+
+    // XO-CHIP, as implemented by Octo
+    template <>
+    struct Quirks<Platform::xochip> {
+        static constexpr Platform platform = Platform::xochip;
+        static constexpr std::size_t memory_size = 65536;
+        static constexpr bool xochip_opcodes = true;
+        static constexpr int stack_depth = 16;
+
+        static constexpr bool shift_uses_vy = true;
+        static constexpr bool load_store_increments_i = true;
+        static constexpr bool jump_uses_vx = false;
+        static constexpr bool logic_resets_vf = false;
+        static constexpr bool sprites_wrap = true;
+        static constexpr bool display_wait = false;
+    };
+
+    // Call f with the quirk profile of a platform known only at runtime
+    template <typename F>
+    decltype(auto) with_quirks(Platform platform, F &&f)
+    {
+        switch (platform) {
+            case Platform::cosmac_vip: return f(Quirks<Platform::cosmac_vip> {});
+            case Platform::schip: return f(Quirks<Platform::schip> {});
+            case Platform::xochip: return f(Quirks<Platform::xochip> {});
+            case Platform::modern: break;
+        }
+        return f(Quirks<Platform::modern> {});
+    }
+}
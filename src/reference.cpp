@@ -0,0 +1,340 @@
+#include <bit>
+#include "ops.h"
+#include "quirks.h"
+#include "reference.h"
+
+namespace chip8 {
+    namespace {
+        // The quirk profile as plain values, looked up on every instruction
+        struct RuntimeQuirks {
+            std::size_t memory_size;
+            bool xochip_opcodes;
+            int stack_depth;
+            bool shift_uses_vy;
+            bool load_store_increments_i;
+            bool jump_uses_vx;
+            bool logic_resets_vf;
+            bool sprites_wrap;
+            bool display_wait;
+        };
+
+        RuntimeQuirks get_quirks(Platform platform)
+        {
+            return with_quirks(platform, [](auto quirks) {
+                using Q = decltype(quirks);
+                return RuntimeQuirks { Q::memory_size, Q::xochip_opcodes, Q::stack_depth, Q::shift_uses_vy,
+                                       Q::load_store_increments_i, Q::jump_uses_vx, Q::logic_resets_vf,
+                                       Q::sprites_wrap, Q::display_wait };
+            });
+        }
+
+        // Addresses wrap around the end of memory
+        std::uint8_t load(const Machine &machine, const RuntimeQuirks &quirks, unsigned int address)
+        {
+            return read_memory(machine, address % quirks.memory_size);
+        }
+
+        void store(Machine &machine, const RuntimeQuirks &quirks, unsigned int address, std::uint8_t value)
+        {
+            write_memory(machine, address % quirks.memory_size, value);
+        }
+
+        // Halt with the PC back on the instruction
+        unsigned int fault(Machine &machine, Fault fault, std::uint16_t address)
+        {
+            machine.fault = fault;
+            machine.program_counter = address;
+            return 0;
+        }
+
+        void skip(Machine &machine, const RuntimeQuirks &quirks)
+        {
+            // XO-CHIP skips the whole of F000 nnnn
+            bool long_load = quirks.xochip_opcodes && load(machine, quirks, machine.program_counter) == 0xF0
+                          && load(machine, quirks, machine.program_counter + 1) == 0x00;
+            machine.program_counter = static_cast<std::uint16_t>(machine.program_counter + (long_load ? 4 : 2));
+        }
+
+        // XOR one sprite into a plane a pixel at a time. Returns whether a lit pixel was erased.
+        bool draw(Machine &machine, const RuntimeQuirks &quirks, int plane, std::uint16_t address,
+                  unsigned int x, unsigned int y, unsigned int rows, unsigned int width)
+        {
+            bool collision = false;
+            x %= SCREEN_WIDTH;
+            y %= SCREEN_HEIGHT;
+
+            for (unsigned int row = 0; row < rows; row++) {
+                unsigned int screen_y = y + row;
+                if (screen_y >= SCREEN_HEIGHT) {
+                    if (!quirks.sprites_wrap) break;
+                    screen_y %= SCREEN_HEIGHT;
+                }
+
+                for (unsigned int column = 0; column < width; column++) {
+                    unsigned int byte = width == 16 ? 2 * row + column / 8 : row;
+                    if (((load(machine, quirks, address + byte) >> (7 - column % 8)) & 1) == 0) {
+                        continue;
+                    }
+
+                    unsigned int screen_x = x + column;
+                    if (screen_x >= SCREEN_WIDTH) {
+                        if (!quirks.sprites_wrap) continue;
+                        screen_x %= SCREEN_WIDTH;
+                    }
+
+                    PlaneRow bit = PlaneRow { 1 } << (SCREEN_WIDTH - 1 - screen_x);
+                    PlaneRow &pixels = machine.planes.edit(static_cast<std::size_t>(plane))[screen_y];
+                    collision |= (pixels & bit) != 0;
+                    pixels ^= bit;
+                }
+            }
+
+            return collision;
+        }
+    }
+
+    void reference_start_frame(Machine &machine)
+    {
+        if (machine.delay_timer > 0) machine.delay_timer--;
+        if (machine.sound_timer > 0) machine.sound_timer--;
+        machine.waiting_for_vblank = false;
+    }
+
+    unsigned int reference_step(Machine &machine)
+    {
+        if (machine.fault != Fault::none || machine.waiting_for_vblank) {
+            return 0;
+        }
+
+        const RuntimeQuirks quirks = get_quirks(machine.platform);
+        machine.global_cycle_number++;
+
+        const std::uint16_t address = machine.program_counter;
+        if (address >= quirks.memory_size) {
+            return fault(machine, Fault::pc_out_of_range, address);
+        }
+
+        const std::uint16_t instruction = static_cast<std::uint16_t>(load(machine, quirks, address) << 8
+                                                                   | load(machine, quirks, address + 1u));
+        const unsigned int x = (instruction >> 8) & 0xF;
+        const unsigned int y = (instruction >> 4) & 0xF;
+        const unsigned int n = instruction & 0xF;
+        const std::uint8_t kk = instruction & 0xFF;
+        const std::uint16_t nnn = instruction & 0xFFF;
+        auto &V = machine.registers;
+
+        machine.program_counter = static_cast<std::uint16_t>(address + 2);
+
+        switch (instruction >> 12) {
+        case 0x0:
+            if (instruction == 0x00E0) {
+                for (int plane = 0; plane < MAX_PLANES; plane++) {
+                    if (machine.plane_mask & (1 << plane)) {
+                        machine.planes.edit(static_cast<std::size_t>(plane)).fill(0);
+                    }
+                }
+            } else if (instruction == 0x00EE) {
+                if (machine.stack_pointer == 0) {
+                    return fault(machine, Fault::stack_underflow, address);
+                }
+                machine.stack_pointer--;
+                machine.program_counter = machine.stack[machine.stack_pointer];
+            }
+            // Anything else is SYS nnn, which does nothing
+            break;
+
+        case 0x1:
+            machine.program_counter = nnn;
+            break;
+
+        case 0x2:
+            if (machine.stack_pointer >= quirks.stack_depth) {
+                return fault(machine, Fault::stack_overflow, address);
+            }
+            machine.stack[machine.stack_pointer] = machine.program_counter;
+            machine.stack_pointer++;
+            machine.program_counter = nnn;
+            break;
+
+        case 0x3:
+            if (V[x] == kk) skip(machine, quirks);
+            break;
+
+        case 0x4:
+            if (V[x] != kk) skip(machine, quirks);
+            break;
+
+        case 0x5:
+            if (n == 0) {
+                if (V[x] == V[y]) skip(machine, quirks);
+            } else if (n == 2 && quirks.xochip_opcodes) {
+                unsigned int count = x <= y ? y - x + 1 : x - y + 1;
+                for (unsigned int i = 0; i < count; i++) {
+                    store(machine, quirks, machine.i_register + i, V[x <= y ? x + i : x - i]);
+                }
+            } else if (n == 3 && quirks.xochip_opcodes) {
+                unsigned int count = x <= y ? y - x + 1 : x - y + 1;
+                for (unsigned int i = 0; i < count; i++) {
+                    V[x <= y ? x + i : x - i] = load(machine, quirks, machine.i_register + i);
+                }
+            } else {
+                return fault(machine, Fault::invalid_opcode, address);
+            }
+            break;
+
+        case 0x6:
+            V[x] = kk;
+            break;
+
+        case 0x7:
+            V[x] = static_cast<std::uint8_t>(V[x] + kk);
+            break;
+
+        case 0x8: {
+            // Results and flags come from the values before the instruction. VF is written last, so for
+            // x = F the flag wins over the result; the logic operations only touch VF with the quirk.
+            const unsigned int vx = V[x], vy = V[y];
+            const unsigned int source = quirks.shift_uses_vy ? vy : vx;
+            const int keep = -1;
+            unsigned int result = 0;
+            int flag = keep;
+            switch (n) {
+                case 0x0: result = vy; break;
+                case 0x1: result = vx | vy; flag = quirks.logic_resets_vf ? 0 : keep; break;
+                case 0x2: result = vx & vy; flag = quirks.logic_resets_vf ? 0 : keep; break;
+                case 0x3: result = vx ^ vy; flag = quirks.logic_resets_vf ? 0 : keep; break;
+                case 0x4: result = vx + vy; flag = result > 0xFF; break;
+                case 0x5: result = vx - vy; flag = vx >= vy; break;
+                case 0x6: result = source >> 1; flag = source & 1; break;
+                case 0x7: result = vy - vx; flag = vy >= vx; break;
+                case 0xE: result = source << 1; flag = source >> 7; break;
+                default: return fault(machine, Fault::invalid_opcode, address);
+            }
+            V[x] = static_cast<std::uint8_t>(result);
+            if (flag != keep) {
+                V[0xF] = static_cast<std::uint8_t>(flag);
+            }
+            break;
+        }
+
+        case 0x9:
+            if (n != 0) {
+                return fault(machine, Fault::invalid_opcode, address);
+            }
+            if (V[x] != V[y]) skip(machine, quirks);
+            break;
+
+        case 0xA:
+            machine.i_register = nnn;
+            break;
+
+        case 0xB:
+            machine.program_counter = static_cast<std::uint16_t>(nnn + V[quirks.jump_uses_vx ? x : 0]);
+            break;
+
+        case 0xC:
+            machine.random_state = next_random(machine.random_state);
+            V[x] = static_cast<std::uint8_t>((machine.random_state >> 24) & kk);
+            break;
+
+        case 0xD: {
+            // XO-CHIP draws a 16x16 sprite for n = 0, and one sprite per selected plane back to back from I
+            bool wide = n == 0 && quirks.xochip_opcodes;
+            unsigned int rows = wide ? 16 : n;
+            unsigned int bytes = wide ? 32 : n;
+            std::uint16_t sprite = machine.i_register;
+            bool collision = false;
+            for (int plane = 0; plane < MAX_PLANES; plane++) {
+                if (machine.plane_mask & (1 << plane)) {
+                    collision |= draw(machine, quirks, plane, sprite, V[x], V[y], rows, wide ? 16 : 8);
+                    sprite = static_cast<std::uint16_t>(sprite + bytes);
+                }
+            }
+            V[0xF] = collision ? 1 : 0;
+            if (quirks.display_wait) {
+                machine.waiting_for_vblank = true;
+            }
+            break;
+        }
+
+        case 0xE: {
+            bool pressed = (machine.keys >> (V[x] & 0xF)) & 1;
+            if (kk == 0x9E) {
+                if (pressed) skip(machine, quirks);
+            } else if (kk == 0xA1) {
+                if (!pressed) skip(machine, quirks);
+            } else {
+                return fault(machine, Fault::invalid_opcode, address);
+            }
+            break;
+        }
+
+        case 0xF:
+            if (quirks.xochip_opcodes && instruction == 0xF000) {
+                machine.i_register = static_cast<std::uint16_t>(load(machine, quirks, machine.program_counter) << 8
+                                                              | load(machine, quirks, machine.program_counter + 1u));
+                machine.program_counter = static_cast<std::uint16_t>(machine.program_counter + 2);
+                break;
+            }
+            if (quirks.xochip_opcodes && (kk == 0x01 || instruction == 0xF002 || kk == 0x3A)) {
+                // PLANE n selects the planes; AUDIO and PITCH have no effect without sound output
+                if (kk == 0x01) machine.plane_mask = static_cast<std::uint8_t>(x);
+                break;
+            }
+            switch (kk) {
+                case 0x07:
+                    V[x] = machine.delay_timer;
+                    break;
+                case 0x0A:
+                    // The key is taken when it is released; until then the instruction repeats
+                    if (machine.pending_key < 0) {
+                        if (machine.keys != 0) {
+                            machine.pending_key = static_cast<std::int8_t>(std::countr_zero(machine.keys));
+                        }
+                        machine.program_counter = address;
+                    } else if ((machine.keys >> machine.pending_key) & 1) {
+                        machine.program_counter = address;
+                    } else {
+                        V[x] = static_cast<std::uint8_t>(machine.pending_key);
+                        machine.pending_key = -1;
+                    }
+                    break;
+                case 0x15:
+                    machine.delay_timer = V[x];
+                    break;
+                case 0x18:
+                    machine.sound_timer = V[x];
+                    break;
+                case 0x1E:
+                    machine.i_register = static_cast<std::uint16_t>(machine.i_register + V[x]);
+                    break;
+                case 0x29:
+                    machine.i_register = static_cast<std::uint16_t>(FONT_START_ADDRESS + (V[x] & 0xF) * 5);
+                    break;
+                case 0x33:
+                    store(machine, quirks, machine.i_register, V[x] / 100);
+                    store(machine, quirks, machine.i_register + 1u, V[x] / 10 % 10);
+                    store(machine, quirks, machine.i_register + 2u, V[x] % 10);
+                    break;
+                case 0x55:
+                case 0x65:
+                    for (unsigned int i = 0; i <= x; i++) {
+                        if (kk == 0x55) {
+                            store(machine, quirks, machine.i_register + i, V[i]);
+                        } else {
+                            V[i] = load(machine, quirks, machine.i_register + i);
+                        }
+                    }
+                    if (quirks.load_store_increments_i) {
+                        machine.i_register = static_cast<std::uint16_t>(machine.i_register + x + 1);
+                    }
+                    break;
+                default:
+                    return fault(machine, Fault::invalid_opcode, address);
+            }
+            break;
+        }
+
+        return 1;
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "chip8.h"
+
+namespace chip8 {
+    /*
+        A deliberately plain second implementation of the instruction set, used as the oracle by the
+        differential tester (difftest.h). It shares nothing with the interpreter beyond the Machine
+        layout and the quirk profiles: it decodes with nested switches, reads the quirks at run time,
+        goes through read_memory()/write_memory() and draws sprites pixel by pixel. Keep it obvious
+        rather than fast; only the interpreter and the lane engine are worth optimizing.
+    */
+
+    // Start a 60 Hz frame like run_frame() does: tick the timers and end any vblank wait
+    void reference_start_frame(Machine &machine);
+
+    // Execute one instruction unless the machine is faulted or waiting for vblank. Returns 1 if an
+    // instruction completed and 0 otherwise, counting like fetch_decode_execute(machine, 1).
+    unsigned int reference_step(Machine &machine);
+}
@@ -0,0 +1,283 @@
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "reward.h"
+
+namespace chip8 {
+    namespace {
+        // Decimal, or hex with a 0x prefix. A leading zero does not mean octal, so "010" is ten.
+        bool parse_integer(const std::string &text, std::int64_t &value)
+        {
+            const char *first = text.data();
+            const char *last = text.data() + text.size();
+            bool negative = first != last && *first == '-';
+            if (negative) {
+                first++;
+            }
+
+            int base = 10;
+            if (last - first > 2 && first[0] == '0' && (first[1] == 'x' || first[1] == 'X')) {
+                base = 16;
+                first += 2;
+            }
+
+            // from_chars takes no sign of its own here, so "--1" and "-+1" are errors
+            std::uint64_t magnitude = 0;
+            auto [end, error] = std::from_chars(first, last, magnitude, base);
+            if (first == last || *first == '-' || *first == '+' || error != std::errc() || end != last
+                || magnitude > (negative ? std::uint64_t { 1 } << 63 : std::uint64_t { INT64_MAX })) {
+                return false;
+            }
+
+            value = negative ? static_cast<std::int64_t>(0 - magnitude) : static_cast<std::int64_t>(magnitude);
+            return true;
+        }
+
+        bool parse_scale(const std::string &text, float &value)
+        {
+            try {
+                std::size_t end = 0;
+                value = std::stof(text, &end);
+                return end == text.size();
+            } catch (const std::exception &) {
+                return false;
+            }
+        }
+
+        bool parse_encoding(const std::string &text, RewardEncoding &encoding)
+        {
+            if (text == "be") encoding = RewardEncoding::big_endian;
+            else if (text == "le") encoding = RewardEncoding::little_endian;
+            else if (text == "digits") encoding = RewardEncoding::digits;
+            else if (text == "bcd") encoding = RewardEncoding::bcd;
+            else return false;
+            return true;
+        }
+
+        bool parse_compare(const std::string &text, RewardCompare &compare)
+        {
+            if (text == "==") compare = RewardCompare::equal;
+            else if (text == "!=") compare = RewardCompare::not_equal;
+            else if (text == "<") compare = RewardCompare::less;
+            else if (text == "<=") compare = RewardCompare::less_equal;
+            else if (text == ">") compare = RewardCompare::greater;
+            else if (text == ">=") compare = RewardCompare::greater_equal;
+            else return false;
+            return true;
+        }
+
+        // Memory sizes are powers of two, so addresses wrap like they do for the interpreter.
+        // read_memory(address) returns the byte at an address below memory_size.
+        template <typename ReadMemory>
+        std::int64_t read_value(const RewardRule &rule, ReadMemory &&read_memory, std::size_t memory_size)
+        {
+            const std::size_t mask = memory_size - 1;
+            std::uint64_t value = 0;
+
+            for (unsigned int i = 0; i < rule.width; i++) {
+                std::uint8_t byte = read_memory((rule.address + i) & mask);
+                switch (rule.encoding) {
+                    case RewardEncoding::big_endian: value = value << 8 | byte; break;
+                    case RewardEncoding::little_endian: value |= static_cast<std::uint64_t>(byte) << (8 * i); break;
+                    case RewardEncoding::digits: value = value * 10 + byte; break;
+                    case RewardEncoding::bcd: value = value * 100 + (byte >> 4) * 10 + (byte & 0xF); break;
+                }
+            }
+
+            return static_cast<std::int64_t>(value);
+        }
+
+        bool holds(RewardCompare compare, std::int64_t value, std::int64_t constant)
+        {
+            switch (compare) {
+                case RewardCompare::none: return value != 0;
+                case RewardCompare::equal: return value == constant;
+                case RewardCompare::not_equal: return value != constant;
+                case RewardCompare::less: return value < constant;
+                case RewardCompare::less_equal: return value <= constant;
+                case RewardCompare::greater: return value > constant;
+                case RewardCompare::greater_equal: return value >= constant;
+            }
+            return false;
+        }
+
+        template <typename ReadMemory>
+        void start(const RewardProgram &program, ReadMemory &&read_memory, std::size_t memory_size, std::int64_t *previous)
+        {
+            for (const RewardRule &rule : program.rules) {
+                if (rule.delta) {
+                    previous[rule.slot] = read_value(rule, read_memory, memory_size);
+                }
+            }
+        }
+
+        template <typename ReadMemory>
+        RewardResult evaluate(const RewardProgram &program, ReadMemory &&read_memory, std::size_t memory_size, std::int64_t *previous)
+        {
+            RewardResult result;
+
+            for (const RewardRule &rule : program.rules) {
+                std::int64_t value = read_value(rule, read_memory, memory_size);
+                if (rule.delta) {
+                    std::int64_t current = value;
+                    value -= previous[rule.slot];
+                    previous[rule.slot] = current;
+                }
+
+                if (rule.done) {
+                    result.done |= holds(rule.compare, value, rule.constant);
+                } else if (rule.compare == RewardCompare::none) {
+                    result.reward += rule.scale * static_cast<float>(value);
+                } else if (holds(rule.compare, value, rule.constant)) {
+                    result.reward += rule.scale;
+                }
+            }
+
+            return result;
+        }
+    }
+
+    bool compile_reward_spec(const std::string &text, RewardProgram &program, std::string &error)
+    {
+        std::istringstream input(text);
+        std::string line;
+        unsigned int line_number = 0;
+
+        program.rules.clear();
+        program.slot_count = 0;
+
+        while (std::getline(input, line)) {
+            line_number++;
+            line = line.substr(0, line.find('#'));
+
+            std::istringstream fields(line);
+            std::vector<std::string> words;
+            for (std::string word; fields >> word; ) {
+                words.push_back(word);
+            }
+            if (words.empty()) {
+                continue; // Blank or comment-only line
+            }
+
+            auto fail = [&](const std::string &message) {
+                error = "line " + std::to_string(line_number) + ": " + message;
+                return false;
+            };
+
+            RewardRule rule {};
+            rule.scale = 1;
+
+            if (words[0] == "done") {
+                rule.done = true;
+            } else if (words[0] != "reward") {
+                return fail("expected reward or done, got '" + words[0] + "'");
+            }
+            if (words.size() < 5) {
+                return fail("expected address, width, encoding and value or delta");
+            }
+
+            std::int64_t number;
+            if (!parse_integer(words[1], number) || number < 0 || number > 0xFFFF) {
+                return fail("bad address '" + words[1] + "'");
+            }
+            rule.address = static_cast<std::uint16_t>(number);
+
+            if (!parse_integer(words[2], number) || number < 1 || number > 8) {
+                return fail("bad width '" + words[2] + "', expected 1 to 8 bytes");
+            }
+            rule.width = static_cast<std::uint8_t>(number);
+
+            if (!parse_encoding(words[3], rule.encoding)) {
+                return fail("bad encoding '" + words[3] + "', expected be, le, digits or bcd");
+            }
+            // Values are signed 64-bit, so a full 8-byte binary value could read as negative
+            if (rule.width > 7 && (rule.encoding == RewardEncoding::big_endian || rule.encoding == RewardEncoding::little_endian)) {
+                return fail("bad width '" + words[2] + "', be and le values are 1 to 7 bytes");
+            }
+
+            if (words[4] == "delta") {
+                rule.delta = true;
+                rule.slot = static_cast<std::uint32_t>(program.slot_count++);
+            } else if (words[4] != "value") {
+                return fail("expected value or delta, got '" + words[4] + "'");
+            }
+
+            std::size_t next = 5;
+            if (next < words.size() && parse_compare(words[next], rule.compare)) {
+                if (next + 1 >= words.size() || !parse_integer(words[next + 1], rule.constant)) {
+                    return fail("expected a constant after '" + words[next] + "'");
+                }
+                next += 2;
+            } else if (rule.done) {
+                return fail("done rules need a comparison");
+            }
+
+            if (next < words.size() && !rule.done) {
+                if (!parse_scale(words[next], rule.scale)) {
+                    return fail("bad scale '" + words[next] + "'");
+                }
+                next++;
+            }
+            if (next < words.size()) {
+                return fail("unexpected '" + words[next] + "'");
+            }
+
+            program.rules.push_back(rule);
+        }
+
+        return true;
+    }
+
+    bool load_reward_spec(const std::string &path, RewardProgram &program, std::string &error)
+    {
+        std::ifstream input(path);
+        if (!input) {
+            error = "cannot open " + path;
+            return false;
+        }
+
+        std::stringstream text;
+        text << input.rdbuf();
+        return compile_reward_spec(text.str(), program, error);
+    }
+
+    void start_reward(const RewardProgram &program, const std::uint8_t *memory, std::size_t memory_size, std::int64_t *previous)
+    {
+        start(program, [=](std::size_t address) { return memory[address]; }, memory_size, previous);
+    }
+
+    RewardResult evaluate_reward(const RewardProgram &program, const std::uint8_t *memory, std::size_t memory_size,
+                                 std::int64_t *previous)
+    {
+        return evaluate(program, [=](std::size_t address) { return memory[address]; }, memory_size, previous);
+    }
+
+    void start_reward(const RewardProgram &program, const Machine &machine, std::int64_t *previous)
+    {
+        start(program, [&](std::size_t address) { return read_memory(machine, address); },
+              static_cast<std::size_t>(get_memory_size(machine)), previous);
+    }
+
+    RewardResult evaluate_reward(const RewardProgram &program, const Machine &machine, std::int64_t *previous)
+    {
+        return evaluate(program, [&](std::size_t address) { return read_memory(machine, address); },
+                        static_cast<std::size_t>(get_memory_size(machine)), previous);
+    }
+
+    void evaluate_lane_rewards(const RewardProgram &program, Lanes &lanes, std::int64_t *previous,
+                               float *rewards, std::uint8_t *dones)
+    {
+        for (std::size_t lane = 0; lane < lanes.lane_count; lane++) {
+            if (dones[lane]) {
+                continue;
+            }
+
+            RewardResult result = evaluate_reward(program, get_lane_memory(lanes, lane), lanes.memory_size,
+                                                  previous + lane * program.slot_count);
+            rewards[lane] += result.reward;
+            dones[lane] = result.done ? 1 : 0;
+        }
+    }
+}
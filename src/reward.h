@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "chip8.h"
+#include "lanes.h"
+
+namespace chip8 {
+    /*
+        Reward and termination rules read from machine memory, one rule per line:
+
+            reward <address> <width> <encoding> <measure> [<compare> <constant>] [<scale>]
+            done   <address> <width> <encoding> <measure> <compare> <constant>
+
+        The rule reads <width> bytes (1 to 8, at most 7 for be and le) at <address> and decodes them as:
+            be      big-endian unsigned
+            le      little-endian unsigned
+            digits  one decimal digit per byte, most significant first, as written by Fx33
+            bcd     packed BCD, two digits per byte, most significant first
+
+        <measure> is "value" for the decoded number or "delta" for its change since the last
+        evaluation. With a comparison (== != < <= > >=) the rule counts 1 when it holds and 0
+        otherwise. A reward rule adds scale (default 1) times that to the reward; a done rule ends
+        the episode when its comparison holds. Numbers are decimal unless they start with 0x, and '#'
+        starts a comment.
+
+            reward 0x3F0 3 digits delta          # score
+            reward 0x3F8 1 be delta < 0 -10      # lost a life
+            done   0x3F8 1 be value == 0         # out of lives
+
+        Rules are compiled once into a flat table; evaluating them does no parsing or allocation.
+    */
+    enum class RewardEncoding : std::uint8_t { big_endian, little_endian, digits, bcd };
+    enum class RewardCompare : std::uint8_t { none, equal, not_equal, less, less_equal, greater, greater_equal };
+
+    struct RewardRule {
+        std::uint16_t address;
+        std::uint8_t width;
+        RewardEncoding encoding;
+        bool delta;
+        bool done;
+        RewardCompare compare;
+        std::int64_t constant;
+        float scale;
+        std::uint32_t slot;     // Index of the previous value, for delta rules
+    };
+
+    struct RewardProgram {
+        std::vector<RewardRule> rules;
+        std::size_t slot_count = 0;     // Previous values each instance keeps for its delta rules
+    };
+
+    struct RewardResult {
+        float reward = 0;
+        bool done = false;
+    };
+
+    // Returns false and fills error on a malformed spec
+    bool compile_reward_spec(const std::string &text, RewardProgram &program, std::string &error);
+
+    bool load_reward_spec(const std::string &path, RewardProgram &program, std::string &error);
+
+    // Record the starting values for delta rules. previous holds slot_count values.
+    void start_reward(const RewardProgram &program, const std::uint8_t *memory, std::size_t memory_size, std::int64_t *previous);
+
+    RewardResult evaluate_reward(const RewardProgram &program, const std::uint8_t *memory, std::size_t memory_size,
+                                 std::int64_t *previous);
+
+    // Reads the machine's memory pages in place, so forked machines stay shared
+    void start_reward(const RewardProgram &program, const Machine &machine, std::int64_t *previous);
+
+    RewardResult evaluate_reward(const RewardProgram &program, const Machine &machine, std::int64_t *previous);
+
+    /*
+        Evaluate every lane, with slot_count previous values per lane in previous. Adds to rewards and
+        sets dones for lanes whose episode ended; lanes already marked done are skipped.
+    */
+    void evaluate_lane_rewards(const RewardProgram &program, Lanes &lanes, std::int64_t *previous,
+                               float *rewards, std::uint8_t *dones);
+}
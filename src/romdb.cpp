@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include "romdb.h"
+
+namespace chip8 {
+    namespace {
+        constexpr std::uint8_t parse_hex_digit(char c)
+        {
+            if (c >= '0' && c <= '9') return static_cast<std::uint8_t>(c - '0');
+            if (c >= 'a' && c <= 'f') return static_cast<std::uint8_t>(c - 'a' + 10);
+            if (c >= 'A' && c <= 'F') return static_cast<std::uint8_t>(c - 'A' + 10);
+            return NO_KEY;
+        }
+
+        constexpr Sha1Digest parse_sha1(const char (&hex)[41])
+        {
+            Sha1Digest digest {};
+            for (std::size_t i = 0; i < digest.size(); i++) {
+                digest[i] = static_cast<std::uint8_t>(parse_hex_digit(hex[2*i]) << 4 | parse_hex_digit(hex[2*i + 1]));
+            }
+            return digest;
+        }
+
+        constexpr KeyMap parse_keymap(const char (&keys)[BUTTON_COUNT + 1])
+        {
+            KeyMap keymap {};
+            for (std::size_t i = 0; i < keymap.size(); i++) {
+                keymap[i] = parse_hex_digit(keys[i]);
+            }
+            return keymap;
+        }
+
+        // CHIP8_EXTRA_ROMS can name a second file of ROM() entries, the checks add their fixture ROM that way
+        constexpr std::size_t ROM_COUNT = 0
+#define ROM(sha1, title, platform, cycles_per_frame, keymap) + 1
+#include "romdb.inc"
+#ifdef CHIP8_EXTRA_ROMS
+#include CHIP8_EXTRA_ROMS
+#endif
+#undef ROM
+        ;
+
+        // Sorted by hash at compile time, so lookups are a binary search over static data
+        constexpr std::array<RomInfo, ROM_COUNT> ROMS = [] {
+            std::array<RomInfo, ROM_COUNT> roms {{
+#define ROM(sha1, title, platform, cycles_per_frame, keymap) \
+                { parse_sha1(sha1), title, Platform::platform, cycles_per_frame, parse_keymap(keymap) },
+#include "romdb.inc"
+#ifdef CHIP8_EXTRA_ROMS
+#include CHIP8_EXTRA_ROMS
+#endif
+#undef ROM
+            }};
+            std::sort(roms.begin(), roms.end(), [](const RomInfo &a, const RomInfo &b) { return a.sha1 < b.sha1; });
+            return roms;
+        }();
+
+        static_assert(std::adjacent_find(ROMS.begin(), ROMS.end(),
+                                         [](const RomInfo &a, const RomInfo &b) { return a.sha1 == b.sha1; }) == ROMS.end(),
+                      "duplicate ROM hash in romdb.inc");
+
+        struct Sha1State {
+            std::array<std::uint32_t, 5> h { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+            void process_block(const std::uint8_t *block)
+            {
+                std::array<std::uint32_t, 80> w;
+                for (std::size_t i = 0; i < 16; i++) {
+                    w[i] = static_cast<std::uint32_t>(block[4*i]) << 24 | static_cast<std::uint32_t>(block[4*i + 1]) << 16
+                         | static_cast<std::uint32_t>(block[4*i + 2]) << 8 | static_cast<std::uint32_t>(block[4*i + 3]);
+                }
+                for (std::size_t i = 16; i < 80; i++) {
+                    w[i] = std::rotl(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+                }
+
+                std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+                for (std::size_t i = 0; i < 80; i++) {
+                    std::uint32_t f, k;
+                    if (i < 20) {
+                        f = (b & c) | (~b & d);
+                        k = 0x5A827999;
+                    } else if (i < 40) {
+                        f = b ^ c ^ d;
+                        k = 0x6ED9EBA1;
+                    } else if (i < 60) {
+                        f = (b & c) | (b & d) | (c & d);
+                        k = 0x8F1BBCDC;
+                    } else {
+                        f = b ^ c ^ d;
+                        k = 0xCA62C1D6;
+                    }
+
+                    std::uint32_t temp = std::rotl(a, 5) + f + e + k + w[i];
+                    e = d;
+                    d = c;
+                    c = std::rotl(b, 30);
+                    b = a;
+                    a = temp;
+                }
+
+                h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+            }
+        };
+    }
+
+    Sha1Digest sha1(const std::uint8_t *data, std::size_t size)
+    {
+        Sha1State state;
+
+        std::size_t offset = 0;
+        for (; offset + 64 <= size; offset += 64) {
+            state.process_block(data + offset);
+        }
+
+        // Pad the tail with a 1 bit, zeros and the message length in bits
+        std::array<std::uint8_t, 128> tail {};
+        std::size_t remaining = size - offset;
+        if (remaining > 0) {
+            std::memcpy(tail.data(), data + offset, remaining);
+        }
+        tail[remaining] = 0x80;
+
+        std::size_t tail_size = remaining < 56 ? 64 : 128;
+        std::uint64_t bit_length = static_cast<std::uint64_t>(size) * 8;
+        for (std::size_t i = 0; i < 8; i++) {
+            tail[tail_size - 1 - i] = static_cast<std::uint8_t>(bit_length >> (8 * i));
+        }
+
+        for (std::size_t block = 0; block < tail_size; block += 64) {
+            state.process_block(tail.data() + block);
+        }
+
+        Sha1Digest digest;
+        for (std::size_t i = 0; i < 5; i++) {
+            digest[4*i] = static_cast<std::uint8_t>(state.h[i] >> 24);
+            digest[4*i + 1] = static_cast<std::uint8_t>(state.h[i] >> 16);
+            digest[4*i + 2] = static_cast<std::uint8_t>(state.h[i] >> 8);
+            digest[4*i + 3] = static_cast<std::uint8_t>(state.h[i]);
+        }
+        return digest;
+    }
+
+    const RomInfo *find_rom(const Sha1Digest &digest)
+    {
+        auto entry = std::lower_bound(ROMS.begin(), ROMS.end(), digest,
+                                      [](const RomInfo &rom, const Sha1Digest &value) { return rom.sha1 < value; });
+
+        if (entry == ROMS.end() || entry->sha1 != digest) {
+            return nullptr;
+        }
+
+        return &*entry;
+    }
+
+    const RomInfo *identify_rom(const std::uint8_t *data, std::size_t size)
+    {
+        return find_rom(sha1(data, size));
+    }
+
+    std::size_t get_rom_database_size()
+    {
+        return ROMS.size();
+    }
+}
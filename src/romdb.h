@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "chip8.h"
+
+namespace chip8 {
+    using Sha1Digest = std::array<std::uint8_t, 20>;
+
+    // RetroPad buttons that can be mapped to a CHIP-8 key
+    enum Button : std::uint8_t {
+        BUTTON_UP, BUTTON_DOWN, BUTTON_LEFT, BUTTON_RIGHT,
+        BUTTON_A, BUTTON_B, BUTTON_X, BUTTON_Y,
+        BUTTON_L, BUTTON_R, BUTTON_SELECT, BUTTON_START,
+        BUTTON_COUNT
+    };
+
+    inline constexpr std::uint8_t NO_KEY = 0xFF;
+
+    // The CHIP-8 key pressed by each button, or NO_KEY
+    using KeyMap = std::array<std::uint8_t, BUTTON_COUNT>;
+
+    // Directions on 2/8/4/6, the centre key 5 on A and the rest spread over the other buttons
+    inline constexpr KeyMap DEFAULT_KEYMAP { 0x2, 0x8, 0x4, 0x6, 0x5, 0x0, 0x1, 0x3, 0x7, 0x9, 0xE, 0xF };
+
+    struct RomInfo {
+        Sha1Digest sha1;
+        const char *title;
+        Platform platform;
+        std::uint16_t cycles_per_frame;
+        KeyMap keymap;
+    };
+
+    Sha1Digest sha1(const std::uint8_t *data, std::size_t size);
+
+    // Look a ROM image up in the embedded database. Returns nullptr for unknown ROMs.
+    const RomInfo *identify_rom(const std::uint8_t *data, std::size_t size);
+
+    const RomInfo *find_rom(const Sha1Digest &digest);
+
+    std::size_t get_rom_database_size();
+}
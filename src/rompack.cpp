@@ -0,0 +1,191 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include "rompack.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CHIP8_HAVE_MMAP 1
+#endif
+
+namespace chip8 {
+    namespace {
+        constexpr char ROM_PACK_MAGIC[8] = { 'C', 'H', '8', 'P', 'A', 'C', 'K', '\0' };
+
+        std::uint64_t read_le(const std::uint8_t *data, int bytes)
+        {
+            std::uint64_t value = 0;
+            for (int i = bytes - 1; i >= 0; i--) {
+                value = (value << 8) | data[i];
+            }
+            return value;
+        }
+
+        // Offset and size lie within a file of file_size bytes
+        bool in_file(std::uint64_t offset, std::uint64_t size, std::size_t file_size)
+        {
+            return offset <= file_size && size <= file_size - offset;
+        }
+    }
+
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile::MappedFile(MappedFile &&other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+    {
+        if (this != &other) {
+            close();
+            bytes = std::exchange(other.bytes, nullptr);
+            size = std::exchange(other.size, 0);
+            mapped = std::exchange(other.mapped, false);
+            fallback = std::move(other.fallback);
+        }
+        return *this;
+    }
+
+    bool MappedFile::open(const std::string &path, std::string &error)
+    {
+        close();
+
+#ifdef CHIP8_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = "cannot open " + path + ": " + std::strerror(errno);
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            error = "cannot stat " + path + ": " + std::strerror(errno);
+            ::close(fd);
+            return false;
+        }
+
+        // mmap refuses empty mappings, and an empty file has nothing to map anyway
+        if (info.st_size > 0) {
+            void *address = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                error = "cannot map " + path + ": " + std::strerror(errno);
+                ::close(fd);
+                return false;
+            }
+            bytes = static_cast<const std::uint8_t *>(address);
+            size = static_cast<std::size_t>(info.st_size);
+            mapped = true;
+        }
+
+        // The mapping keeps the file alive
+        ::close(fd);
+        return true;
+#else
+        std::FILE *input = std::fopen(path.c_str(), "rb");
+        if (!input) {
+            error = "cannot open " + path;
+            return false;
+        }
+
+        std::uint8_t chunk[1 << 16];
+        while (std::size_t count = std::fread(chunk, 1, sizeof(chunk), input)) {
+            fallback.insert(fallback.end(), chunk, chunk + count);
+        }
+
+        bool ok = !std::ferror(input);
+        std::fclose(input);
+        if (!ok) {
+            error = "cannot read " + path;
+            fallback.clear();
+            return false;
+        }
+
+        bytes = fallback.data();
+        size = fallback.size();
+        return true;
+#endif
+    }
+
+    void MappedFile::close()
+    {
+#ifdef CHIP8_HAVE_MMAP
+        if (mapped) {
+            munmap(const_cast<std::uint8_t *>(bytes), size);
+        }
+#endif
+        bytes = nullptr;
+        size = 0;
+        mapped = false;
+        fallback.clear();
+    }
+
+    bool is_rom_pack(std::span<const std::uint8_t> data)
+    {
+        return data.size() >= sizeof(ROM_PACK_MAGIC) && std::memcmp(data.data(), ROM_PACK_MAGIC, sizeof(ROM_PACK_MAGIC)) == 0;
+    }
+
+    bool RomPack::open(const std::string &path, std::string &error)
+    {
+        close();
+        if (!file.open(path, error)) {
+            return false;
+        }
+
+        std::span<const std::uint8_t> data = file.data();
+        if (!is_rom_pack(data) || data.size() < ROM_PACK_HEADER_SIZE) {
+            error = path + " is not a ROM pack";
+            file.close();
+            return false;
+        }
+
+        std::uint32_t version = static_cast<std::uint32_t>(read_le(&data[8], 4));
+        if (version != ROM_PACK_VERSION) {
+            error = path + " has ROM pack version " + std::to_string(version) + ", expected " + std::to_string(ROM_PACK_VERSION);
+            file.close();
+            return false;
+        }
+
+        std::uint64_t count = read_le(&data[12], 4);
+        if (!in_file(ROM_PACK_HEADER_SIZE, count * ROM_PACK_ENTRY_SIZE, data.size())) {
+            error = path + " is truncated";
+            file.close();
+            return false;
+        }
+
+        roms.reserve(count);
+        for (std::size_t i = 0; i < count; i++) {
+            const std::uint8_t *entry = &data[ROM_PACK_HEADER_SIZE + i * ROM_PACK_ENTRY_SIZE];
+            std::uint64_t data_offset = read_le(entry, 8);
+            std::uint64_t name_offset = read_le(entry + 8, 8);
+            std::uint64_t data_size = read_le(entry + 16, 4);
+            std::uint64_t name_size = read_le(entry + 20, 4);
+
+            if (!in_file(data_offset, data_size, data.size()) || !in_file(name_offset, name_size, data.size())) {
+                error = path + ": ROM " + std::to_string(i) + " lies outside the file";
+                close();
+                return false;
+            }
+
+            PackedRom rom;
+            rom.name = std::string_view(reinterpret_cast<const char *>(data.data() + name_offset), name_size);
+            rom.data = data.subspan(data_offset, data_size);
+            roms.push_back(rom);
+        }
+
+        return true;
+    }
+
+    void RomPack::close()
+    {
+        roms.clear();
+        file.close();
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chip8 {
+    // A whole file mapped read-only into memory. The contents stay valid until the file is closed or the object destroyed.
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(MappedFile &&other) noexcept;
+        MappedFile &operator=(MappedFile &&other) noexcept;
+
+        // Returns false and fills error if the file cannot be opened or mapped. An empty file maps to an empty span.
+        bool open(const std::string &path, std::string &error);
+
+        void close();
+
+        std::span<const std::uint8_t> data() const { return { bytes, size }; }
+
+    private:
+        const std::uint8_t *bytes = nullptr;
+        std::size_t size = 0;
+        bool mapped = false;                // Otherwise bytes points into fallback
+        std::vector<std::uint8_t> fallback; // Contents read normally where mmap is not available
+    };
+
+    /*
+        ROM pack layout, all values little endian:
+            "CH8PACK" and a zero byte, version (32 bits), ROM count (32 bits), then one index entry
+            per ROM: data offset (64 bits), name offset (64 bits), data size (32 bits), name size
+            (32 bits). Offsets count from the start of the file; names are UTF-8 without a
+            terminator. scripts/pack_roms.py writes packs. Bump ROM_PACK_VERSION whenever the layout changes.
+    */
+    inline constexpr std::uint32_t ROM_PACK_VERSION = 1;
+    inline constexpr std::size_t ROM_PACK_HEADER_SIZE = 16;
+    inline constexpr std::size_t ROM_PACK_ENTRY_SIZE = 24;
+
+    struct PackedRom {
+        std::string_view name;              // Path of the ROM relative to the directory it was packed from
+        std::span<const std::uint8_t> data;
+    };
+
+    /*
+        Many ROM images in one mapped file, so tools can scan a whole ROM set without opening and
+        reading every file. The index is checked once on open; the names and data handed out point
+        straight into the mapping and stay valid as long as the pack is open.
+    */
+    class RomPack {
+    public:
+        // Returns false and fills error if the file cannot be mapped or is not a valid pack
+        bool open(const std::string &path, std::string &error);
+
+        void close();
+
+        std::size_t size() const { return roms.size(); }
+
+        const PackedRom &operator[](std::size_t index) const { return roms[index]; }
+
+        auto begin() const { return roms.begin(); }
+        auto end() const { return roms.end(); }
+
+    private:
+        MappedFile file;
+        std::vector<PackedRom> roms;
+    };
+
+    // True if data starts like a ROM pack of any version
+    bool is_rom_pack(std::span<const std::uint8_t> data);
+}
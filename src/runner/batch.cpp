@@ -0,0 +1,131 @@
+#include <cinttypes>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include "batch.h"
+#include "thread_pool.h"
+
+namespace runner {
+    namespace {
+        // Collects results that finish out of order and writes them out in job order
+        class OrderedWriter {
+        public:
+            OrderedWriter(std::size_t count, std::FILE *output) : pending(count), output(output) {}
+
+            void write(std::size_t job, std::string line)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                pending[job] = std::move(line);
+                while (next < pending.size() && pending[next]) {
+                    std::fputs(pending[next]->c_str(), output);
+                    pending[next].reset();
+                    next++;
+                }
+                std::fflush(output);
+            }
+
+        private:
+            std::mutex mutex;
+            std::vector<std::optional<std::string>> pending;
+            std::size_t next = 0;
+            std::FILE *output;
+        };
+
+        std::string format_result(std::size_t index, const BatchJob &job, const RunResult &result)
+        {
+            char line[512];
+            std::snprintf(line, sizeof(line),
+                          "job=%zu platform=%s frames=%u cycles=%" PRIu64 " hash=%016" PRIx64 " state=%016" PRIx64
+                          " fault=\"%s\" seconds=%.6f",
+                          index, chip8::get_platform_name(result.platform), result.frames, result.cycles,
+                          result.display_hash, result.state_hash, chip8::describe_fault(result.fault), result.seconds);
+
+            std::string text = line;
+            text += " rom=" + job.rom_path;
+            if (!job.input_path.empty()) {
+                text += " input=" + job.input_path;
+            }
+            text += "\n";
+            return text;
+        }
+
+        std::string format_error(std::size_t index, const BatchJob &job, const std::string &error)
+        {
+            return "job=" + std::to_string(index) + " error=\"" + error + "\" rom=" + job.rom_path + "\n";
+        }
+    }
+
+    bool load_batch_manifest(const std::string &path, std::vector<BatchJob> &jobs, std::string &error)
+    {
+        std::ifstream input(path);
+        if (!input) {
+            error = "cannot open " + path;
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(input, line)) {
+            std::istringstream fields(line.substr(0, line.find('#')));
+            BatchJob job;
+            if (fields >> job.rom_path) {
+                fields >> job.input_path;
+                jobs.push_back(std::move(job));
+            }
+        }
+
+        return true;
+    }
+
+    std::vector<BatchJob> make_pack_jobs(const std::string &pack_path, const chip8::RomPack &pack, const std::string &input_path)
+    {
+        std::vector<BatchJob> jobs;
+        jobs.reserve(pack.size());
+        for (const chip8::PackedRom &rom : pack) {
+            jobs.push_back({ pack_path + ":" + std::string(rom.name), input_path, rom.data });
+        }
+        return jobs;
+    }
+
+    std::size_t run_batch(const std::vector<BatchJob> &jobs, const RunOptions &options, unsigned int threads, std::FILE *output)
+    {
+        WorkStealingPool pool(threads);
+        OrderedWriter writer(jobs.size(), output);
+
+        // One machine per worker, reused across that worker's jobs. Nothing else is shared.
+        std::vector<chip8::Machine> machines(pool.worker_count());
+        std::vector<std::size_t> failures(pool.worker_count());
+
+        pool.run(jobs.size(), [&](unsigned int worker, std::size_t index) {
+            const BatchJob &job = jobs[index];
+
+            chip8::MappedFile file;
+            InputScript script;
+            std::string error;
+
+            if (!job.rom && !file.open(job.rom_path, error)) {
+                failures[worker]++;
+                writer.write(index, format_error(index, job, error));
+                return;
+            }
+            if (!job.input_path.empty() && !load_input_script(job.input_path, script, error)) {
+                failures[worker]++;
+                writer.write(index, format_error(index, job, error));
+                return;
+            }
+
+            RunResult result = run_rom(machines[worker], job.rom ? *job.rom : file.data(), script, options);
+            if (!result.loaded || result.fault != chip8::Fault::none) {
+                failures[worker]++;
+            }
+            writer.write(index, format_result(index, job, result));
+        });
+
+        std::size_t failed = 0;
+        for (auto count : failures) {
+            failed += count;
+        }
+        return failed;
+    }
+}
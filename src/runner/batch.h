@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdio>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+#include "../rompack.h"
+#include "run.h"
+
+namespace runner {
+    /*
+        A batch manifest lists one job per line: a ROM path, optionally followed by an input script
+        path. Blank lines and '#' comments are ignored. Every job runs with the same RunOptions.
+    */
+    struct BatchJob {
+        std::string rom_path;
+        std::string input_path;
+        std::optional<std::span<const std::uint8_t>> rom;  // Already in memory, e.g. in a ROM pack; otherwise rom_path is mapped
+    };
+
+    bool load_batch_manifest(const std::string &path, std::vector<BatchJob> &jobs, std::string &error);
+
+    // One job per ROM in the pack, named "pack_path:name", all with the same input script. The pack must stay open while they run.
+    std::vector<BatchJob> make_pack_jobs(const std::string &pack_path, const chip8::RomPack &pack, const std::string &input_path);
+
+    // Run every job over threads workers, each with its own machine, and write one result line per job
+    // to output in manifest order as soon as all earlier jobs have finished. Returns the number of failed jobs.
+    std::size_t run_batch(const std::vector<BatchJob> &jobs, const RunOptions &options, unsigned int threads, std::FILE *output);
+}
@@ -0,0 +1,292 @@
+/*
+    Headless runner: loads a ROM into the core and runs it with scripted input, without any
+    frontend, video or audio, then reports display hashes, timing and optionally the final state.
+    With --batch it runs a whole manifest of ROM and input script jobs in parallel instead, and
+    with --pack every ROM of a ROM pack (rompack.h).
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../chip8.h"
+#include "../ops.h"
+#include "../profile.h"
+#include "../romdb.h"
+#include "../rompack.h"
+#include "../trace.h"
+#include "batch.h"
+#include "run.h"
+#include "script.h"
+
+static void usage(const char *program)
+{
+    std::fprintf(stderr,
+        "usage: %s [options] rom\n"
+        "       %s [options] --batch MANIFEST\n"
+        "  --platform NAME      modern, cosmac_vip, schip or xochip (default: ROM database, then modern)\n"
+        "  --frames N           frames to run (default: 600)\n"
+        "  --cycles N           instructions per frame (default: ROM database, then %u)\n"
+        "  --max-cycles N       stop after N instructions in total\n"
+        "  --input FILE         scripted keypad input\n"
+        "  --hash-every N       print the display hash every N frames\n"
+        "  --seed N             seed for the machine's random numbers (default: 0)\n"
+        "  --state FILE         write the final machine state to FILE\n"
+        "  --profile FILE       write a hot-spot report of where the cycles went to FILE\n"
+        "  --trace FILE         record every instruction to FILE, for tracedump\n"
+        "  --trace-from ADDR    only record instructions at ADDR and above\n"
+        "  --trace-to ADDR      only record instructions at ADDR and below\n"
+        "  --display            print the final display\n"
+        "  --batch FILE         run every 'rom [input]' line of FILE\n"
+        "  --pack FILE          run every ROM in the ROM pack FILE, all with the --input script\n"
+        "  --jobs N             worker threads for --batch and --pack (default: all cores)\n"
+        "  --output FILE        write --batch and --pack results to FILE instead of stdout\n",
+        program, program, runner::DEFAULT_CYCLES_PER_FRAME);
+}
+
+static bool parse_number(const char *text, unsigned long long &value)
+{
+    char *end = nullptr;
+    value = std::strtoull(text, &end, 0);
+    return *text != '\0' && *end == '\0';
+}
+
+static void print_display(const chip8::Machine &machine)
+{
+    for (int row = 0; row < chip8::SCREEN_HEIGHT; row++) {
+        for (int column = 0; column < chip8::SCREEN_WIDTH; column++) {
+            unsigned int color = 0;
+            for (int plane = 0; plane < chip8::MAX_PLANES; plane++) {
+                color |= static_cast<unsigned int>((machine.planes[plane][row] >> (chip8::SCREEN_WIDTH - 1 - column)) & 0x1) << plane;
+            }
+            std::putchar(color == 0 ? '.' : color == 1 ? '#' : "0123456789abcdef"[color]);
+        }
+        std::putchar('\n');
+    }
+}
+
+static int run_batch(const std::vector<runner::BatchJob> &jobs, const std::string &output_path,
+                     const runner::RunOptions &options, unsigned int threads)
+{
+    std::FILE *output = stdout;
+    if (!output_path.empty() && !(output = std::fopen(output_path.c_str(), "w"))) {
+        std::fprintf(stderr, "cannot write %s\n", output_path.c_str());
+        return 1;
+    }
+
+    std::size_t failed = runner::run_batch(jobs, options, threads, output);
+
+    if (output != stdout) {
+        std::fclose(output);
+    }
+
+    std::fprintf(stderr, "%zu jobs, %zu failed\n", jobs.size(), failed);
+    return failed == 0 ? 0 : 3;
+}
+
+int main(int argc, char **argv)
+{
+    runner::RunOptions options;
+    std::string rom_path, input_path, state_path, profile_path, trace_path, batch_path, pack_path, output_path;
+    bool show_display = false;
+    const char *single_rom_flag = nullptr;  // The last flag given that only applies to one ROM
+    std::uint16_t trace_from = 0, trace_to = 0xFFFF;
+    unsigned int threads = std::thread::hardware_concurrency();
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        unsigned long long number = 0;
+
+        if (std::strcmp(arg, "--display") == 0) {
+            show_display = true;
+            single_rom_flag = arg;
+            continue;
+        }
+
+        if (arg[0] != '-' || arg[1] == '\0') {
+            rom_path = arg;
+            continue;
+        }
+
+        if (!value) {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+
+        if (std::strcmp(arg, "--platform") == 0) {
+            chip8::Platform platform;
+            if (!chip8::parse_platform_name(value, platform)) {
+                std::fprintf(stderr, "unknown platform '%s'\n", value);
+                return 2;
+            }
+            options.platform = platform;
+        } else if (std::strcmp(arg, "--input") == 0) {
+            input_path = value;
+        } else if (std::strcmp(arg, "--state") == 0) {
+            state_path = value;
+            single_rom_flag = arg;
+        } else if (std::strcmp(arg, "--profile") == 0) {
+            profile_path = value;
+            single_rom_flag = arg;
+        } else if (std::strcmp(arg, "--trace") == 0) {
+            trace_path = value;
+            single_rom_flag = arg;
+        } else if (std::strcmp(arg, "--batch") == 0) {
+            batch_path = value;
+        } else if (std::strcmp(arg, "--pack") == 0) {
+            pack_path = value;
+        } else if (std::strcmp(arg, "--output") == 0) {
+            output_path = value;
+        } else if (!parse_number(value, number)) {
+            std::fprintf(stderr, "%s expects a number\n", arg);
+            return 2;
+        } else if (std::strcmp(arg, "--frames") == 0) {
+            options.frames = static_cast<std::uint32_t>(number);
+        } else if (std::strcmp(arg, "--cycles") == 0) {
+            options.cycles_per_frame = static_cast<unsigned int>(number);
+        } else if (std::strcmp(arg, "--max-cycles") == 0) {
+            options.max_cycles = number;
+        } else if (std::strcmp(arg, "--hash-every") == 0) {
+            options.hash_interval = static_cast<std::uint32_t>(number);
+        } else if (std::strcmp(arg, "--seed") == 0) {
+            options.seed = number;
+        } else if (std::strcmp(arg, "--trace-from") == 0) {
+            trace_from = static_cast<std::uint16_t>(number);
+            single_rom_flag = arg;
+        } else if (std::strcmp(arg, "--trace-to") == 0) {
+            trace_to = static_cast<std::uint16_t>(number);
+            single_rom_flag = arg;
+        } else if (std::strcmp(arg, "--jobs") == 0) {
+            threads = static_cast<unsigned int>(number);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    // run_frame either profiles or traces, and a profile of a traced run would be empty
+    if (!profile_path.empty() && !trace_path.empty()) {
+        std::fprintf(stderr, "--profile and --trace cannot be used together\n");
+        return 2;
+    }
+
+    std::string error;
+    if (!batch_path.empty()) {
+        if (single_rom_flag) {
+            std::fprintf(stderr, "%s cannot be used with --batch\n", single_rom_flag);
+            return 2;
+        }
+
+        std::vector<runner::BatchJob> jobs;
+        if (!runner::load_batch_manifest(batch_path, jobs, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        return run_batch(jobs, output_path, options, threads);
+    }
+
+    if (!pack_path.empty()) {
+        if (single_rom_flag) {
+            std::fprintf(stderr, "%s cannot be used with --pack\n", single_rom_flag);
+            return 2;
+        }
+
+        chip8::RomPack pack;
+        if (!pack.open(pack_path, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        return run_batch(runner::make_pack_jobs(pack_path, pack, input_path), output_path, options, threads);
+    }
+
+    if (rom_path.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    chip8::MappedFile rom_file;
+    if (!rom_file.open(rom_path, error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    std::span<const std::uint8_t> rom = rom_file.data();
+
+    runner::InputScript script;
+    if (!input_path.empty() && !runner::load_input_script(input_path, script, error)) {
+        std::fprintf(stderr, "%s: %s\n", input_path.c_str(), error.c_str());
+        return 1;
+    }
+
+    chip8::Profile profile;
+    if (!profile_path.empty()) {
+        options.profile = &profile;
+    }
+
+    // The trace header names the platform, resolved the same way run_rom() does
+    chip8::TraceRecorder trace;
+    if (!trace_path.empty()) {
+        const chip8::RomInfo *info = chip8::identify_rom(rom.data(), rom.size());
+        if (!trace.open(trace_path, options.platform.value_or(info ? info->platform : chip8::Platform::modern), error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        trace.set_pc_range(trace_from, trace_to);
+        options.trace = &trace;
+    }
+
+    chip8::Machine machine;
+    runner::RunResult result = runner::run_rom(machine, rom, script, options);
+    trace.close();
+
+    std::printf("rom=%s title=\"%s\" platform=%s cycles_per_frame=%u\n", rom_path.c_str(),
+                result.title ? result.title : "", chip8::get_platform_name(result.platform), result.cycles_per_frame);
+
+    if (!result.loaded) {
+        std::fprintf(stderr, "cannot load %s: %s\n", rom_path.c_str(), chip8::describe_fault(result.fault));
+        return 1;
+    }
+
+    for (const auto &frame : result.hashes) {
+        std::printf("frame=%u hash=%016llx\n", frame.frame, static_cast<unsigned long long>(frame.hash));
+    }
+
+    double mips = result.seconds > 0 ? static_cast<double>(result.cycles) / result.seconds / 1e6 : 0;
+    std::printf("frames=%u cycles=%llu hash=%016llx state=%016llx fault=\"%s\" pc=0x%04x seconds=%.6f mips=%.2f\n",
+                result.frames, static_cast<unsigned long long>(result.cycles),
+                static_cast<unsigned long long>(result.display_hash),
+                static_cast<unsigned long long>(result.state_hash), chip8::describe_fault(result.fault),
+                machine.program_counter, result.seconds, mips);
+
+    if (show_display) {
+        print_display(machine);
+    }
+
+    if (!profile_path.empty()) {
+        std::string report = chip8::format_profile_report(profile, rom, chip8::PROGRAM_START_ADDRESS, result.platform);
+        std::ofstream output(profile_path);
+        output << report;
+        if (!output) {
+            std::fprintf(stderr, "cannot write %s\n", profile_path.c_str());
+            return 1;
+        }
+    }
+
+    if (!state_path.empty()) {
+        std::vector<std::uint8_t> state(chip8::get_state_size(machine));
+        chip8::save_state(machine, state.data(), state.size());
+
+        std::ofstream output(state_path, std::ios::binary);
+        output.write(reinterpret_cast<const char *>(state.data()), static_cast<std::streamsize>(state.size()));
+        if (!output) {
+            std::fprintf(stderr, "cannot write %s\n", state_path.c_str());
+            return 1;
+        }
+    }
+
+    return result.fault == chip8::Fault::none ? 0 : 3;
+}
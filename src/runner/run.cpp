@@ -0,0 +1,79 @@
+#include <chrono>
+#include "run.h"
+#include "../romdb.h"
+
+namespace runner {
+    std::uint64_t hash_display(const chip8::Machine &machine)
+    {
+        std::uint64_t hash = 0xcbf29ce484222325;
+        for (int plane = 0; plane < chip8::MAX_PLANES; plane++) {
+            for (auto row : machine.planes[plane]) {
+                for (int byte = 0; byte < 8; byte++) {
+                    hash ^= (row >> (8 * byte)) & 0xFF;
+                    hash *= 0x100000001b3;
+                }
+            }
+        }
+        return hash;
+    }
+
+    RunResult run_rom(chip8::Machine &machine, std::span<const std::uint8_t> rom,
+                      const InputScript &script, const RunOptions &options)
+    {
+        RunResult result;
+
+        const chip8::RomInfo *info = chip8::identify_rom(rom.data(), rom.size());
+        result.title = info ? info->title : nullptr;
+        result.platform = options.platform.value_or(info ? info->platform : chip8::Platform::modern);
+        result.cycles_per_frame = options.cycles_per_frame.value_or(info ? info->cycles_per_frame : DEFAULT_CYCLES_PER_FRAME);
+
+        chip8::seed_random(machine, options.seed);
+        chip8::reset(machine, result.platform);
+        result.loaded = chip8::load_rom(machine, rom);
+        if (!result.loaded) {
+            result.fault = chip8::get_fault(machine);
+            return result;
+        }
+
+        std::size_t next_event = 0;
+        std::uint16_t keys = 0;
+
+        auto start = std::chrono::steady_clock::now();
+
+        while (result.frames < options.frames) {
+            keys = script.keys_at(result.frames, next_event, keys);
+            machine.keys = keys;
+
+            unsigned int cycles = result.cycles_per_frame;
+            if (options.max_cycles != 0 && options.max_cycles - result.cycles < cycles) {
+                cycles = static_cast<unsigned int>(options.max_cycles - result.cycles);
+            }
+
+            if (options.trace) {
+                result.cycles += chip8::run_frame(machine, cycles, *options.trace);
+            } else if (options.profile) {
+                result.cycles += chip8::run_frame(machine, cycles, *options.profile);
+            } else {
+                result.cycles += chip8::run_frame(machine, cycles);
+            }
+            result.frames++;
+
+            if (options.hash_interval != 0 && result.frames % options.hash_interval == 0) {
+                result.hashes.push_back({ result.frames, hash_display(machine) });
+            }
+
+            if (chip8::get_fault(machine) != chip8::Fault::none
+                || (options.max_cycles != 0 && result.cycles >= options.max_cycles)) {
+                break;
+            }
+        }
+
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.display_hash = hash_display(machine);
+        chip8::StateHash state_hash;
+        result.state_hash = chip8::update_state_hash(machine, state_hash);
+        result.fault = chip8::get_fault(machine);
+
+        return result;
+    }
+}
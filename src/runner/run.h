@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+#include "../chip8.h"
+#include "../profile.h"
+#include "../trace.h"
+#include "script.h"
+
+namespace runner {
+    struct RunOptions {
+        std::optional<chip8::Platform> platform;        // Defaults to the ROM database, then modern
+        std::optional<unsigned int> cycles_per_frame;   // Defaults to the ROM database, then DEFAULT_CYCLES_PER_FRAME
+        std::uint32_t frames = 600;
+        std::uint64_t max_cycles = 0;                   // Stop early after this many instructions, 0 for no limit
+        std::uint32_t hash_interval = 0;                // Record a display hash every N frames, 0 for only the last
+        std::uint64_t seed = 0;                         // Seeds the machine's random numbers
+        chip8::Profile *profile = nullptr;              // Counts executions here if set, see profile.h
+        chip8::TraceRecorder *trace = nullptr;          // Records every instruction here if set, see trace.h. Not with profile
+    };
+
+    inline constexpr unsigned int DEFAULT_CYCLES_PER_FRAME = 700 / 60;
+
+    struct FrameHash {
+        std::uint32_t frame;
+        std::uint64_t hash;
+    };
+
+    struct RunResult {
+        bool loaded = false;
+        const char *title = nullptr; // From the ROM database, if the ROM is known
+        chip8::Platform platform = chip8::Platform::modern;
+        unsigned int cycles_per_frame = 0;
+
+        std::uint32_t frames = 0;
+        std::uint64_t cycles = 0;
+        std::vector<FrameHash> hashes;
+        std::uint64_t display_hash = 0;
+        std::uint64_t state_hash = 0;  // Of the whole final machine, see chip8::update_state_hash()
+        chip8::Fault fault = chip8::Fault::none;
+        double seconds = 0;          // Time spent running frames, excluding ROM loading
+    };
+
+    // FNV-1a over the packed bitplanes, independent of the palette
+    std::uint64_t hash_display(const chip8::Machine &machine);
+
+    // Reset machine, load the ROM and run it headless with scripted input
+    RunResult run_rom(chip8::Machine &machine, std::span<const std::uint8_t> rom,
+                      const InputScript &script, const RunOptions &options);
+}
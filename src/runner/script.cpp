@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "script.h"
+
+namespace runner {
+    std::uint16_t InputScript::keys_at(std::uint32_t frame, std::size_t &next_event, std::uint16_t keys) const
+    {
+        while (next_event < events.size() && events[next_event].frame <= frame) {
+            keys = events[next_event++].keys;
+        }
+        return keys;
+    }
+
+    bool parse_input_script(const std::string &text, InputScript &script, std::string &error)
+    {
+        std::istringstream input(text);
+        std::string line;
+        unsigned int line_number = 0;
+
+        script.events.clear();
+
+        while (std::getline(input, line)) {
+            line_number++;
+            line = line.substr(0, line.find('#'));
+
+            std::istringstream fields(line);
+            std::string frame, keys;
+            if (!(fields >> frame)) {
+                continue; // Blank or comment-only line
+            }
+
+            InputEvent event {};
+            try {
+                size_t end = 0;
+                unsigned long value = std::stoul(frame, &end);
+                if (end != frame.size() || value > UINT32_MAX) throw std::invalid_argument(frame);
+                event.frame = static_cast<std::uint32_t>(value);
+            } catch (const std::exception &) {
+                error = "line " + std::to_string(line_number) + ": bad frame number '" + frame + "'";
+                return false;
+            }
+
+            if (!(fields >> keys)) {
+                error = "line " + std::to_string(line_number) + ": missing keys";
+                return false;
+            }
+            if (keys != "-") {
+                for (char digit : keys) {
+                    std::string hex(1, digit);
+                    if (!std::isxdigit(static_cast<unsigned char>(digit))) {
+                        error = "line " + std::to_string(line_number) + ": bad key '" + hex + "'";
+                        return false;
+                    }
+                    event.keys |= static_cast<std::uint16_t>(1u << std::stoul(hex, nullptr, 16));
+                }
+            }
+
+            script.events.push_back(event);
+        }
+
+        std::stable_sort(script.events.begin(), script.events.end(),
+                         [](const InputEvent &a, const InputEvent &b) { return a.frame < b.frame; });
+        return true;
+    }
+
+    bool load_input_script(const std::string &path, InputScript &script, std::string &error)
+    {
+        std::ifstream input(path);
+        if (!input) {
+            error = "cannot open " + path;
+            return false;
+        }
+
+        std::stringstream text;
+        text << input.rdbuf();
+        return parse_input_script(text.str(), script, error);
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace runner {
+    /*
+        Scripted keypad input. One "<frame> <keys>" entry per line, where keys are the hex digits of
+        every key held from that frame on (e.g. "120 5a"), or "-" for none. '#' starts a comment.
+    */
+    struct InputEvent {
+        std::uint32_t frame;
+        std::uint16_t keys;
+    };
+
+    struct InputScript {
+        std::vector<InputEvent> events; // Sorted by frame
+
+        // Keys held during a frame. next_event is a cursor for callers walking frames in order.
+        std::uint16_t keys_at(std::uint32_t frame, std::size_t &next_event, std::uint16_t keys) const;
+    };
+
+    // Returns false and fills error on malformed input
+    bool parse_input_script(const std::string &text, InputScript &script, std::string &error);
+
+    bool load_input_script(const std::string &path, InputScript &script, std::string &error);
+}
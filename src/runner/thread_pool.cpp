@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <thread>
+#include "thread_pool.h"
+
+namespace runner {
+    WorkStealingPool::WorkStealingPool(unsigned int workers)
+    {
+        if (workers == 0) {
+            workers = 1;
+        }
+
+        for (unsigned int i = 0; i < workers; i++) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+    }
+
+    bool WorkStealingPool::pop(unsigned int worker, std::size_t &job)
+    {
+        Queue &queue = *queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.jobs.empty()) {
+            return false;
+        }
+
+        job = queue.jobs.back();
+        queue.jobs.pop_back();
+        return true;
+    }
+
+    bool WorkStealingPool::steal(unsigned int thief, std::size_t &job)
+    {
+        // Start with the next worker along, so thieves spread over different victims
+        for (unsigned int offset = 1; offset < worker_count(); offset++) {
+            Queue &queue = *queues[(thief + offset) % worker_count()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+
+            if (!queue.jobs.empty()) {
+                job = queue.jobs.front();
+                queue.jobs.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void WorkStealingPool::run(std::size_t job_count, const std::function<void(unsigned int, std::size_t)> &task)
+    {
+        // Deal the jobs out in contiguous blocks and push them so the owner pops them in order, which keeps
+        // results arriving roughly in job order for the caller. Thieves take from the far end of a block.
+        std::size_t block = (job_count + worker_count() - 1) / worker_count();
+        for (unsigned int worker = 0; worker < worker_count(); worker++) {
+            auto &jobs = queues[worker]->jobs;
+            jobs.clear();
+            for (std::size_t job = std::min(job_count, (worker + 1) * block); job > worker * block; job--) {
+                jobs.push_back(job - 1);
+            }
+        }
+
+        auto work = [&](unsigned int worker) {
+            std::size_t job;
+            while (pop(worker, job) || steal(worker, job)) {
+                task(worker, job);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned int worker = 1; worker < worker_count(); worker++) {
+            threads.emplace_back(work, worker);
+        }
+        work(0);
+
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+}
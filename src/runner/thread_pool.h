@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace runner {
+    /*
+        Runs a fixed set of jobs over a group of threads. Each worker owns a deque of job indexes and
+        takes work from its back; when it runs dry it steals from the front of another worker's deque.
+        Jobs are never added while running, so a worker finding every deque empty is done.
+    */
+    class WorkStealingPool {
+    public:
+        explicit WorkStealingPool(unsigned int workers);
+
+        unsigned int worker_count() const { return static_cast<unsigned int>(queues.size()); }
+
+        // Call task(worker, job) once for each job in [0, job_count) and wait for all of them
+        void run(std::size_t job_count, const std::function<void(unsigned int, std::size_t)> &task);
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<std::size_t> jobs;
+        };
+
+        bool pop(unsigned int worker, std::size_t &job);
+        bool steal(unsigned int thief, std::size_t &job);
+
+        std::vector<std::unique_ptr<Queue>> queues;
+    };
+}
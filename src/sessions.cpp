@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include "sessions.h"
+
+namespace chip8 {
+    namespace {
+        // Whether the machine is stuck in Fx0A until its keys change: every instruction it would run
+        // is the same Fx0A, which does nothing but count a cycle
+        bool is_waiting_for_key(const Machine &machine)
+        {
+            std::size_t pc = machine.program_counter;
+            if (machine.waiting_for_vblank || pc + 1 >= static_cast<std::size_t>(get_memory_size(machine))) {
+                return false;
+            }
+
+            std::uint16_t instruction = static_cast<std::uint16_t>(read_memory(machine, pc) << 8 | read_memory(machine, pc + 1));
+            if ((instruction & 0xF0FF) != 0xF00A) {
+                return false;
+            }
+
+            // Waiting for a press, or for the pressed key to be released
+            return machine.pending_key < 0 ? machine.keys == 0 : ((machine.keys >> machine.pending_key) & 1) != 0;
+        }
+    }
+
+    struct Scheduler::SessionTask {
+        struct promise_type {
+            SessionTask get_return_object() { return { std::coroutine_handle<promise_type>::from_promise(*this) }; }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    struct Scheduler::Session {
+        SessionId id;
+        Machine machine;
+        unsigned int cycles_per_frame;
+        SessionState state = SessionState::runnable;
+        std::uint64_t parked_frame = 0;     // Frames the machine has run or caught up on, while not runnable
+        bool woken = false;                 // Queued to run again after waiting for a key
+        std::coroutine_handle<> coroutine;
+
+        ~Session()
+        {
+            if (coroutine) {
+                coroutine.destroy();
+            }
+        }
+    };
+
+    // Resumed on the next frame
+    struct Scheduler::NextFrame {
+        Scheduler &scheduler;
+        Session &session;
+
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<>) { scheduler.runnable.push_back(session.id); }
+        void await_resume() {}
+    };
+
+    // Resumed on the first frame after set_keys() changes the keys
+    struct Scheduler::KeyChange {
+        Scheduler &scheduler;
+        Session &session;
+
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<>)
+        {
+            session.state = SessionState::waiting_for_key;
+            session.parked_frame = scheduler.frame + 1;
+        }
+        void await_resume()
+        {
+            scheduler.catch_up(session);
+            session.state = SessionState::runnable;
+            session.woken = false;
+        }
+    };
+
+    // Never resumed, the session stays halted until it is removed
+    struct Scheduler::Halt {
+        Scheduler &scheduler;
+        Session &session;
+
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<>)
+        {
+            session.state = SessionState::halted;
+            session.parked_frame = scheduler.frame + 1;
+        }
+        void await_resume() {}
+    };
+
+    Scheduler::SessionTask Scheduler::run_session(Scheduler &scheduler, Session &session)
+    {
+        for (;;) {
+            chip8::run_frame(session.machine, session.cycles_per_frame);
+
+            if (session.machine.fault != Fault::none) {
+                co_await Halt { scheduler, session };
+            } else if (is_waiting_for_key(session.machine)) {
+                co_await KeyChange { scheduler, session };
+            } else {
+                co_await NextFrame { scheduler, session };
+            }
+        }
+    }
+
+    Scheduler::Scheduler() = default;
+
+    Scheduler::~Scheduler() = default;
+
+    // Apply the frames a parked session skipped: the timers tick every frame, and a machine in Fx0A
+    // spends its whole cycle budget repeating it
+    void Scheduler::catch_up(Session &session)
+    {
+        std::uint64_t frames = frame - session.parked_frame;
+        if (session.state == SessionState::runnable || frames == 0) {
+            return;
+        }
+
+        Machine &machine = session.machine;
+        machine.delay_timer = static_cast<std::uint8_t>(machine.delay_timer - std::min<std::uint64_t>(frames, machine.delay_timer));
+        machine.sound_timer = static_cast<std::uint8_t>(machine.sound_timer - std::min<std::uint64_t>(frames, machine.sound_timer));
+        if (session.state == SessionState::waiting_for_key) {
+            machine.global_cycle_number += static_cast<std::uint32_t>(frames * session.cycles_per_frame);
+        }
+        session.parked_frame = frame;
+    }
+
+    SessionId Scheduler::add_session(Machine machine, unsigned int cycles_per_frame)
+    {
+        SessionId id = static_cast<SessionId>(sessions.size());
+        auto session = std::make_unique<Session>();
+        session->id = id;
+        session->machine = std::move(machine);
+        session->cycles_per_frame = cycles_per_frame;
+        session->coroutine = run_session(*this, *session).handle;
+
+        sessions.push_back(std::move(session));
+        runnable.push_back(id);
+        live_sessions++;
+        return id;
+    }
+
+    Scheduler::Session *Scheduler::find_session(SessionId id) const
+    {
+        return id < sessions.size() ? sessions[id].get() : nullptr;
+    }
+
+    bool Scheduler::remove_session(SessionId id)
+    {
+        if (!find_session(id)) {
+            return false;
+        }
+
+        // A session is in the runnable list at most once
+        auto queued = std::find(runnable.begin(), runnable.end(), id);
+        if (queued != runnable.end()) {
+            runnable.erase(queued);
+        }
+        sessions[id].reset();
+        live_sessions--;
+        return true;
+    }
+
+    bool Scheduler::set_keys(SessionId id, std::uint16_t keys)
+    {
+        Session *found = find_session(id);
+        if (!found) {
+            return false;
+        }
+
+        Session &session = *found;
+        if (session.machine.keys == keys) {
+            return true;
+        }
+
+        session.machine.keys = keys;
+        if (session.state == SessionState::waiting_for_key && !session.woken) {
+            // Stays marked waiting until resumed, so catch_up() still applies
+            session.woken = true;
+            runnable.push_back(id);
+        }
+        return true;
+    }
+
+    const Machine *Scheduler::get_machine(SessionId id)
+    {
+        Session *session = find_session(id);
+        if (!session) {
+            return nullptr;
+        }
+
+        catch_up(*session);
+        return &session->machine;
+    }
+
+    SessionState Scheduler::get_session_state(SessionId id) const
+    {
+        Session *session = find_session(id);
+        return session ? session->state : SessionState::removed;
+    }
+
+    std::size_t Scheduler::run_frame()
+    {
+        // Sessions resumed now queue themselves for the next frame. Swapping keeps both capacities.
+        ready.clear();
+        ready.swap(runnable);
+
+        // remove_session() takes sessions off the list, so every id here is live
+        for (SessionId id : ready) {
+            sessions[id]->coroutine.resume();
+        }
+
+        frame++;
+        return ready.size();
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "chip8.h"
+
+namespace chip8 {
+    /*
+        Interleaves many machines on one thread, e.g. for hosting interactive sessions. Each session
+        runs as a coroutine that executes one frame and then suspends: until the next frame, until
+        its keys change while the program waits in Fx0A, or for good once the machine faults. Every
+        run_frame() only resumes sessions that can make progress, so sessions idling on input cost
+        nothing per frame however many there are.
+
+        A session that was waiting catches up on the frames it skipped before running again: the
+        timers tick and the cycle count grows as if it had spun in Fx0A, so its state always matches
+        what calling chip8::run_frame() every frame would have produced.
+
+        A scheduler and its sessions belong to one thread; use one scheduler per thread for more.
+    */
+    using SessionId = std::uint32_t;
+
+    enum class SessionState : std::uint8_t {
+        runnable,
+        waiting_for_key, // In Fx0A, and nothing happens until the keys change
+        halted,          // The machine faulted
+        removed,         // Removed, or never added
+    };
+
+    class Scheduler {
+    public:
+        Scheduler();
+        ~Scheduler();
+
+        Scheduler(const Scheduler &) = delete;
+        Scheduler &operator=(const Scheduler &) = delete;
+
+        // Start running a machine, normally with its ROM already loaded, from the next frame on
+        SessionId add_session(Machine machine, unsigned int cycles_per_frame);
+
+        // The calls taking an id return false or null for sessions that were removed or never added
+        bool remove_session(SessionId id);
+
+        // Takes effect from the next frame. Wakes the session if it was waiting for a key.
+        bool set_keys(SessionId id, std::uint16_t keys);
+
+        // The machine as of the last frame. Brings a waiting session's timers up to date first.
+        const Machine *get_machine(SessionId id);
+
+        SessionState get_session_state(SessionId id) const;
+
+        std::size_t session_count() const { return live_sessions; }
+
+        // Advance every session by one 60 Hz frame. Returns the number of sessions resumed.
+        std::size_t run_frame();
+
+    private:
+        struct Session;
+        struct SessionTask;
+        struct NextFrame;
+        struct KeyChange;
+        struct Halt;
+
+        static SessionTask run_session(Scheduler &scheduler, Session &session);
+        void catch_up(Session &session);
+        Session *find_session(SessionId id) const;
+
+        std::vector<std::unique_ptr<Session>> sessions; // Indexed by id, null once removed. Ids are not reused.
+        std::vector<SessionId> runnable;                // Sessions to resume on the next frame
+        std::vector<SessionId> ready;                   // Sessions being resumed by run_frame()
+        std::uint64_t frame = 0;                        // Frames run so far
+        std::size_t live_sessions = 0;
+    };
+}
@@ -0,0 +1,248 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include "chip8.h"
+
+namespace chip8 {
+    /*
+        Save state layout, all values little endian:
+            "C8ST", version, platform, CPU registers, timers, random seed and state, keypad, fault, V0-VF,
+            stack pointer and stack, every plane row, then the whole memory.
+        Bump STATE_VERSION whenever the layout changes.
+    */
+    constexpr std::array<std::uint8_t, 4> STATE_MAGIC { 'C', '8', 'S', 'T' };
+    constexpr std::uint8_t STATE_VERSION = 2;
+
+    constexpr size_t STATE_REGISTERS_SIZE = 1
+        + 2 + 2 + 1 + 1 + 1 + 4 + 1     // PC, I, DT, ST, plane mask, cycle number, vblank wait
+        + 8 + 4                         // random seed and state
+        + 2 + 1 + 1                     // keys, pending key, fault
+        + 16 + 1 + 2 * MAX_STACK_DEPTH; // V0-VF, stack pointer, stack
+
+    constexpr size_t STATE_HEADER_SIZE = STATE_MAGIC.size() + 1 + STATE_REGISTERS_SIZE
+        + 8 * SCREEN_HEIGHT * MAX_PLANES;
+
+    namespace {
+        struct StateWriter {
+            uint8_t *data;
+
+            void put8(std::uint8_t value) { *data++ = value; }
+            void put16(std::uint16_t value) { put8(static_cast<std::uint8_t>(value)); put8(static_cast<std::uint8_t>(value >> 8)); }
+            void put32(std::uint32_t value) { put16(static_cast<std::uint16_t>(value)); put16(static_cast<std::uint16_t>(value >> 16)); }
+            void put64(std::uint64_t value) { put32(static_cast<std::uint32_t>(value)); put32(static_cast<std::uint32_t>(value >> 32)); }
+            void put(const std::uint8_t *bytes, size_t size) { std::memcpy(data, bytes, size); data += size; }
+        };
+
+        struct StateReader {
+            const uint8_t *data;
+
+            std::uint8_t get8() { return *data++; }
+            std::uint16_t get16() { std::uint16_t low = get8(); return static_cast<std::uint16_t>(low | get8() << 8); }
+            std::uint32_t get32() { std::uint32_t low = get16(); return low | static_cast<std::uint32_t>(get16()) << 16; }
+            std::uint64_t get64() { std::uint64_t low = get32(); return low | static_cast<std::uint64_t>(get32()) << 32; }
+            void get(std::uint8_t *bytes, size_t size) { std::memcpy(bytes, data, size); data += size; }
+        };
+
+        // Platform and everything else outside the display and memory, STATE_REGISTERS_SIZE bytes
+        void write_registers(StateWriter &writer, const Machine &machine)
+        {
+            writer.put8(static_cast<std::uint8_t>(machine.platform));
+
+            writer.put16(machine.program_counter);
+            writer.put16(machine.i_register);
+            writer.put8(machine.delay_timer);
+            writer.put8(machine.sound_timer);
+            writer.put8(machine.plane_mask);
+            writer.put32(machine.global_cycle_number);
+            writer.put8(machine.waiting_for_vblank ? 1 : 0);
+            writer.put64(machine.random_seed);
+            writer.put32(machine.random_state);
+
+            writer.put16(machine.keys);
+            writer.put8(static_cast<std::uint8_t>(machine.pending_key));
+            writer.put8(static_cast<std::uint8_t>(machine.fault));
+
+            writer.put(machine.registers.data(), machine.registers.size());
+            writer.put8(machine.stack_pointer);
+            for (auto address : machine.stack) {
+                writer.put16(address);
+            }
+        }
+
+        // Little endian whatever the host, so hashes match across machines
+        std::uint64_t load_word(const std::uint8_t *bytes)
+        {
+            std::uint64_t word = 0;
+            for (size_t j = 0; j < 8; j++) {
+                word |= static_cast<std::uint64_t>(bytes[j]) << (8 * j);
+            }
+            return word;
+        }
+
+        // Not cryptographic, it only has to tell diverged machines apart
+        std::uint64_t mix(std::uint64_t hash, std::uint64_t word)
+        {
+            hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+            return hash ^ (hash >> 32);
+        }
+
+        // Salted with the page index, so equal pages at different places do not cancel out
+        std::uint64_t hash_memory_page(const MemoryPage &page, size_t index)
+        {
+            std::uint64_t hash = (index + 1) * 0x9E3779B97F4A7C15ull;
+            for (size_t i = 0; i < PAGE_SIZE; i += 8) {
+                hash = mix(hash, load_word(&page[i]));
+            }
+            return hash;
+        }
+
+        std::uint64_t hash_plane(const Plane &plane, size_t index)
+        {
+            std::uint64_t hash = ~(index + 1) * 0x9E3779B97F4A7C15ull;
+            for (auto row : plane) {
+                hash = mix(hash, row);
+            }
+            return hash;
+        }
+
+        template <typename Page, typename HashPage>
+        void update_pages(SharedPages<Page> &pages, size_t first, StateHash &state, HashPage &&hash_page)
+        {
+            pages.for_each_dirty([&](size_t i) {
+                std::uint64_t hash = hash_page(pages[i], i);
+                state.pages += hash - state.page_hashes[first + i];
+                state.page_hashes[first + i] = hash;
+            });
+            pages.clear_dirty();
+        }
+    }
+
+    size_t get_state_size(const Machine &machine)
+    {
+        return STATE_HEADER_SIZE + static_cast<size_t>(get_memory_size(machine));
+    }
+
+    bool save_state(const Machine &machine, uint8_t *data, size_t size)
+    {
+        if (size < get_state_size(machine)) {
+            return false;
+        }
+
+        StateWriter writer { data };
+        writer.put(STATE_MAGIC.data(), STATE_MAGIC.size());
+        writer.put8(STATE_VERSION);
+        write_registers(writer, machine);
+
+        for (size_t p = 0; p < MAX_PLANES; p++) {
+            for (auto row : machine.planes[p]) {
+                writer.put64(row);
+            }
+        }
+
+        for (size_t page = 0; page < machine.memory.size(); page++) {
+            writer.put(machine.memory[page].data(), PAGE_SIZE);
+        }
+
+        return true;
+    }
+
+    bool load_state(Machine &machine, const uint8_t *data, size_t size)
+    {
+        if (size < STATE_HEADER_SIZE
+            || std::memcmp(data, STATE_MAGIC.data(), STATE_MAGIC.size()) != 0
+            || data[STATE_MAGIC.size()] != STATE_VERSION) {
+            return false;
+        }
+
+        StateReader reader { data + STATE_MAGIC.size() + 1 };
+        auto platform = static_cast<Platform>(reader.get8());
+        if (platform > Platform::xochip || size < STATE_HEADER_SIZE + static_cast<size_t>(get_memory_size(platform))) {
+            return false;
+        }
+
+        // Read into a scratch machine, so a bad state leaves the real one as it was
+        Machine loaded;
+        loaded.platform = platform;
+        loaded.program_counter = reader.get16();
+        loaded.i_register = reader.get16();
+        loaded.delay_timer = reader.get8();
+        loaded.sound_timer = reader.get8();
+        loaded.plane_mask = reader.get8();
+        loaded.global_cycle_number = reader.get32();
+        loaded.waiting_for_vblank = reader.get8() != 0;
+        loaded.random_seed = reader.get64();
+        loaded.random_state = reader.get32();
+
+        loaded.keys = reader.get16();
+        loaded.pending_key = static_cast<std::int8_t>(reader.get8());
+        loaded.fault = static_cast<Fault>(reader.get8());
+
+        reader.get(loaded.registers.data(), loaded.registers.size());
+        loaded.stack_pointer = reader.get8();
+        for (auto &address : loaded.stack) {
+            address = reader.get16();
+        }
+
+        if (loaded.stack_pointer > MAX_STACK_DEPTH || loaded.pending_key > 0xF || loaded.fault > Fault::invalid_opcode
+            || loaded.random_state == 0) {
+            return false;
+        }
+
+        for (size_t p = 0; p < MAX_PLANES; p++) {
+            for (auto &row : loaded.planes.edit(p)) {
+                row = reader.get64();
+            }
+        }
+
+        // Reuse the machine's pages where possible, so a buffer from get_memory_buffer() stays valid
+        size_t pages = static_cast<size_t>(get_memory_size(platform)) / PAGE_SIZE;
+        if (machine.memory.size() == pages) {
+            loaded.memory = std::move(machine.memory);
+        } else {
+            loaded.memory = SharedPages<MemoryPage>(pages);
+        }
+        for (size_t page = 0; page < pages; page++) {
+            reader.get(loaded.memory.edit(page).data(), PAGE_SIZE);
+        }
+
+        machine = std::move(loaded);
+
+        return true;
+    }
+
+    std::uint64_t update_state_hash(Machine &machine, StateHash &state)
+    {
+        // Start over when the page count changed, e.g. on a switch to XO-CHIP
+        size_t memory_pages = machine.memory.size();
+        if (state.page_hashes.size() != memory_pages + MAX_PLANES) {
+            state.page_hashes.assign(memory_pages + MAX_PLANES, 0);
+            state.pages = 0;
+            for (size_t i = 0; i < memory_pages; i++) {
+                state.page_hashes[i] = hash_memory_page(machine.memory[i], i);
+                state.pages += state.page_hashes[i];
+            }
+            for (size_t p = 0; p < MAX_PLANES; p++) {
+                state.page_hashes[memory_pages + p] = hash_plane(machine.planes[p], p);
+                state.pages += state.page_hashes[memory_pages + p];
+            }
+            machine.memory.clear_dirty();
+            machine.planes.clear_dirty();
+        } else {
+            update_pages(machine.memory, 0, state, hash_memory_page);
+            update_pages(machine.planes, memory_pages, state, hash_plane);
+        }
+
+        // Padded to whole words
+        std::array<std::uint8_t, (STATE_REGISTERS_SIZE + 7) / 8 * 8> registers {};
+        StateWriter writer { registers.data() };
+        write_registers(writer, machine);
+
+        std::uint64_t hash = state.pages;
+        for (size_t i = 0; i < registers.size(); i += 8) {
+            hash = mix(hash, load_word(&registers[i]));
+        }
+        return hash;
+    }
+}
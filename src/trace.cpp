@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include "decode.h"
+#include "disassembler.h"
+#include "quirks.h"
+#include "trace.h"
+
+namespace chip8 {
+    namespace {
+        constexpr std::array<std::uint8_t, 4> TRACE_MAGIC { 'C', '8', 'T', 'R' };
+
+        // Records drained per write
+        constexpr std::size_t DRAIN_CHUNK = 4096;
+
+        void put16(std::uint8_t *data, std::uint16_t value)
+        {
+            data[0] = static_cast<std::uint8_t>(value);
+            data[1] = static_cast<std::uint8_t>(value >> 8);
+        }
+
+        std::uint16_t get16(const std::uint8_t *data)
+        {
+            return static_cast<std::uint16_t>(data[0] | data[1] << 8);
+        }
+
+        void write_record(std::uint8_t *data, const TraceRecord &record)
+        {
+            put16(data, static_cast<std::uint16_t>(record.cycle));
+            put16(data + 2, static_cast<std::uint16_t>(record.cycle >> 16));
+            put16(data + 4, record.pc);
+            put16(data + 6, record.instruction);
+            put16(data + 8, record.i_register);
+            put16(data + 10, record.write_address);
+            data[12] = record.vx;
+            data[13] = record.vf;
+            data[14] = record.write_value;
+            data[15] = record.write_count;
+        }
+
+        // On little endian hosts records are written straight from the ring buffer
+        constexpr bool RECORDS_MATCH_FILE = std::endian::native == std::endian::little && sizeof(TraceRecord) == TRACE_RECORD_SIZE
+                                         && offsetof(TraceRecord, pc) == 4 && offsetof(TraceRecord, write_address) == 10
+                                         && offsetof(TraceRecord, write_count) == 15;
+
+        // What an instruction changes besides the PC, to show after it in a listing
+        struct Effects {
+            bool vx = false;
+            bool vf = false;
+            bool i = false;
+        };
+
+        template <typename Q>
+        Effects get_effects(Opcode opcode)
+        {
+            switch (opcode) {
+                case Opcode::ld_byte:
+                case Opcode::add_byte:
+                case Opcode::ld_reg:
+                case Opcode::rnd:
+                case Opcode::ld_vx_dt:
+                case Opcode::ld_key:
+                case Opcode::load_range:
+                    return { true, false, false };
+                case Opcode::or_reg:
+                case Opcode::and_reg:
+                case Opcode::xor_reg:
+                    return { true, Q::logic_resets_vf, false };
+                case Opcode::add_reg:
+                case Opcode::sub_reg:
+                case Opcode::shr:
+                case Opcode::subn:
+                case Opcode::shl:
+                    return { true, true, false };
+                case Opcode::drw:
+                    return { false, true, false };
+                case Opcode::ld_i:
+                case Opcode::ld_i_long:
+                case Opcode::add_i:
+                case Opcode::ld_font:
+                case Opcode::store:
+                    return { false, false, true };
+                case Opcode::load:
+                    return { true, false, true };
+                default:
+                    return {};
+            }
+        }
+    }
+
+    TraceRecorder::TraceRecorder(std::size_t capacity)
+        : records(std::bit_ceil(std::max<std::size_t>(capacity, 1))), mask(records.size() - 1)
+    {
+    }
+
+    TraceRecorder::~TraceRecorder()
+    {
+        close();
+    }
+
+    bool TraceRecorder::open(const std::string &path, Platform platform, std::string &error)
+    {
+        close();
+
+        file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            error = "cannot write " + path;
+            return false;
+        }
+
+        std::array<std::uint8_t, TRACE_HEADER_SIZE> header {};
+        std::memcpy(header.data(), TRACE_MAGIC.data(), TRACE_MAGIC.size());
+        header[4] = TRACE_VERSION;
+        header[5] = static_cast<std::uint8_t>(platform);
+        put16(&header[6], static_cast<std::uint16_t>(TRACE_RECORD_SIZE));
+        std::fwrite(header.data(), 1, header.size(), file);
+
+        // Anything recorded while closed is dropped
+        tail.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        cached_tail = tail.load(std::memory_order_relaxed);
+        stopping.store(false, std::memory_order_relaxed);
+        drain_thread = std::thread(&TraceRecorder::drain, this);
+        return true;
+    }
+
+    void TraceRecorder::close()
+    {
+        if (!file) {
+            return;
+        }
+
+        stopping.store(true, std::memory_order_release);
+        drain_thread.join();
+        std::fclose(file);
+        file = nullptr;
+    }
+
+    void TraceRecorder::wait_for_space(std::uint64_t index)
+    {
+        if (!file) {
+            // Nothing drains the buffer, so make room by dropping the oldest record
+            tail.store(index - records.size() + 1, std::memory_order_relaxed);
+            cached_tail = index - records.size() + 1;
+            return;
+        }
+
+        for (;;) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (index - cached_tail < records.size()) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void TraceRecorder::drain()
+    {
+        std::vector<std::uint8_t> buffer(RECORDS_MATCH_FILE ? 0 : DRAIN_CHUNK * TRACE_RECORD_SIZE);
+
+        for (;;) {
+            // Checked before head, so records pushed before close() are still seen below
+            bool stop = stopping.load(std::memory_order_acquire);
+            std::uint64_t first = tail.load(std::memory_order_relaxed);
+            std::uint64_t last = head.load(std::memory_order_acquire);
+
+            if (first == last) {
+                if (stop) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+
+            // Up to the end of the ring, the rest comes around on the next pass
+            std::uint64_t count = std::min<std::uint64_t>({ last - first, DRAIN_CHUNK, records.size() - (first & mask) });
+            if constexpr (RECORDS_MATCH_FILE) {
+                std::fwrite(&records[first & mask], TRACE_RECORD_SIZE, count, file);
+            } else {
+                for (std::uint64_t i = 0; i < count; i++) {
+                    write_record(&buffer[i * TRACE_RECORD_SIZE], records[(first + i) & mask]);
+                }
+                std::fwrite(buffer.data(), TRACE_RECORD_SIZE, count, file);
+            }
+            tail.store(first + count, std::memory_order_release);
+        }
+
+        std::fflush(file);
+    }
+
+    bool read_trace_header(const std::uint8_t *data, std::size_t size, Platform &platform)
+    {
+        if (size < TRACE_HEADER_SIZE || std::memcmp(data, TRACE_MAGIC.data(), TRACE_MAGIC.size()) != 0
+            || data[4] != TRACE_VERSION || data[5] > static_cast<std::uint8_t>(Platform::xochip)
+            || get16(data + 6) != TRACE_RECORD_SIZE) {
+            return false;
+        }
+        platform = static_cast<Platform>(data[5]);
+        return true;
+    }
+
+    TraceRecord read_trace_record(const std::uint8_t *data)
+    {
+        TraceRecord record;
+        record.cycle = get16(data) | static_cast<std::uint32_t>(get16(data + 2)) << 16;
+        record.pc = get16(data + 4);
+        record.instruction = get16(data + 6);
+        record.i_register = get16(data + 8);
+        record.write_address = get16(data + 10);
+        record.vx = data[12];
+        record.vf = data[13];
+        record.write_value = data[14];
+        record.write_count = data[15];
+        return record;
+    }
+
+    std::size_t format_trace_record(const TraceRecord &record, Platform platform, std::span<char> buffer)
+    {
+        if (buffer.size() < MAX_TRACE_LINE) {
+            return 0;
+        }
+
+        char *out = buffer.data();
+        out += std::snprintf(out, 16, "%10u  ", record.cycle);
+
+        // F000 nnnn is followed by the address it loaded, which I now holds
+        std::array<std::uint8_t, 4> code {
+            static_cast<std::uint8_t>(record.instruction >> 8), static_cast<std::uint8_t>(record.instruction),
+            static_cast<std::uint8_t>(record.i_register >> 8), static_cast<std::uint8_t>(record.i_register),
+        };
+        Opcode opcode = Opcode::invalid;
+        Effects effects;
+        with_quirks(platform, [&](auto quirks) {
+            using Q = decltype(quirks);
+            opcode = decode<Q::xochip_opcodes>(record.instruction);
+            effects = get_effects<Q>(opcode);
+        });
+        std::size_t offset = 0;
+        std::size_t length = disassemble(std::span(code).first(instruction_size(opcode)), offset, record.pc, platform,
+                                         std::span(out, MAX_DISASSEMBLY_LINE));
+        out += length - 1;  // Without the newline
+
+        unsigned int x = (record.instruction >> 8) & 0xF;
+        if (effects.vx) {
+            out += std::snprintf(out, 16, "  V%X=0x%02x", x, record.vx);
+        }
+        if (effects.vf && x != 0xF) {
+            out += std::snprintf(out, 16, "  VF=0x%02x", record.vf);
+        }
+        if (effects.i) {
+            out += std::snprintf(out, 16, "  I=0x%04x", record.i_register);
+        }
+        if (record.write_count > 0) {
+            out += std::snprintf(out, 32, "  [0x%04x]=0x%02x", record.write_address, record.write_value);
+            if (record.write_count > 1) {
+                out += std::snprintf(out, 16, " +%u", record.write_count - 1u);
+            }
+        }
+
+        *out++ = '\n';
+        return static_cast<std::size_t>(out - buffer.data());
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chip8.h"
+
+namespace chip8 {
+    /*
+        One executed instruction, as written by the tracing variants of run_frame() and
+        fetch_decode_execute(). Registers are recorded after the instruction ran: Vx is the register
+        most instructions change, VF their flag. Fx65 and 5xy3 load more registers than Vx, and only
+        the first byte of a memory write is kept along with how many bytes were written.
+    */
+    struct TraceRecord {
+        std::uint32_t cycle;            // global_cycle_number
+        std::uint16_t pc;
+        std::uint16_t instruction;
+        std::uint16_t i_register;
+        std::uint16_t write_address;
+        std::uint8_t vx;
+        std::uint8_t vf;
+        std::uint8_t write_value;
+        std::uint8_t write_count;       // Bytes written to memory from write_address on, 0 for none
+    };
+
+    /*
+        Trace file layout, all values little endian:
+            "C8TR", version, platform, record size (16 bits), then the records back to back, each as
+            cycle, PC, instruction, I, write address, Vx, VF, write value and write count.
+        Bump TRACE_VERSION whenever the layout changes.
+    */
+    inline constexpr std::uint8_t TRACE_VERSION = 1;
+    inline constexpr std::size_t TRACE_HEADER_SIZE = 8;
+    inline constexpr std::size_t TRACE_RECORD_SIZE = 16;
+
+    /*
+        Records instructions into a lock-free ring buffer that a background thread drains to a file.
+        One thread runs machines into the recorder; if the drain falls a whole buffer behind, that
+        thread waits rather than losing records. Only instructions whose address lies in the PC
+        range are kept. Records pushed while no file is open overwrite the oldest ones.
+    */
+    class TraceRecorder {
+    public:
+        // capacity is rounded up to a power of two
+        explicit TraceRecorder(std::size_t capacity = 1 << 16);
+        ~TraceRecorder();
+
+        TraceRecorder(const TraceRecorder &) = delete;
+        TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+        // Start writing to path, which is replaced. Returns false and fills error if it cannot be created.
+        bool open(const std::string &path, Platform platform, std::string &error);
+
+        // Write out everything recorded so far and stop the drain thread
+        void close();
+
+        void set_pc_range(std::uint16_t first, std::uint16_t last)
+        {
+            pc_first = first;
+            pc_last = last;
+        }
+
+        bool in_pc_range(std::uint16_t pc) const { return pc >= pc_first && pc <= pc_last; }
+
+        void push(const TraceRecord &record)
+        {
+            std::uint64_t index = head.load(std::memory_order_relaxed);
+            if (index - cached_tail == records.size()) [[unlikely]] {
+                wait_for_space(index);
+            }
+            records[index & mask] = record;
+            head.store(index + 1, std::memory_order_release);
+        }
+
+        std::uint64_t get_record_count() const { return head.load(std::memory_order_relaxed); }
+
+    private:
+        std::vector<TraceRecord> records;
+        std::size_t mask;
+        std::uint16_t pc_first = 0;
+        std::uint16_t pc_last = 0xFFFF;
+
+        alignas(64) std::atomic<std::uint64_t> head { 0 };     // Next record to write, only the recording thread moves it
+        std::uint64_t cached_tail = 0;                          // Last tail the recording thread saw
+        alignas(64) std::atomic<std::uint64_t> tail { 0 };     // Next record to drain, only the drain thread moves it
+        std::atomic<bool> stopping { false };
+
+        std::FILE *file = nullptr;
+        std::thread drain_thread;
+
+        void wait_for_space(std::uint64_t index);
+        void drain();
+    };
+
+    unsigned int fetch_decode_execute(Machine &machine, unsigned int cycles, TraceRecorder &trace);
+
+    unsigned int run_frame(Machine &machine, unsigned int cycles, TraceRecorder &trace);
+
+    // Reading trace files back: the header, then TRACE_RECORD_SIZE bytes per record up to the end.
+    // Returns false if data does not start with a trace header of this version.
+    bool read_trace_header(const std::uint8_t *data, std::size_t size, Platform &platform);
+
+    TraceRecord read_trace_record(const std::uint8_t *data);
+
+    // Longest line format_trace_record() writes, including its newline
+    inline constexpr std::size_t MAX_TRACE_LINE = 112;
+
+    // One line such as "12345  0x0204  0x7b01  ADD VB, 0x01  VB=0x02", returning its length
+    std::size_t format_trace_record(const TraceRecord &record, Platform platform, std::span<char> buffer);
+}
@@ -0,0 +1,123 @@
+/*
+    Trace decoder: turns a trace written by the runner's --trace into a listing, one executed
+    instruction per line with the registers and memory it changed. The file is read in large
+    chunks and the listing written in large blocks, so traces of millions of instructions decode
+    in a fraction of a second.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+#include <vector>
+#include "../chip8.h"
+#include "../trace.h"
+
+static void usage(const char *program)
+{
+    std::fprintf(stderr,
+        "usage: %s [options] trace\n"
+        "  --from ADDR          only list instructions at ADDR and above\n"
+        "  --to ADDR            only list instructions at ADDR and below\n",
+        program);
+}
+
+static bool parse_address(const char *text, unsigned long &address)
+{
+    char *end = nullptr;
+    address = std::strtoul(text, &end, 0);
+    return *text != '\0' && *end == '\0' && address <= 0xFFFF;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long from = 0, to = 0xFFFF;
+    const char *trace_path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (arg[0] != '-' || arg[1] == '\0') {
+            trace_path = arg;
+            continue;
+        }
+
+        if (!value) {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+
+        if (std::strcmp(arg, "--from") == 0 || std::strcmp(arg, "--to") == 0) {
+            if (!parse_address(value, std::strcmp(arg, "--from") == 0 ? from : to)) {
+                std::fprintf(stderr, "%s expects an address up to 0xffff\n", arg);
+                return 2;
+            }
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!trace_path) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::FILE *input = std::fopen(trace_path, "rb");
+    if (!input) {
+        std::fprintf(stderr, "cannot read %s\n", trace_path);
+        return 1;
+    }
+
+    std::uint8_t header[chip8::TRACE_HEADER_SIZE];
+    chip8::Platform platform;
+    if (std::fread(header, 1, sizeof(header), input) != sizeof(header)
+        || !chip8::read_trace_header(header, sizeof(header), platform)) {
+        std::fprintf(stderr, "%s: not a trace file of version %u\n", trace_path, static_cast<unsigned int>(chip8::TRACE_VERSION));
+        std::fclose(input);
+        return 1;
+    }
+
+    // Records are read and listed a chunk at a time, with the listing flushed whenever it may not fit another line
+    constexpr std::size_t CHUNK_RECORDS = 1 << 14;
+    std::vector<std::uint8_t> records(CHUNK_RECORDS * chip8::TRACE_RECORD_SIZE);
+    std::vector<char> output(1 << 20);
+    std::size_t used = 0;
+    std::size_t leftover = 0;
+
+    while (std::size_t count = std::fread(records.data() + leftover, 1, records.size() - leftover, input)) {
+        std::size_t available = leftover + count;
+        std::size_t whole = available - available % chip8::TRACE_RECORD_SIZE;
+
+        for (std::size_t offset = 0; offset < whole; offset += chip8::TRACE_RECORD_SIZE) {
+            chip8::TraceRecord record = chip8::read_trace_record(&records[offset]);
+            if (record.pc < from || record.pc > to) {
+                continue;
+            }
+            if (output.size() - used < chip8::MAX_TRACE_LINE) {
+                std::fwrite(output.data(), 1, used, stdout);
+                used = 0;
+            }
+            used += chip8::format_trace_record(record, platform, std::span(output).subspan(used));
+        }
+
+        // A record split across reads is finished by the next one
+        leftover = available - whole;
+        std::memmove(records.data(), records.data() + whole, leftover);
+    }
+
+    std::fwrite(output.data(), 1, used, stdout);
+
+    bool ok = !std::ferror(input);
+    std::fclose(input);
+    if (!ok) {
+        std::fprintf(stderr, "cannot read %s\n", trace_path);
+        return 1;
+    }
+    if (leftover != 0) {
+        std::fprintf(stderr, "%s: ends in the middle of a record\n", trace_path);
+        return 1;
+    }
+    return std::fflush(stdout) == 0 ? 0 : 1;
+}
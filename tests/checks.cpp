@@ -0,0 +1,939 @@
+/*
+    Small checks of the library's contracts that the difftest and fuzz runs do not reach: save
+    states, forks, faults, the session scheduler, reward rules, CFG files, ROM packs, the ROM
+    database, the gym interface, trace files, profile counts, batch runs and memory usage. Each
+    check is registered with CTest on its own; run "checks NAME" for one or "checks" for all of them.
+*/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../src/cfg.h"
+#include "../src/chip8.h"
+#include "../src/difftest.h"
+#include "../src/disassembler.h"
+#include "../src/gym/gym.h"
+#include "../src/profile.h"
+#include "../src/reward.h"
+#include "../src/romdb.h"
+#include "../src/rompack.h"
+#include "../src/runner/batch.h"
+#include "../src/runner/thread_pool.h"
+#include "../src/sessions.h"
+#include "../src/trace.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// Draws a random font digit each frame, keeps its BCD at 0x300 and the digit in the delay timer
+static const std::vector<std::uint8_t> DRAWING_ROM = {
+    0x60, 0x05,     // 0x200  LD V0, 0x05
+    0x61, 0x00,     // 0x202  LD V1, 0x00
+    0x62, 0x00,     // 0x204  LD V2, 0x00
+    0xF0, 0x29,     // 0x206  LD F, V0
+    0xD1, 0x25,     // 0x208  DRW V1, V2, 5
+    0xC0, 0x0F,     // 0x20a  RND V0, 0x0f
+    0x71, 0x05,     // 0x20c  ADD V1, 0x05
+    0xA3, 0x00,     // 0x20e  LD I, 0x300
+    0xF0, 0x33,     // 0x210  LD B, V0
+    0xF0, 0x15,     // 0x212  LD DT, V0
+    0x12, 0x06,     // 0x214  JP 0x206
+};
+
+// Waits for a key, then counts key presses in V1 and starts the sound timer
+static const std::vector<std::uint8_t> KEY_ROM = {
+    0x60, 0x3C,     // 0x200  LD V0, 0x3c
+    0xF0, 0x15,     // 0x202  LD DT, V0
+    0xF2, 0x0A,     // 0x204  LD V2, K
+    0x71, 0x01,     // 0x206  ADD V1, 0x01
+    0xF0, 0x18,     // 0x208  LD ST, V0
+    0x12, 0x04,     // 0x20a  JP 0x204
+};
+
+static chip8::Machine start(const std::vector<std::uint8_t> &rom, chip8::Platform platform = chip8::Platform::modern)
+{
+    chip8::Machine machine;
+    chip8::seed_random(machine, 7);
+    chip8::reset(machine, platform);
+    chip8::load_rom(machine, rom.data(), rom.size());
+    return machine;
+}
+
+static void run_frames(chip8::Machine &machine, int frames, unsigned int cycles = 20)
+{
+    for (int frame = 0; frame < frames; frame++) {
+        chip8::run_frame(machine, cycles);
+    }
+}
+
+static std::vector<std::uint8_t> save(const chip8::Machine &machine)
+{
+    std::vector<std::uint8_t> state(chip8::get_state_size(machine));
+    CHECK(chip8::save_state(machine, state.data(), state.size()));
+    return state;
+}
+
+static bool same(const chip8::Machine &expected, const chip8::Machine &actual)
+{
+    std::string differences = chip8::compare_machines(expected, actual, "actual");
+    if (!differences.empty()) {
+        std::fprintf(stderr, "%s", differences.c_str());
+    }
+    return differences.empty();
+}
+
+static void save_load_round_trip()
+{
+    for (chip8::Platform platform : { chip8::Platform::modern, chip8::Platform::schip, chip8::Platform::xochip }) {
+        chip8::Machine machine = start(DRAWING_ROM, platform);
+        run_frames(machine, 30);
+        std::vector<std::uint8_t> state = save(machine);
+
+        chip8::Machine loaded;
+        CHECK(chip8::load_state(loaded, state.data(), state.size()));
+        CHECK(same(machine, loaded));
+        CHECK(save(loaded) == state);
+
+        chip8::StateHash machine_hash, loaded_hash;
+        CHECK(chip8::update_state_hash(machine, machine_hash) == chip8::update_state_hash(loaded, loaded_hash));
+
+        // Both carry on identically, random numbers included
+        run_frames(machine, 30);
+        run_frames(loaded, 30);
+        CHECK(same(machine, loaded));
+    }
+}
+
+static void save_state_validation()
+{
+    chip8::Machine machine = start(DRAWING_ROM);
+    run_frames(machine, 10);
+    const std::vector<std::uint8_t> state = save(machine);
+
+    chip8::Machine target = start(KEY_ROM);
+    const std::vector<std::uint8_t> before = save(target);
+
+    // Offsets into the version 2 layout, see state.cpp
+    auto rejected = [&](std::size_t offset, std::uint8_t value) {
+        std::vector<std::uint8_t> bad = state;
+        bad[offset] = value;
+        return !chip8::load_state(target, bad.data(), bad.size());
+    };
+    CHECK(rejected(0, 'X'));        // Magic
+    CHECK(rejected(4, 1));          // Version
+    CHECK(rejected(5, 4));          // Platform
+    CHECK(rejected(32, 0x10));      // Pending key
+    CHECK(rejected(33, 6));         // Fault
+    CHECK(rejected(50, 17));        // Stack pointer
+
+    std::vector<std::uint8_t> zero_random = state;
+    std::memset(&zero_random[26], 0, 4);
+    CHECK(!chip8::load_state(target, zero_random.data(), zero_random.size()));
+
+    CHECK(!chip8::load_state(target, state.data(), state.size() - 1));
+    CHECK(!chip8::load_state(target, state.data(), 10));
+
+    // A rejected state leaves the machine as it was
+    CHECK(save(target) == before);
+
+    CHECK(chip8::load_state(target, state.data(), state.size()));
+    CHECK(same(machine, target));
+}
+
+static void fork_isolation()
+{
+    chip8::Machine machine = start(DRAWING_ROM);
+    run_frames(machine, 10);
+    const std::vector<std::uint8_t> before = save(machine);
+
+    chip8::Machine child = chip8::fork(machine);
+    CHECK(same(machine, child));
+
+    run_frames(child, 20);
+    chip8::write_memory(child, 0x200, 0xFF);
+    chip8::write_memory(child, chip8::get_memory_size(child) - 1, 0xAA);
+    child.registers[3] = 0x33;
+
+    CHECK(save(machine) == before);
+    CHECK(chip8::read_memory(machine, 0x200) == DRAWING_ROM[0]);
+
+    // And the other way round
+    const std::vector<std::uint8_t> child_state = save(child);
+    run_frames(machine, 5);
+    chip8::write_memory(machine, 0x300, 0x55);
+    CHECK(save(child) == child_state);
+}
+
+static void rom_too_large()
+{
+    const std::size_t space = 4096 - 0x200;
+    std::vector<std::uint8_t> rom(space, 0x12);
+
+    chip8::Machine machine;
+    chip8::reset(machine, chip8::Platform::modern);
+    CHECK(chip8::load_rom(machine, rom.data(), rom.size()));
+    CHECK(chip8::get_fault(machine) == chip8::Fault::none);
+
+    rom.push_back(0);
+    chip8::reset(machine, chip8::Platform::modern);
+    CHECK(!chip8::load_rom(machine, rom.data(), rom.size()));
+    CHECK(chip8::get_fault(machine) == chip8::Fault::rom_too_large);
+
+    chip8::reset(machine, chip8::Platform::xochip);
+    CHECK(chip8::load_rom(machine, rom.data(), rom.size()));
+
+    // A machine that was never reset has no memory to load into
+    chip8::Machine blank;
+    CHECK(!chip8::load_rom(blank, DRAWING_ROM.data(), DRAWING_ROM.size()));
+    CHECK(chip8::get_fault(blank) == chip8::Fault::rom_too_large);
+
+    chip8::RomImage image;
+    CHECK(!chip8::make_rom_image(chip8::Platform::schip, rom.data(), rom.size(), image));
+}
+
+static void fault_reporting()
+{
+    struct Case {
+        std::vector<std::uint8_t> rom;
+        chip8::Fault fault;
+        std::uint16_t address;
+    };
+    const Case cases[] = {
+        { { 0x00, 0xEE }, chip8::Fault::stack_underflow, 0x200 },
+        { { 0x22, 0x00 }, chip8::Fault::stack_overflow, 0x200 },
+        { { 0x60, 0x01, 0x50, 0x01 }, chip8::Fault::invalid_opcode, 0x202 },
+    };
+
+    for (const Case &c : cases) {
+        chip8::Machine machine = start(c.rom);
+        run_frames(machine, 2);
+        CHECK(chip8::get_fault(machine) == c.fault);
+        CHECK(machine.program_counter == c.address);
+        CHECK(std::strlen(chip8::describe_fault(c.fault)) > 0);
+
+        // A faulted machine stays halted
+        std::uint32_t cycles = machine.global_cycle_number;
+        CHECK(chip8::run_frame(machine, 20) == 0);
+        CHECK(machine.global_cycle_number == cycles);
+        CHECK(machine.program_counter == c.address);
+    }
+}
+
+static void scheduler()
+{
+    chip8::Scheduler scheduler;
+    chip8::Machine reference = start(KEY_ROM);
+    chip8::SessionId id = scheduler.add_session(reference, 20);
+    chip8::SessionId drawing = scheduler.add_session(start(DRAWING_ROM), 20);
+    chip8::Machine drawing_reference = start(DRAWING_ROM);
+    CHECK(scheduler.session_count() == 2);
+
+    // The key ROM parks in Fx0A; its state must still match running every frame directly
+    for (int frame = 0; frame < 90; frame++) {
+        std::uint16_t keys = frame == 40 ? 0x0010 : 0;
+        CHECK(scheduler.set_keys(id, keys));
+        reference.keys = keys;
+        scheduler.run_frame();
+        chip8::run_frame(reference, 20);
+        chip8::run_frame(drawing_reference, 20);
+        if (frame == 20) {
+            CHECK(scheduler.get_session_state(id) == chip8::SessionState::waiting_for_key);
+        }
+    }
+    CHECK(scheduler.get_machine(id) && same(reference, *scheduler.get_machine(id)));
+    CHECK(scheduler.get_machine(drawing) && same(drawing_reference, *scheduler.get_machine(drawing)));
+    CHECK(reference.registers[1] == 1);
+
+    // Removed and unknown ids are refused
+    CHECK(scheduler.remove_session(id));
+    CHECK(!scheduler.remove_session(id));
+    CHECK(!scheduler.set_keys(id, 1));
+    CHECK(scheduler.get_machine(id) == nullptr);
+    CHECK(scheduler.get_session_state(id) == chip8::SessionState::removed);
+    CHECK(scheduler.get_machine(1000) == nullptr);
+    CHECK(scheduler.session_count() == 1);
+    CHECK(scheduler.run_frame() == 1);
+
+    // A faulting session halts and is no longer resumed
+    chip8::SessionId faulting = scheduler.add_session(start({ 0x00, 0xEE }), 20);
+    scheduler.run_frame();
+    CHECK(scheduler.get_session_state(faulting) == chip8::SessionState::halted);
+    CHECK(scheduler.run_frame() == 1);
+}
+
+static void reward_parse_errors()
+{
+    chip8::RewardProgram program;
+    std::string error;
+    CHECK(chip8::compile_reward_spec("reward 0x3F0 3 digits delta  # score\n"
+                                     "reward 0x3F8 1 be delta < 0 -10\n"
+                                     "done   0x3F8 1 be value == 0\n", program, error));
+    CHECK(program.rules.size() == 3);
+
+    const char *bad_specs[] = {
+        "reward",
+        "bonus 0x3F0 1 be value",
+        "reward 0x3F0 0 be value",
+        "reward 0x3F0 9 be value",
+        "reward 0x3F0 1 middle value",
+        "reward 0x3F0 1 be total",
+        "reward 0x3F0 1 be value <",
+        "reward 0x3F0 1 be value ~ 3",
+        "reward 0x3F0 1 be value 1 2 3",
+        "reward zero 1 be value",
+        "done 0x3F0 1 be value",
+        "reward 0x10000 1 be value",
+        "reward 0x3F0 8 be value",
+        "reward 0x3F0 8 le value",
+        "reward 0x3F0 1 be value == 0x",
+        "reward 0x3F0 1 be value == --1",
+        "reward 0x3F0 1 be value == 1e3",
+        "reward 0x3F0 1 be value == 9223372036854775808",
+    };
+    // Leading zeros are decimal, only 0x means hex
+    CHECK(chip8::compile_reward_spec("reward 010 8 digits value == 08\n"
+                                     "done 0x10 1 be value >= -0x10\n"
+                                     "done 0 1 be value < -9223372036854775808\n", program, error));
+    if (program.rules.size() == 3) {
+        CHECK(program.rules[0].address == 10 && program.rules[0].constant == 8);
+        CHECK(program.rules[1].address == 16 && program.rules[1].constant == -16);
+        CHECK(program.rules[2].constant == INT64_MIN);
+    }
+
+    // Wide binary values stay positive
+    CHECK(chip8::compile_reward_spec("reward 0 7 be value > 0", program, error));
+    std::vector<std::uint8_t> memory(4096, 0xFF);
+    std::vector<std::int64_t> previous(program.slot_count);
+    CHECK(chip8::evaluate_reward(program, memory.data(), memory.size(), previous.data()).reward == 1);
+
+    for (const char *spec : bad_specs) {
+        error.clear();
+        bool compiled = chip8::compile_reward_spec(spec, program, error);
+        if (compiled || error.empty()) {
+            std::fprintf(stderr, "accepted: %s\n", spec);
+        }
+        CHECK(!compiled && !error.empty());
+    }
+}
+
+static void cfg_round_trip()
+{
+    chip8::ControlFlowGraph cfg = chip8::analyze_control_flow(DRAWING_ROM, 0x200, chip8::Platform::modern);
+    CHECK(!cfg.blocks.empty());
+    CHECK(chip8::find_block(cfg, 0x206) != nullptr);
+
+    std::vector<std::uint8_t> saved = chip8::save_cfg(cfg);
+    chip8::ControlFlowGraph loaded;
+    CHECK(chip8::load_cfg(loaded, saved.data(), saved.size()));
+    CHECK(chip8::save_cfg(loaded) == saved);
+    CHECK(loaded.blocks.size() == cfg.blocks.size() && loaded.functions == cfg.functions && loaded.calls == cfg.calls);
+
+    for (std::size_t size = 0; size < saved.size(); size++) {
+        CHECK(!chip8::load_cfg(loaded, saved.data(), size));
+    }
+    std::vector<std::uint8_t> bad_magic = saved;
+    bad_magic[0] ^= 0xFF;
+    CHECK(!chip8::load_cfg(loaded, bad_magic.data(), bad_magic.size()));
+
+    // Malformed blocks. The two blocks, 0x200-0x206 and 0x206-0x216, follow the 16-byte header as
+    // start, end, kind and two successors; see cfg.cpp.
+    CHECK(cfg.blocks.size() == 2);
+    auto rejected = [&](std::size_t block, std::size_t field, std::uint16_t value) {
+        std::vector<std::uint8_t> bad = saved;
+        std::size_t offset = 16 + block * 9 + field * 2;
+        bad[offset] = static_cast<std::uint8_t>(value);
+        bad[offset + 1] = static_cast<std::uint8_t>(value >> 8);
+        return !chip8::load_cfg(loaded, bad.data(), bad.size());
+    };
+    CHECK(rejected(0, 1, 0x1FE));                           // Ends before it starts
+    CHECK(rejected(0, 1, 0x200));                           // Empty
+    CHECK(rejected(0, 0, 0x1FE));                           // Starts before the ROM
+    CHECK(rejected(1, 1, 0x200 + DRAWING_ROM.size() + 2));  // Ends past the ROM
+    CHECK(rejected(1, 0, 0x200));                           // Out of order
+    CHECK(rejected(1, 0, 0xFFFE));
+    CHECK(!rejected(1, 0, 0x204));                          // Overlapping is allowed, XO-CHIP produces it
+}
+
+static void rompack_validation()
+{
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "chip8-checks.c8pack";
+    auto write = [&](const std::vector<std::uint8_t> &bytes) {
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    };
+    auto put = [](std::vector<std::uint8_t> &bytes, std::uint64_t value, int size) {
+        for (int i = 0; i < size; i++) {
+            bytes.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+        }
+    };
+
+    // Header, two index entries, the names "a" and "bc", then two ROMs of 2 and 4 bytes
+    std::vector<std::uint8_t> pack = { 'C', 'H', '8', 'P', 'A', 'C', 'K', 0 };
+    put(pack, chip8::ROM_PACK_VERSION, 4);
+    put(pack, 2, 4);
+    const std::uint64_t names = chip8::ROM_PACK_HEADER_SIZE + 2 * chip8::ROM_PACK_ENTRY_SIZE;
+    put(pack, names + 3, 8); put(pack, names, 8); put(pack, 2, 4); put(pack, 1, 4);
+    put(pack, names + 5, 8); put(pack, names + 1, 8); put(pack, 4, 4); put(pack, 2, 4);
+    pack.insert(pack.end(), { 'a', 'b', 'c', 0x00, 0xE0, 0x12, 0x00, 0x12, 0x02 });
+
+    chip8::RomPack roms;
+    std::string error;
+    write(pack);
+    CHECK(roms.open(path.string(), error));
+    CHECK(roms.size() == 2);
+    if (roms.size() == 2) {
+        CHECK(roms[0].name == "a" && roms[0].data.size() == 2 && roms[0].data[1] == 0xE0);
+        CHECK(roms[1].name == "bc" && roms[1].data.size() == 4 && roms[1].data[3] == 0x02);
+    }
+
+    auto rejected = [&](const std::vector<std::uint8_t> &bytes) {
+        write(bytes);
+        error.clear();
+        return !roms.open(path.string(), error) && !error.empty() && roms.size() == 0;
+    };
+    std::vector<std::uint8_t> bad = pack;
+    bad[0] = 'X';
+    CHECK(rejected(bad));
+    bad = pack;
+    bad[8] = 2;
+    CHECK(rejected(bad));
+    bad = pack;
+    bad[12] = 200;
+    CHECK(rejected(bad));
+    bad = pack;
+    bad[chip8::ROM_PACK_HEADER_SIZE + chip8::ROM_PACK_ENTRY_SIZE + 16] = 5;
+    CHECK(rejected(bad));
+    CHECK(rejected(std::vector<std::uint8_t>(pack.begin(), pack.begin() + 12)));
+    CHECK(rejected(std::vector<std::uint8_t>(pack.begin(), pack.end() - 1)));
+
+    std::filesystem::remove(path);
+    CHECK(!roms.open(path.string(), error));
+}
+
+static void jump_offset_disassembly()
+{
+    const std::vector<std::uint8_t> code = { 0xB3, 0x10 };
+    auto line = [&](chip8::Platform platform) {
+        std::string text;
+        chip8::disassemble(code, 0x200, platform, [&](std::string_view lines) { text += lines; });
+        return text;
+    };
+    CHECK(line(chip8::Platform::modern).find("JP V0, 0x310") != std::string::npos);
+    CHECK(line(chip8::Platform::schip).find("JP V3, 0x310") != std::string::npos);
+}
+
+static std::string hex(const chip8::Sha1Digest &digest)
+{
+    std::string text;
+    for (std::uint8_t byte : digest) {
+        text += "0123456789abcdef"[byte >> 4];
+        text += "0123456789abcdef"[byte & 0xF];
+    }
+    return text;
+}
+
+static void sha1_vectors()
+{
+    auto sha1 = [](std::string_view text) {
+        return hex(chip8::sha1(reinterpret_cast<const std::uint8_t *>(text.data()), text.size()));
+    };
+    CHECK(sha1("") == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    CHECK(sha1("abc") == "a9993e364706816aba3e25717850c26c9cd0d89d");
+    CHECK(sha1("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq") == "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+
+    // Around the padding boundaries: 55 bytes fit one padded block, 56 need a second, 64 fill one
+    CHECK(sha1(std::string(55, 'a')) == "c1c8bbdc22796e28c0e15163d20899b65621d65a");
+    CHECK(sha1(std::string(56, 'a')) == "c2db330f6083854c99d4b5bfb6e8f29f201be699");
+    CHECK(sha1(std::string(63, 'a')) == "03f09f5b158a7a8cdad920bddc29b81c18a551f5");
+    CHECK(sha1(std::string(64, 'a')) == "0098ba824b5c16427bd7a1122a5a442a25ec644d");
+    CHECK(sha1(std::string(65, 'a')) == "11655326c708d70319be2610e8a57d9a5b959d3b");
+    CHECK(sha1(std::string(1000000, 'a')) == "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+}
+
+static void rom_database()
+{
+    // DRAWING_ROM is in the checks' own database, see tests/romdb_checks.inc
+    CHECK(chip8::get_rom_database_size() >= 1);
+
+    const chip8::RomInfo *info = chip8::identify_rom(DRAWING_ROM.data(), DRAWING_ROM.size());
+    CHECK(info != nullptr);
+    if (info) {
+        CHECK(hex(info->sha1) == "c6ec05380a7e30624cd79e57d0a9cbd8be2d7453");
+        CHECK(std::string_view(info->title) == "Checks \"drawing\" ROM");
+        CHECK(info->platform == chip8::Platform::schip);
+        CHECK(info->cycles_per_frame == 30);
+        const chip8::KeyMap keymap { 0x2, 0x8, 0x4, 0x6, chip8::NO_KEY, chip8::NO_KEY, 0x5, chip8::NO_KEY,
+                                     chip8::NO_KEY, chip8::NO_KEY, chip8::NO_KEY, chip8::NO_KEY };
+        CHECK(info->keymap == keymap);
+        CHECK(chip8::find_rom(info->sha1) == info);
+    }
+
+    // A digest one bit away, and a ROM one byte shorter, are unknown
+    chip8::Sha1Digest digest = chip8::sha1(DRAWING_ROM.data(), DRAWING_ROM.size());
+    digest[19] ^= 1;
+    CHECK(chip8::find_rom(digest) == nullptr);
+    CHECK(chip8::identify_rom(DRAWING_ROM.data(), DRAWING_ROM.size() - 1) == nullptr);
+    CHECK(chip8::identify_rom(KEY_ROM.data(), KEY_ROM.size()) == nullptr);
+}
+
+static void lanes_self_modifying_code()
+{
+    // Lanes holding key 0 rewrite the instruction at 0x210 differently from the rest
+    const std::vector<std::uint8_t> rom = {
+        0x60, 0x72,     // 0x200  LD V0, 0x72
+        0x61, 0x01,     // 0x202  LD V1, 0x01
+        0xE3, 0x9E,     // 0x204  SKP V3
+        0x12, 0x0A,     // 0x206  JP 0x20a
+        0x60, 0x71,     // 0x208  LD V0, 0x71
+        0xA2, 0x10,     // 0x20a  LD I, 0x210
+        0xF1, 0x55,     // 0x20c  LD [I], V1
+        0x63, 0x00,     // 0x20e  LD V3, 0x00
+        0x72, 0x01,     // 0x210  ADD V2, 0x01, or ADD V1, 0x01 once rewritten
+        0x12, 0x00,     // 0x212  JP 0x200
+    };
+
+    chip8::DiffOptions options;
+    options.frames = 60;
+    options.lane_count = 64;
+    for (std::uint64_t key_seed = 1; key_seed <= 3; key_seed++) {
+        options.key_seed = key_seed;
+        chip8::DiffResult result = chip8::run_differential(chip8::Backend::lanes, rom, options);
+        CHECK(result.status == chip8::DiffStatus::match);
+        if (result.status != chip8::DiffStatus::match) {
+            std::fprintf(stderr, "%s", result.report.c_str());
+        }
+    }
+}
+
+// Draws the 0 digit at the top left once key 0 is seen held, then stops
+static const std::vector<std::uint8_t> KEY_DRAW_ROM = {
+    0x60, 0x00,     // 0x200  LD V0, 0x00
+    0xF0, 0x29,     // 0x202  LD F, V0
+    0xE0, 0xA1,     // 0x204  SKNP V0
+    0x12, 0x0A,     // 0x206  JP 0x20a
+    0x12, 0x04,     // 0x208  JP 0x204
+    0xD0, 0x05,     // 0x20a  DRW V0, V0, 5
+    0x12, 0x0C,     // 0x20c  JP 0x20c
+};
+
+static void gym_stepping()
+{
+    chip8_gym_config config;
+    chip8_gym_default_config(&config);
+    config.num_envs = 2;
+    config.platform = CHIP8_GYM_PLATFORM_MODERN;
+    config.frameskip = 4;
+    config.max_episode_frames = 10;
+    config.downsample = 4;
+
+    chip8_gym *gym = chip8_gym_create(KEY_DRAW_ROM.data(), KEY_DRAW_ROM.size(), &config);
+    CHECK(gym != nullptr);
+    if (!gym) {
+        return;
+    }
+    CHECK(chip8_gym_num_envs(gym) == 2);
+
+    // Only the first environment holds key 0
+    const std::uint16_t actions[] = { 0x0001, 0x0000 };
+    const std::uint64_t *observations = chip8_gym_observations(gym);
+    const std::uint8_t *pixels = chip8_gym_pixels(gym);
+    chip8_gym_step(gym, actions);
+    CHECK(chip8_gym_episode_frames(gym)[0] == 4 && chip8_gym_episode_frames(gym)[1] == 4);
+    CHECK(chip8_gym_dones(gym)[0] == 0 && chip8_gym_dones(gym)[1] == 0);
+    CHECK(observations[0] == 0xF0ull << 56 && observations[4] == 0xF0ull << 56 && observations[5] == 0);
+    CHECK(observations[chip8::SCREEN_HEIGHT] == 0);
+
+    // 16 x 8 cells of 4 x 4 pixels: the digit lights 10 of the first cell and 4 of the one below
+    const std::size_t cells = (chip8::SCREEN_HEIGHT / 4) * (chip8::SCREEN_WIDTH / 4);
+    CHECK(pixels[0] == 10 * 255 / 16 && pixels[1] == 0 && pixels[16] == 4 * 255 / 16);
+    CHECK(std::all_of(pixels + cells, pixels + 2 * cells, [](std::uint8_t pixel) { return pixel == 0; }));
+
+    // The episode ends two frames into the third step and starts over, blank, by the end of it
+    chip8_gym_step(gym, actions);
+    CHECK(chip8_gym_episode_frames(gym)[0] == 8 && chip8_gym_dones(gym)[0] == 0);
+    chip8_gym_step(gym, actions);
+    CHECK(chip8_gym_dones(gym)[0] == 1 && chip8_gym_dones(gym)[1] == 1);
+    CHECK(chip8_gym_episode_frames(gym)[0] == 0 && chip8_gym_episode_frames(gym)[1] == 0);
+    CHECK(observations[0] == 0 && pixels[0] == 0);
+    chip8_gym_step(gym, actions);
+    CHECK(chip8_gym_dones(gym)[0] == 0 && chip8_gym_episode_frames(gym)[0] == 4);
+    CHECK(observations[0] == 0xF0ull << 56);
+    chip8_gym_destroy(gym);
+
+    // Sticky actions: environments that always repeat their last action keep the no keys they
+    // started with, and at even odds some of many take up the new action on the first frame
+    config.num_envs = 64;
+    config.frameskip = 1;
+    config.max_episode_frames = 0;
+    config.downsample = 0;
+    config.sticky_action_probability = 1;
+    gym = chip8_gym_create(KEY_DRAW_ROM.data(), KEY_DRAW_ROM.size(), &config);
+    CHECK(gym != nullptr && chip8_gym_pixels(gym) == nullptr);
+    if (!gym) {
+        return;
+    }
+    const std::vector<std::uint16_t> all_pressed(64, 0x0001);
+    for (int step = 0; step < 5; step++) {
+        chip8_gym_step(gym, all_pressed.data());
+    }
+    int drawn = 0;
+    for (int env = 0; env < 64; env++) {
+        drawn += chip8_gym_observations(gym)[env * chip8::SCREEN_HEIGHT] != 0;
+    }
+    CHECK(drawn == 0);
+    chip8_gym_destroy(gym);
+
+    config.sticky_action_probability = 0.5f;
+    gym = chip8_gym_create(KEY_DRAW_ROM.data(), KEY_DRAW_ROM.size(), &config);
+    CHECK(gym != nullptr);
+    if (!gym) {
+        return;
+    }
+    chip8_gym_step(gym, all_pressed.data());
+    drawn = 0;
+    for (int env = 0; env < 64; env++) {
+        drawn += chip8_gym_observations(gym)[env * chip8::SCREEN_HEIGHT] != 0;
+    }
+    CHECK(drawn > 0 && drawn < 64);
+    chip8_gym_destroy(gym);
+
+    // A faulting environment is done after its first frame
+    const std::vector<std::uint8_t> faulting = { 0x50, 0x01 };
+    config.num_envs = 1;
+    config.sticky_action_probability = 0;
+    gym = chip8_gym_create(faulting.data(), faulting.size(), &config);
+    CHECK(gym != nullptr);
+    if (gym) {
+        chip8_gym_step(gym, actions);
+        CHECK(chip8_gym_dones(gym)[0] == 1 && chip8_gym_episode_frames(gym)[0] == 0);
+        chip8_gym_destroy(gym);
+    }
+
+    config.frameskip = 0;
+    CHECK(chip8_gym_create(KEY_DRAW_ROM.data(), KEY_DRAW_ROM.size(), &config) == nullptr);
+    config.frameskip = 1;
+    config.downsample = 3;
+    CHECK(chip8_gym_create(KEY_DRAW_ROM.data(), KEY_DRAW_ROM.size(), &config) == nullptr);
+}
+
+static std::vector<std::uint8_t> read_file(const std::filesystem::path &path)
+{
+    std::ifstream input(path, std::ios::binary);
+    return std::vector<std::uint8_t>(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+}
+
+static void trace_round_trip()
+{
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "chip8-checks.c8trace";
+    std::string error;
+
+    chip8::Machine machine = start(DRAWING_ROM);
+    chip8::Machine reference = start(DRAWING_ROM);
+    chip8::TraceRecorder trace(16);
+    CHECK(trace.open(path.string(), chip8::Platform::modern, error));
+    unsigned int executed = 0;
+    for (int frame = 0; frame < 20; frame++) {
+        executed += chip8::run_frame(machine, 20, trace);
+    }
+    run_frames(reference, 20);
+    trace.close();
+    CHECK(same(reference, machine));
+    CHECK(trace.get_record_count() == executed);
+
+    // The ring holds 16 records, so the drain kept up rather than dropping any
+    const std::vector<std::uint8_t> file = read_file(path);
+    chip8::Platform platform = chip8::Platform::xochip;
+    CHECK(chip8::read_trace_header(file.data(), file.size(), platform));
+    CHECK(platform == chip8::Platform::modern);
+    CHECK(file.size() == chip8::TRACE_HEADER_SIZE + executed * chip8::TRACE_RECORD_SIZE);
+    if (file.size() != chip8::TRACE_HEADER_SIZE + executed * chip8::TRACE_RECORD_SIZE) {
+        return;
+    }
+    std::vector<chip8::TraceRecord> records;
+    for (std::size_t offset = chip8::TRACE_HEADER_SIZE; offset < file.size(); offset += chip8::TRACE_RECORD_SIZE) {
+        records.push_back(chip8::read_trace_record(&file[offset]));
+    }
+    for (std::size_t i = 0; i < records.size(); i++) {
+        CHECK(records[i].cycle == i + 1);
+    }
+
+    auto format = [](const chip8::TraceRecord &record, chip8::Platform platform) {
+        std::vector<char> line(chip8::MAX_TRACE_LINE);
+        return std::string(line.data(), chip8::format_trace_record(record, platform, line));
+    };
+    CHECK(format(records[0], chip8::Platform::modern) == "         1  0x0200  0x6005  LD V0, 0x05  V0=0x05\n");
+    CHECK(format(records[4], chip8::Platform::modern) == "         5  0x0208  0xd125  DRW V1, V2, 0x5  VF=0x00\n");
+    CHECK(format(records[8], chip8::Platform::modern).starts_with("         9  0x0210  0xf033  LD B, V0  [0x0300]=0x0"));
+    CHECK(format(records[8], chip8::Platform::modern).ends_with(" +2\n"));
+    CHECK(records[8].write_address == 0x300 && records[8].write_count == 3);
+
+    // VF is only listed after a logic op on platforms where it clears VF
+    chip8::TraceRecord logic { 7, 0x200, 0x8121, 0x000, 0, 0x03, 0x00, 0, 0 };
+    CHECK(format(logic, chip8::Platform::modern) == "         7  0x0200  0x8121  OR V1, V2  V1=0x03\n");
+    CHECK(format(logic, chip8::Platform::cosmac_vip) == "         7  0x0200  0x8121  OR V1, V2  V1=0x03  VF=0x00\n");
+    CHECK(chip8::format_trace_record(logic, chip8::Platform::modern, std::span<char>()) == 0);
+
+    // Only instructions in the PC range are kept
+    chip8::Machine filtered = start(DRAWING_ROM);
+    chip8::TraceRecorder range(16);
+    range.set_pc_range(0x206, 0x20a);
+    CHECK(range.open(path.string(), chip8::Platform::modern, error));
+    for (int frame = 0; frame < 20; frame++) {
+        chip8::run_frame(filtered, 20, range);
+    }
+    range.close();
+    CHECK(same(reference, filtered));
+    const std::vector<std::uint8_t> filtered_file = read_file(path);
+    std::size_t kept = 0;
+    for (const chip8::TraceRecord &record : records) {
+        kept += record.pc >= 0x206 && record.pc <= 0x20a;
+    }
+    CHECK(kept > 0 && range.get_record_count() == kept);
+    CHECK(filtered_file.size() == chip8::TRACE_HEADER_SIZE + kept * chip8::TRACE_RECORD_SIZE);
+    for (std::size_t offset = chip8::TRACE_HEADER_SIZE; offset + chip8::TRACE_RECORD_SIZE <= filtered_file.size(); offset += chip8::TRACE_RECORD_SIZE) {
+        std::uint16_t pc = chip8::read_trace_record(&filtered_file[offset]).pc;
+        CHECK(pc >= 0x206 && pc <= 0x20a);
+    }
+
+    std::filesystem::remove(path);
+    CHECK(!chip8::read_trace_header(file.data(), chip8::TRACE_HEADER_SIZE - 1, platform));
+}
+
+static void profile_counts()
+{
+    const std::vector<std::uint8_t> rom = {
+        0x60, 0x05,     // 0x200  LD V0, 0x05
+        0x30, 0x05,     // 0x202  SE V0, 0x05, taken
+        0x60, 0x00,     // 0x204  LD V0, 0x00
+        0x40, 0x05,     // 0x206  SNE V0, 0x05, not taken
+        0xF0, 0x29,     // 0x208  LD F, V0
+        0xD1, 0x15,     // 0x20a  DRW V1, V1, 5
+        0xD1, 0x15,     // 0x20c  DRW V1, V1, 5, erasing it again
+        0x12, 0x0E,     // 0x20e  JP 0x20e
+    };
+
+    chip8::Machine machine = start(rom);
+    chip8::Machine reference = start(rom);
+    chip8::Profile profile;
+    CHECK(chip8::run_frame(machine, 20, profile) == 20);
+    run_frames(reference, 1);
+    CHECK(same(reference, machine));
+
+    CHECK(profile.get_cycles() == 20);
+    CHECK(profile.pc_counts[0x200] == 1 && profile.pc_counts[0x202] == 1 && profile.pc_counts[0x204] == 0);
+    CHECK(profile.pc_counts[0x20a] == 1 && profile.pc_counts[0x20c] == 1 && profile.pc_counts[0x20e] == 14);
+    CHECK(profile.skips_taken == 1);
+    CHECK(profile.draw_collisions == 1);
+
+    const std::string report = chip8::format_profile_report(profile, rom, 0x200, chip8::Platform::modern);
+    CHECK(report.find("cycles=20 draws=2 (10.0%) collisions=1 (50.0% of draws) skips=2 taken=1 (50.0%)\n") != std::string::npos);
+
+    // One profile collects over several machines
+    chip8::Machine second = start(rom);
+    chip8::run_frame(second, 20, profile);
+    CHECK(profile.get_cycles() == 40 && profile.skips_taken == 2 && profile.draw_collisions == 2);
+}
+
+static void batch_order()
+{
+    // Jobs of very different lengths, and ones that fail, still come out in manifest order
+    const std::vector<std::uint8_t> halting = { 0x00, 0xEE };
+    std::vector<runner::BatchJob> jobs;
+    for (int i = 0; i < 12; i++) {
+        runner::BatchJob job;
+        job.rom_path = "missing-" + std::to_string(i) + ".ch8";
+        if (i % 4 == 3) {
+            job.rom = std::span<const std::uint8_t>(halting);
+        } else if (i % 4 != 2) {
+            job.rom = std::span<const std::uint8_t>(i % 2 ? DRAWING_ROM : KEY_ROM);
+        }
+        jobs.push_back(job);
+    }
+    runner::RunOptions options;
+    options.platform = chip8::Platform::modern;
+    options.frames = 120;
+
+    auto run = [&](unsigned int threads, std::size_t &failed) {
+        std::FILE *output = std::tmpfile();
+        failed = runner::run_batch(jobs, options, threads, output);
+        std::vector<std::string> lines;
+        std::rewind(output);
+        char line[1024];
+        while (std::fgets(line, sizeof(line), output)) {
+            // Drop the timing, the one field that differs between runs
+            std::string text = line;
+            std::size_t seconds = text.find(" seconds=");
+            if (seconds != std::string::npos) {
+                text.erase(seconds, text.find(' ', seconds + 1) - seconds);
+            }
+            lines.push_back(text);
+        }
+        std::fclose(output);
+        return lines;
+    };
+
+    std::size_t failed = 0;
+    const std::vector<std::string> lines = run(4, failed);
+    CHECK(failed == 6);
+    CHECK(lines.size() == jobs.size());
+    for (std::size_t i = 0; i < lines.size(); i++) {
+        CHECK(lines[i].starts_with("job=" + std::to_string(i) + " "));
+        CHECK(lines[i].ends_with(" rom=missing-" + std::to_string(i) + ".ch8\n"));
+        CHECK((lines[i].find(" error=") != std::string::npos) == (i % 4 == 2));
+        CHECK((lines[i].find(" fault=\"no fault\"") != std::string::npos) == (i % 4 < 2));
+        CHECK((lines[i].find(" fault=\"stack underflow\"") != std::string::npos) == (i % 4 == 3));
+    }
+
+    std::size_t serial_failed = 0;
+    CHECK(run(1, serial_failed) == lines);
+    CHECK(serial_failed == failed);
+}
+
+static void work_stealing()
+{
+    runner::WorkStealingPool pool(3);
+    CHECK(pool.worker_count() == 3);
+    CHECK(runner::WorkStealingPool(0).worker_count() == 1);
+
+    // Every job runs once, on one of the workers, however many jobs there are
+    for (std::size_t job_count : { 0u, 1u, 2u, 100u, 1001u }) {
+        std::vector<std::atomic<int>> runs(job_count);
+        std::atomic<bool> bad_worker { false };
+        pool.run(job_count, [&](unsigned int worker, std::size_t job) {
+            runs[job]++;
+            bad_worker = bad_worker || worker >= 3;
+        });
+        CHECK(std::all_of(runs.begin(), runs.end(), [](const std::atomic<int> &count) { return count == 1; }));
+        CHECK(!bad_worker);
+    }
+
+    // Worker 1 holds its first job until the others are done, so worker 0 must take the rest of its share
+    runner::WorkStealingPool pair(2);
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::size_t done = 0;
+    bool timed_out = false;
+    std::vector<unsigned int> owners(8);
+    pair.run(8, [&](unsigned int worker, std::size_t job) {
+        std::unique_lock<std::mutex> lock(mutex);
+        owners[job] = worker;
+        if (worker == 1 && job == 4) {
+            timed_out = !finished.wait_for(lock, std::chrono::seconds(10), [&] { return done == 7; });
+        }
+        done++;
+        finished.notify_all();
+    });
+    CHECK(!timed_out);
+    CHECK(done == 8);
+    CHECK(owners[5] == 0 && owners[6] == 0 && owners[7] == 0);
+}
+
+static void memory_usage_sharing()
+{
+    auto total = [](const chip8::MemoryUsage &usage) { return usage.private_bytes + usage.shared_bytes; };
+
+    chip8::Machine machine = start(DRAWING_ROM);
+    const chip8::MemoryUsage alone = chip8::get_memory_usage(machine);
+    CHECK(total(alone) > 4096 && alone.overhead_bytes >= sizeof(chip8::Machine));
+    CHECK(alone.proportional_bytes >= alone.private_bytes && alone.proportional_bytes <= total(alone));
+
+    // A fork shares every page, so both see the same bytes, all shared, and each counts less of them
+    chip8::Machine child = chip8::fork(machine);
+    const chip8::MemoryUsage parent = chip8::get_memory_usage(machine);
+    const chip8::MemoryUsage forked = chip8::get_memory_usage(child);
+    CHECK(parent.private_bytes == 0 && parent.shared_bytes == total(alone));
+    CHECK(forked.private_bytes == 0 && forked.shared_bytes == total(alone));
+    CHECK(parent.proportional_bytes == forked.proportional_bytes);
+    CHECK(parent.proportional_bytes < alone.proportional_bytes);
+
+    // A write copies one page for the writer only; the parent's pages are all still in use by the child
+    chip8::write_memory(child, 0x300, 0x55);
+    const chip8::MemoryUsage parent_after = chip8::get_memory_usage(machine);
+    const chip8::MemoryUsage written = chip8::get_memory_usage(child);
+    CHECK(written.private_bytes > 0 && written.private_bytes < total(alone));
+    CHECK(written.shared_bytes == total(alone));
+    CHECK(parent_after.private_bytes == 0 && parent_after.shared_bytes == total(alone));
+    CHECK(written.proportional_bytes - forked.proportional_bytes == written.private_bytes);
+
+    // Machines started from one image share its pages, and each one more that does lowers every share
+    chip8::RomImage image;
+    CHECK(chip8::make_rom_image(chip8::Platform::modern, DRAWING_ROM.data(), DRAWING_ROM.size(), image));
+    chip8::Machine first, second;
+    chip8::load_rom(first, image);
+    const chip8::MemoryUsage one_user = chip8::get_memory_usage(first);
+    chip8::load_rom(second, image);
+    const chip8::MemoryUsage two_users = chip8::get_memory_usage(first);
+    CHECK(one_user.shared_bytes >= 4096);
+    CHECK(two_users.private_bytes == one_user.private_bytes && two_users.shared_bytes == one_user.shared_bytes);
+    CHECK(two_users.proportional_bytes < one_user.proportional_bytes);
+}
+
+struct Check {
+    const char *name;
+    void (*run)();
+};
+
+static const Check CHECKS[] = {
+    { "save_load_round_trip", save_load_round_trip },
+    { "save_state_validation", save_state_validation },
+    { "fork_isolation", fork_isolation },
+    { "rom_too_large", rom_too_large },
+    { "fault_reporting", fault_reporting },
+    { "scheduler", scheduler },
+    { "reward_parse_errors", reward_parse_errors },
+    { "cfg_round_trip", cfg_round_trip },
+    { "rompack_validation", rompack_validation },
+    { "jump_offset_disassembly", jump_offset_disassembly },
+    { "sha1_vectors", sha1_vectors },
+    { "rom_database", rom_database },
+    { "lanes_self_modifying_code", lanes_self_modifying_code },
+    { "gym_stepping", gym_stepping },
+    { "trace_round_trip", trace_round_trip },
+    { "profile_counts", profile_counts },
+    { "batch_order", batch_order },
+    { "work_stealing", work_stealing },
+    { "memory_usage_sharing", memory_usage_sharing },
+};
+
+int main(int argc, char **argv)
+{
+    if (argc > 2) {
+        std::fprintf(stderr, "usage: %s [check]\n", argv[0]);
+        return 2;
+    }
+
+    bool found = false;
+    for (const Check &check : CHECKS) {
+        if (argc == 2 && std::strcmp(argv[1], check.name) != 0) {
+            continue;
+        }
+        found = true;
+        int before = failures;
+        check.run();
+        std::printf("%s %s\n", failures == before ? "ok  " : "FAIL", check.name);
+    }
+
+    if (!found) {
+        std::fprintf(stderr, "unknown check %s\n", argv[1]);
+        return 2;
+    }
+    return failures == 0 ? 0 : 1;
+}